@@ -4,27 +4,61 @@
 #include "Window.h"
 
 struct CommandBuffer {
-    virtual void BeginRendering(Handle<Texture> depth, u32 layer, u32 width, u32 height) = 0;
-    virtual void BeginRendering(Extent2D extent, const span<const Handle<Texture>>&& attachments = {}, Handle<Texture> depth = {}) = 0;
-    virtual void BeginRenderingSwapchain(Handle<Texture> depth = {}) = 0;
+    // Render to a single layer of a depth texture. To render to all layers at once, use layer = -1. The layer of each primitive
+    // is then selected with SV_RenderTargetArrayIndex. If clear is false, the previous contents are loaded instead of cleared,
+    // and parts of them can be cleared with ClearDepth.
+    virtual void BeginRendering(Handle<Texture> depth, u32 layer, u32 width, u32 height, bool clear = true) = 0;
+    // If readOnlyDepth is set, depth must be in SHADER_RESOURCE usage. It is then bound read-only, so it can be tested against
+    // while it is also sampled. If clearDepth is false, the previous contents of depth are loaded instead of cleared.
+    virtual void BeginRendering(Extent2D extent, const span<const Handle<Texture>>&& attachments = {}, Handle<Texture> depth = {}, bool readOnlyDepth = false, bool clearDepth = true, bool clearColor = true) = 0;
+    virtual void BeginRenderingSwapchain(Handle<Texture> depth = {}, bool readOnlyDepth = false) = 0;
     virtual void EndRendering() = 0;
 
+    // Clear a region of the depth attachment of the current rendering scope.
+    virtual void ClearDepth(const Rect2D& rect, u32 baseLayer = 0, u32 layerCount = 1, float depth = 0.0f) = 0;
+
     // Insert an image barrier. To transition all mip levels, use mipCount = -1. To transition all array layers, use layerCount = -1
     virtual void ImageBarrier(Handle<Texture> texture, Usage srcUsage, Usage dstUsage, u32 baseMip = 0, u32 mipCount = 1, u32 baseLayer = 0, u32 layerCount = 1) = 0;
 
+    // Copy regions of mip 0, layer 0 of src to the same regions of dst. src must be in TRANSFER_SRC and dst in TRANSFER_DST usage.
+    virtual void CopyTexture(Handle<Texture> src, Handle<Texture> dst, span<const Rect2D> regions) = 0;
+
+    // Insert a buffer memory barrier. To cover the rest of the buffer from offset, use size = -1
+    // Use USAGE_NONE as dstUsage to make device writes visible to the host once the frame has finished, e.g. for readbacks.
+    virtual void BufferBarrier(Handle<Buffer> buffer, Usage srcUsage, Usage dstUsage, u64 offset = 0, u64 size = -1) = 0;
+
     virtual void SetPipeline(Handle<Pipeline> handle) = 0;
     virtual void SetBindGroup(Handle<BindGroup> handle, u32 index, span<const u32> dynamicOffsets = {}) = 0;
     virtual void PushConstants(void* data, u32 offset, u32 size, u32 stages) = 0;
 
-    virtual void SetVertexBuffer(Handle<Buffer> handle, u64 offset) = 0;
+    virtual void SetVertexBuffer(Handle<Buffer> handle, u64 offset, u32 binding = 0) = 0;
     virtual void SetIndexBuffer(Handle<Buffer> handle, u64 offset, IndexType type) = 0;
 
     virtual void SetScissor(const Rect2D& scissor) = 0;
     virtual void SetViewport(float width, float height) = 0;
 
+    // Set viewports and scissors to the given rects. Primitives select a viewport with SV_ViewportArrayIndex.
+    // The pipeline must have been created with a GraphicsState.viewportCount of at least rects.size().
+    virtual void SetViewports(span<const Rect2D> rects) = 0;
+
+    // Set the depth range [minDepth, maxDepth] passed by pipelines with GraphicsState.depthStencilState.depthBoundsTestEnable.
+    virtual void SetDepthBounds(float minDepth, float maxDepth) = 0;
+
     virtual void Draw(u32 vertexCount, u32 instanceCount, u32 firstVertex, u32 firstInstance) = 0;
     virtual void DrawIndexed(u32 indexCount, u32 instanceCount, u32 firstIndex, u32 vertexOffset, u32 firstInstance) = 0;
 
+    // Issue drawCount indexed draws with arguments read from an array of DrawIndexedIndirectCommand in buffer.
+    // The Count variant reads the number of draws from countBuffer, clamped to maxDrawCount.
+    virtual void DrawIndexedIndirect(Handle<Buffer> buffer, u64 offset, u32 drawCount, u32 stride = sizeof(DrawIndexedIndirectCommand)) = 0;
+    virtual void DrawIndexedIndirectCount(Handle<Buffer> buffer, u64 offset, Handle<Buffer> countBuffer, u64 countOffset, u32 maxDrawCount, u32 stride = sizeof(DrawIndexedIndirectCommand)) = 0;
+
+    virtual void Dispatch(u32 groupCountX, u32 groupCountY, u32 groupCountZ) = 0;
+    virtual void DispatchIndirect(Handle<Buffer> buffer, u64 offset) = 0;
+
+    // Write a GPU timestamp to slot query < Device::MaxTimestamps once all previous commands have completed.
+    // Only valid on the frame command buffer. Read the results back with Device::GetTimestampDelta.
+    virtual void WriteTimestamp(u32 query) = 0;
+
     u32 m_index = 0;
 };
 
@@ -33,6 +67,7 @@ public:
     static Device* ptr;
 
     static constexpr u32 MaxFramesInFlight = 2;
+    static constexpr u32 MaxTimestamps     = 32;
 
     virtual ~Device() {};
 
@@ -48,6 +83,10 @@ public:
 
     virtual Format GetSwapchainFormat() = 0;
     virtual Extent2D GetSwapchainExtent() = 0;
+
+    // Milliseconds between the timestamps written to slots begin and end, by the frame that last used the current frame
+    // index, i.e. MaxFramesInFlight frames ago. Returns 0 if either timestamp was not written. Valid after BeginFrame.
+    virtual float GetTimestampDelta(u32 begin, u32 end) = 0;
     
     bool windowResized = false;
 
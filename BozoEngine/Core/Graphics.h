@@ -14,6 +14,13 @@ typedef int64_t  i64;
 #include <vector>
 #include "../span.h"
 
+// SGR escape sequences: https://docs.microsoft.com/en-us/windows/console/console-virtual-terminal-sequences
+#define SGR_SET_BG_GRAY  "\x1B[100;1m"
+#define SGR_SET_BG_BLUE	 "\x1B[44;1m"
+#define SGR_SET_BG_RED	 "\x1B[41;1m"
+#define SGR_SET_TXT_BLUE "\x1B[34;1m"
+#define SGR_SET_DEFAULT  "\x1B[0m"
+
 // REVISIT THESE, LOOK INTO BETTER LOGGING
 #define Check(expression, message, ...) do {	\
 	if(!(expression)) {							\
@@ -64,6 +71,7 @@ enum class Memory {
 enum class Format {
 	UNDEFINED,
 	R8_UNORM,
+    RG8_UNORM,
 	RGBA8_UNORM,
 	RGBA8_SRGB,
     BGRA8_SRGB,
@@ -71,6 +79,11 @@ enum class Format {
 	D32_SFLOAT,
     RG32_SFLOAT,
     RGB32_SFLOAT,
+    RG16_UNORM,
+    RG16_SFLOAT,
+    R32_UINT,
+    RGBA16_SNORM,
+    RGBA16_SFLOAT,
     RGBA32_SFLOAT
 };
 
@@ -85,13 +98,19 @@ enum Usage : u32 {
 
 	VERTEX_BUFFER		= 1 << 5,
 	INDEX_BUFFER		= 1 << 6,
-	UNIFORM_BUFFER		= 1 << 7
+	UNIFORM_BUFFER		= 1 << 7,
+
+	// Read-write access from shaders. Storage images for textures, storage buffers for buffers.
+	// Buffers with SHADER_RESOURCE usage are also backed by (read-only) storage buffers.
+	UNORDERED_ACCESS	= 1 << 8,
+	INDIRECT_BUFFER		= 1 << 9
 };
 
 enum ShaderStage : u32 {
     STAGE_NONE = 0,
     VERTEX     = 1 << 0,
-    FRAGMENT   = 1 << 1
+    FRAGMENT   = 1 << 1,
+    COMPUTE    = 1 << 2
 };
 
 enum class CompareOp {
@@ -239,7 +258,9 @@ struct Binding {
     enum class Type {
         TEXTURE,
         BUFFER,
-        DYNAMIC
+        DYNAMIC,
+        STORAGE_BUFFER,
+        STORAGE_TEXTURE
     };
 
     Type type;
@@ -387,6 +408,9 @@ struct GraphicsState {
         bool depthWriteEnable     = true;
         CompareOp depthCompareOp  = CompareOp::GreaterEqual;
 
+        // Discard fragments whose stored depth lies outside the bounds set with CommandBuffer::SetDepthBounds.
+        bool depthBoundsTestEnable = false;
+
         bool stencilTestEnable    = false;
         StencilState frontStencilState = {};
         StencilState backStencilState  = {};
@@ -403,26 +427,41 @@ struct GraphicsState {
         FrontFace frontFace   = FrontFace::CounterClockwise;
     } rasterizationState = {};
 
-    // NOTE: Only support 1 vertex input for now. Consider supporting multiple if needed later.
+    // Attribute i is read from location i. Each attribute is read from one of the vertex buffer bindings, whose strides are
+    // given by bindingStrides. See CommandBuffer::SetVertexBuffer.
     struct VertexInputState {
         struct Attribute {
             u32 offset;
             Format format;
+            u32 binding = 0;
         };
 
-        u32 vertexStride = 0;
+        std::vector<u32> bindingStrides = {};
         std::vector<Attribute> attributes = {};
     } vertexInputState = {};
 
     u32 sampleCount = 1;
+
+    // Number of viewports primitives can select from with SV_ViewportArrayIndex. See CommandBuffer::SetViewports.
+    u32 viewportCount = 1;
+};
+
+// Value of a shader specialization constant, declared in HLSL as [[vk::constant_id(id)]] const uint name = default;
+struct SpecializationConstant {
+    u32 id;
+    u32 value;
 };
 
 struct ShaderDesc { 
     span<const u32> spirv = {};
     ShaderStage stage     = ShaderStage::STAGE_NONE;
     const char* entry     = "main"; 
+
+    span<const SpecializationConstant> specialization = {};
 };
 
+// A pipeline is created as a compute pipeline if shaderDescs contains a single COMPUTE stage shader.
+// The graphicsState is ignored for compute pipelines.
 struct PipelineDesc {
     const char* debugName = "";
 
@@ -439,4 +478,13 @@ struct Extent2D { u32 width, height; };
 struct Rect2D {
     Offset2D offset;
     Extent2D extent;
-};
\ No newline at end of file
+};
+
+// Indirect draw arguments, laid out to match VkDrawIndexedIndirectCommand so they can be written straight into INDIRECT_BUFFER buffers.
+struct DrawIndexedIndirectCommand {
+    u32 indexCount;
+    u32 instanceCount;
+    u32 firstIndex;
+    i32 vertexOffset;
+    u32 firstInstance;
+};
@@ -36,6 +36,8 @@ public:
 
     // Write `size` bytes from `data` to a mapped buffer.
     virtual bool WriteBuffer(Handle<Buffer> handle, const void* data, u32 size, u32 offset = 0) = 0;
+    // Read `size` bytes of a host visible buffer written by the GPU into `data`.
+    virtual bool ReadBuffer(Handle<Buffer> handle, void* data, u32 size, u32 offset = 0)        = 0;
 
     // Upload data to device-local buffer/texture
     virtual bool Upload(Handle<Buffer> handle, const void* data, u32 size)                   = 0;
@@ -46,4 +48,7 @@ public:
 
     virtual bool MapBuffer(Handle<Buffer>   handle) = 0;
     virtual void UnmapBuffer(Handle<Buffer> handle) = 0;
+
+    // Make `size` bytes written through the mapped pointer of a buffer visible to the GPU.
+    virtual bool FlushBuffer(Handle<Buffer> handle, u32 size, u32 offset = 0) = 0;
 };
\ No newline at end of file
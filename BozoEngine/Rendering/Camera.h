@@ -8,6 +8,11 @@
 
 class Camera {
 public:
+	// Depth buffers are cleared to 0, the far plane of the reversed-z projection, and only the sky is left at 0.
+	// Any rendered surface has a depth of at least one step of a 24 bit depth buffer, so a depth bounds test of
+	// [MinSurfaceDepth, 1] passes every surface and rejects the sky.
+	static constexpr float MinSurfaceDepth = 0.5f / 16777215.0f;
+
 	Camera(glm::vec3 startPos, float speed, float fov, float aspect, float zNear, float pitch, float yaw);
 	~Camera();
 
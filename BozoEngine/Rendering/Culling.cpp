@@ -0,0 +1,143 @@
+#include "Culling.h"
+
+// Pick the widest instruction set the compiler targets. MSVC does not define __SSE2__, but SSE2 is always available on x64.
+#if defined(__AVX2__)
+    #define CULLING_AVX2
+    #include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define CULLING_SSE
+    #include <emmintrin.h>
+#endif
+
+Frustum Frustum::FromMatrix(const glm::mat4& m, u32 planes) {
+    // glm matrices are column major, so row i is (m[0][i], m[1][i], m[2][i], m[3][i]).
+    glm::vec4 r[4];
+    for (u32 i = 0; i < 4; i++) {
+        r[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+    }
+
+    // -w <= x <= w, -w <= y <= w and 0 <= z <= w
+    const glm::vec4 candidates[6] = {
+        r[3] + r[0], r[3] - r[0],
+        r[3] + r[1], r[3] - r[1],
+        r[2],        r[3] - r[2]
+    };
+
+    Frustum frustum;
+    for (u32 i = 0; i < 6; i++) {
+        if (!HasFlag(planes, 1u << i)) continue;
+
+        const float length = glm::length(glm::vec3(candidates[i]));
+        if (length < 1e-8f) continue;
+
+        frustum.planes[frustum.count++] = candidates[i] / length;
+    }
+
+    return frustum;
+}
+
+void BoundsSoA::Resize(u32 count) {
+    centerX.resize(count); centerY.resize(count); centerZ.resize(count);
+    extentX.resize(count); extentY.resize(count); extentZ.resize(count);
+}
+
+void BoundsSoA::Set(u32 i, const glm::vec3& center, const glm::vec3& extent) {
+    centerX[i] = center.x; centerY[i] = center.y; centerZ[i] = center.z;
+    extentX[i] = extent.x; extentY[i] = extent.y; extentZ[i] = extent.z;
+}
+
+// A box is outside a plane if the signed distance of its center is less than -r, where r is the projected radius of
+// the box onto the plane normal: r = dot(abs(n), extent). The box is culled if it is outside any of the planes.
+bool FrustumTest(const Frustum& frustum, const AABB& box) {
+    for (u32 p = 0; p < frustum.count; p++) {
+        const glm::vec4& plane = frustum.planes[p];
+
+        const float d = plane.x * box.center.x + plane.y * box.center.y + plane.z * box.center.z + plane.w;
+        const float r = glm::abs(plane.x) * box.extent.x + glm::abs(plane.y) * box.extent.y + glm::abs(plane.z) * box.extent.z;
+
+        if (d + r < 0.0f) return false;
+    }
+
+    return true;
+}
+
+u32 FrustumCull(const Frustum& frustum, const BoundsSoA& bounds, u8* visible) {
+    const u32 count = bounds.Size();
+    u32 visibleCount = 0;
+    u32 i = 0;
+
+#if defined(CULLING_AVX2)
+    for (; i + 8 <= count; i += 8) {
+        const __m256 cx = _mm256_loadu_ps(&bounds.centerX[i]);
+        const __m256 cy = _mm256_loadu_ps(&bounds.centerY[i]);
+        const __m256 cz = _mm256_loadu_ps(&bounds.centerZ[i]);
+        const __m256 ex = _mm256_loadu_ps(&bounds.extentX[i]);
+        const __m256 ey = _mm256_loadu_ps(&bounds.extentY[i]);
+        const __m256 ez = _mm256_loadu_ps(&bounds.extentZ[i]);
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (u32 p = 0; p < frustum.count; p++) {
+            const glm::vec4& plane = frustum.planes[p];
+
+            __m256 d = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), cx), _mm256_set1_ps(plane.w));
+            d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(plane.y), cy));
+            d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(plane.z), cz));
+
+            __m256 r = _mm256_mul_ps(_mm256_set1_ps(glm::abs(plane.x)), ex);
+            r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_set1_ps(glm::abs(plane.y)), ey));
+            r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_set1_ps(glm::abs(plane.z)), ez));
+
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(d, r), _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+
+        const u32 mask = (u32)_mm256_movemask_ps(inside);
+        for (u32 j = 0; j < 8; j++) {
+            visible[i + j] = (mask >> j) & 1;
+            visibleCount  += (mask >> j) & 1;
+        }
+    }
+#elif defined(CULLING_SSE)
+    for (; i + 4 <= count; i += 4) {
+        const __m128 cx = _mm_loadu_ps(&bounds.centerX[i]);
+        const __m128 cy = _mm_loadu_ps(&bounds.centerY[i]);
+        const __m128 cz = _mm_loadu_ps(&bounds.centerZ[i]);
+        const __m128 ex = _mm_loadu_ps(&bounds.extentX[i]);
+        const __m128 ey = _mm_loadu_ps(&bounds.extentY[i]);
+        const __m128 ez = _mm_loadu_ps(&bounds.extentZ[i]);
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (u32 p = 0; p < frustum.count; p++) {
+            const glm::vec4& plane = frustum.planes[p];
+
+            __m128 d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), cx), _mm_set1_ps(plane.w));
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(plane.y), cy));
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(plane.z), cz));
+
+            __m128 r = _mm_mul_ps(_mm_set1_ps(glm::abs(plane.x)), ex);
+            r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(glm::abs(plane.y)), ey));
+            r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(glm::abs(plane.z)), ez));
+
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(d, r), _mm_setzero_ps()));
+        }
+
+        const u32 mask = (u32)_mm_movemask_ps(inside);
+        for (u32 j = 0; j < 4; j++) {
+            visible[i + j] = (mask >> j) & 1;
+            visibleCount  += (mask >> j) & 1;
+        }
+    }
+#endif
+
+    // Scalar fallback for the remaining boxes
+    for (; i < count; i++) {
+        const AABB box = {
+            .center = glm::vec3(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]),
+            .extent = glm::vec3(bounds.extentX[i], bounds.extentY[i], bounds.extentZ[i])
+        };
+
+        visible[i] = FrustumTest(frustum, box);
+        visibleCount += visible[i];
+    }
+
+    return visibleCount;
+}
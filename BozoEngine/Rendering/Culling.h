@@ -0,0 +1,49 @@
+#pragma once
+
+#include "../Core/Graphics.h"
+
+#include <glm/glm.hpp>
+
+// Convex culling volume given by up to 6 planes. A point p is inside plane i if dot(planes[i].xyz, p) + planes[i].w >= 0.
+struct Frustum {
+    // Clip space planes that can be selected when extracting a frustum from a matrix.
+    enum Plane : u32 {
+        LEFT   = 1 << 0,    // -w <= x
+        RIGHT  = 1 << 1,    //  x <= w
+        BOTTOM = 1 << 2,    // -w <= y
+        TOP    = 1 << 3,    //  y <= w
+        ZMIN   = 1 << 4,    //  0 <= z
+        ZMAX   = 1 << 5,    //  z <= w
+        ALL    = 0x3F
+    };
+
+    glm::vec4 planes[6];
+    u32 count = 0;
+
+    // Extract the selected planes of the clip volume of a world to clip space matrix (Vulkan clip space, 0 <= z <= w).
+    // Degenerate planes, like the far plane of an infinite projection, are skipped.
+    static Frustum FromMatrix(const glm::mat4& viewProj, u32 planes = Plane::ALL);
+};
+
+struct AABB {
+    glm::vec3 center;
+    glm::vec3 extent;   // half-extents
+};
+
+// Returns true if the box is at least partially inside the frustum.
+bool FrustumTest(const Frustum& frustum, const AABB& box);
+
+// World space axis-aligned bounding boxes stored in SoA layout, so they can be tested several at a time with SIMD.
+struct BoundsSoA {
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> extentX, extentY, extentZ;
+
+    void Resize(u32 count);
+    void Set(u32 i, const glm::vec3& center, const glm::vec3& extent);
+    u32  Size() const { return (u32)centerX.size(); }
+};
+
+// Test every box in bounds against the frustum. visible[i] is set to 1 if box i is at least partially inside, and to 0 otherwise.
+// visible must hold bounds.Size() elements. Returns the number of visible boxes.
+// Boxes are tested 8 at a time with AVX2, 4 at a time with SSE, or one at a time if neither is available.
+u32 FrustumCull(const Frustum& frustum, const BoundsSoA& bounds, u8* visible);
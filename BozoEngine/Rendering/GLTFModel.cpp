@@ -1,12 +1,17 @@
 #include "GLTFModel.h"
+#include "MeshOptimizer.h"
+#include "VisibilityBuffer.h"
 
 #include "../Core/ResourceManager.h"
 
 #define GLM_FORCE_QUAT_DATA_XYZW // glTF stores quaternions with xyzw layout. GLM defaults to wxyz.
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/packing.hpp>
 #include <glm/ext/matrix_transform.hpp>
 
 #include <string>
+#include <algorithm>
+#include <bit>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
@@ -24,16 +29,80 @@
 #pragma warning(pop)
 
 const GraphicsState::VertexInputState GLTFModel::Vertex::InputState = {
-	.vertexStride = sizeof(Vertex),
+	.bindingStrides = { sizeof(glm::vec3), sizeof(Vertex) },
 	.attributes = {
-		{.offset = offsetof(Vertex, pos),     .format = Format::RGB32_SFLOAT  },
-		{.offset = offsetof(Vertex, normal),  .format = Format::RGB32_SFLOAT  },
-		{.offset = offsetof(Vertex, tangent), .format = Format::RGBA32_SFLOAT },
-		{.offset = offsetof(Vertex, uv),      .format = Format::RG32_SFLOAT   },
-		{.offset = offsetof(Vertex, color),   .format = Format::RGB32_SFLOAT  },
+		{.offset = 0,                               .format = Format::RGB32_SFLOAT, .binding = 0 },
+		{.offset = offsetof(Vertex, normalTangent), .format = Format::RGBA16_SNORM, .binding = 1 },
+		{.offset = offsetof(Vertex, uv),            .format = Format::RG16_SFLOAT,  .binding = 1 },
 	}
 };
 
+const GraphicsState::VertexInputState GLTFModel::Vertex::PositionInputState = {
+	.bindingStrides = { sizeof(glm::vec3) },
+	.attributes = { {.offset = 0, .format = Format::RGB32_SFLOAT } }
+};
+
+// Map a direction onto the octahedron, unfolded onto the [-1, 1] square. Zero vectors map to +z.
+static glm::vec2 OctahedralEncode(glm::vec3 v) {
+	const float l1 = glm::abs(v.x) + glm::abs(v.y) + glm::abs(v.z);
+	if (l1 == 0.0f) return glm::vec2(0.0f);
+
+	glm::vec2 e = glm::vec2(v) / l1;
+	if (v.z < 0.0f) {
+		const glm::vec2 signs = glm::vec2(e.x >= 0.0f ? 1.0f : -1.0f, e.y >= 0.0f ? 1.0f : -1.0f);
+		e = (1.0f - glm::abs(glm::vec2(e.y, e.x))) * signs;
+	}
+	return e;
+}
+
+// Quantize the vertex attributes, see Shaders/vertex.hlsli for the layout.
+static GLTFModel::Vertex PackVertex(glm::vec3 normal, glm::vec4 tangent, glm::vec2 uv) {
+	const glm::vec2 n = OctahedralEncode(normal);
+	const glm::vec2 t = OctahedralEncode(glm::vec3(tangent));
+
+	// The tangent's y is remapped to (0, 1], so its sign is free to hold the bitangent sign. Clamping to the smallest
+	// positive snorm16 keeps the sign from being lost at 0.
+	const float ty = glm::max(t.y * 0.5f + 0.5f, 1.0f / 32767.0f) * (tangent.w < 0.0f ? -1.0f : 1.0f);
+
+	return {
+		.normalTangent = glm::u16vec4(glm::packSnorm1x16(n.x), glm::packSnorm1x16(n.y), glm::packSnorm1x16(t.x), glm::packSnorm1x16(ty)),
+		.uv = glm::u16vec2(glm::packHalf1x16(uv.x), glm::packHalf1x16(uv.y))
+	};
+}
+
+// Vertex cache statistics of every primitive of a model, before and after optimization.
+struct MeshStats {
+	VertexCacheStats before;
+	VertexCacheStats after;
+};
+
+// Weld the vertices of a primitive, then reorder its triangles for the vertex cache and overdraw, and its vertices for fetch locality.
+static void OptimizePrimitive(std::vector<u32>& indices, std::vector<glm::vec3>& positions, std::vector<GLTFModel::Vertex>& vertices, MeshStats& stats) {
+	stats.before += AnalyzeVertexCache(indices, (u32)positions.size());
+
+	std::vector<u32> remap;
+	const VertexStream streams[] = {
+		{ positions.data(), sizeof(glm::vec3) },
+		{ vertices.data(),  sizeof(GLTFModel::Vertex) }
+	};
+
+	u32 vertexCount = WeldVertices(indices, (u32)positions.size(), streams, remap);
+	RemapIndices(span<u32>(indices), remap);
+	RemapVertices(positions, remap, vertexCount);
+	RemapVertices(vertices, remap, vertexCount);
+
+	std::vector<u32> clusters;
+	OptimizeVertexCache(span<u32>(indices), vertexCount, clusters);
+	OptimizeOverdraw(span<u32>(indices), positions, clusters);
+
+	vertexCount = OptimizeVertexFetch(indices, vertexCount, remap);
+	RemapIndices(span<u32>(indices), remap);
+	RemapVertices(positions, remap, vertexCount);
+	RemapVertices(vertices, remap, vertexCount);
+
+	stats.after += AnalyzeVertexCache(indices, vertexCount);
+}
+
 static std::vector<Handle<Texture>> LoadImages(const tinygltf::Model& model) {
 	ResourceManager* rm = ResourceManager::ptr;
 
@@ -73,47 +142,48 @@ static std::vector<Handle<Texture>> LoadImages(const tinygltf::Model& model) {
 	return images;
 }
 
-static void LoadNode(const tinygltf::Node& inputNode, const tinygltf::Model& model, std::vector<GLTFModel::Node*>& nodes, GLTFModel::Node* parent, std::vector<u32>& indexBuffer, std::vector<GLTFModel::Vertex>& vertexBuffer) {
-	GLTFModel::Node* node = new GLTFModel::Node();
-	node->transform = glm::mat4(1.0f);
-	node->parent = parent;
+static void LoadNode(const tinygltf::Node& inputNode, const tinygltf::Model& model, GLTFModel::Hierarchy& hierarchy, std::vector<GLTFModel::Primitive>& primitives, i32 parent, std::vector<u32>& indexBuffer, std::vector<glm::vec3>& positions, std::vector<GLTFModel::Vertex>& vertexBuffer, MeshStats& stats) {
+	const u32 node = (u32)hierarchy.parents.size();
+	glm::mat4 transform = glm::mat4(1.0f);
 
 	// Get the local node transform matrix.
-	// Can either be given as a matrix array, in which case node->transform = matrix 
+	// Can either be given as a matrix array, in which case transform = matrix 
 	// Or with separate Translation, Rotation and Scale, in which case the matrix is computed by M = T * R * S.
 	if (inputNode.matrix.size() == 16) {
-		node->transform = glm::make_mat4x4(inputNode.matrix.data());
+		transform = glm::make_mat4x4(inputNode.matrix.data());
 	}
 	else {
 		if (inputNode.translation.size() == 3) {
-			node->transform = glm::translate(node->transform, glm::vec3(glm::make_vec3(inputNode.translation.data())));
+			transform = glm::translate(transform, glm::vec3(glm::make_vec3(inputNode.translation.data())));
 		}
 		if (inputNode.rotation.size() == 4) {
-			node->transform *= glm::mat4(glm::quat(glm::make_quat(inputNode.rotation.data())));
+			transform *= glm::mat4(glm::quat(glm::make_quat(inputNode.rotation.data())));
 		}
 		if (inputNode.scale.size() == 3) {
-			node->transform = glm::scale(node->transform, glm::vec3(glm::make_vec3(inputNode.scale.data())));
+			transform = glm::scale(transform, glm::vec3(glm::make_vec3(inputNode.scale.data())));
 		}
 	}
 
-	// Recursively load the children of the input node.
-	if (inputNode.children.size() > 0) {
-		for (size_t i = 0; i < inputNode.children.size(); i++) {
-			LoadNode(model.nodes[inputNode.children[i]], model, nodes, node, indexBuffer, vertexBuffer);
-		}
-	}
+	// Append the node before its children, so the hierarchy ends up in pre-order.
+	// The world transform is computed once the whole hierarchy is loaded.
+	hierarchy.parents.push_back(parent);
+	hierarchy.subtreeEnd.push_back(node + 1);
+	hierarchy.local.push_back(transform);
+	hierarchy.world.push_back(transform);
+	hierarchy.firstPrimitive.push_back((u32)primitives.size());
+	hierarchy.primitiveCount.push_back(0);
 
 	if (inputNode.mesh > -1) {
 		const tinygltf::Mesh mesh = model.meshes[inputNode.mesh];
 
 		// Reserve space for the mesh primitives
-		node->mesh.primitives.reserve(node->mesh.primitives.size() + mesh.primitives.size());
+		primitives.reserve(primitives.size() + mesh.primitives.size());
 
 		for (size_t i = 0; i < mesh.primitives.size(); i++) {
 			const tinygltf::Primitive& primitive = mesh.primitives[i];
 
 			u32 firstIndex = (u32)indexBuffer.size();
-			u32 vertexStart = (u32)vertexBuffer.size();
+			u32 vertexOffset = (u32)vertexBuffer.size();
 
 			// Load vertices
 			const float* positionBuffer = nullptr;
@@ -122,12 +192,28 @@ static void LoadNode(const tinygltf::Node& inputNode, const tinygltf::Model& mod
 			const float* texCoordsBuffer = nullptr;
 			size_t vertexCount = 0;
 
+			glm::vec3 boundsMin = glm::vec3(0.0f);
+			glm::vec3 boundsMax = glm::vec3(0.0f);
+
 			// Get buffer data for vertex positions
 			if (primitive.attributes.find("POSITION") != primitive.attributes.end()) {
 				const tinygltf::Accessor& accessor = model.accessors[primitive.attributes.find("POSITION")->second];
 				const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
 				positionBuffer = (float*)(&model.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]);
 				vertexCount = accessor.count;
+
+				// glTF requires min/max for positions, but fall back to computing the bounds if they are missing.
+				if (accessor.minValues.size() == 3 && accessor.maxValues.size() == 3) {
+					boundsMin = glm::vec3(accessor.minValues[0], accessor.minValues[1], accessor.minValues[2]);
+					boundsMax = glm::vec3(accessor.maxValues[0], accessor.maxValues[1], accessor.maxValues[2]);
+				}
+				else if (vertexCount > 0) {
+					boundsMin = boundsMax = glm::make_vec3(&positionBuffer[0]);
+					for (size_t v = 1; v < vertexCount; v++) {
+						boundsMin = glm::min(boundsMin, glm::make_vec3(&positionBuffer[v * 3]));
+						boundsMax = glm::max(boundsMax, glm::make_vec3(&positionBuffer[v * 3]));
+					}
+				}
 			}
 
 			// Get buffer data for vertex normals
@@ -151,16 +237,18 @@ static void LoadNode(const tinygltf::Node& inputNode, const tinygltf::Model& mod
 				texCoordsBuffer = (float*)(&model.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]);
 			}
 
-			// Reserve space for and append the vertices to the model's vertexBuffer
-			vertexBuffer.reserve(vertexBuffer.size() + vertexCount);
+			// The primitive is optimized on its own before it is appended to the model's buffers.
+			std::vector<glm::vec3>		   primitivePositions(vertexCount);
+			std::vector<GLTFModel::Vertex> primitiveVertices(vertexCount);
+			std::vector<u32>			   primitiveIndices;
+
 			for (size_t v = 0; v < vertexCount; v++) {
-				vertexBuffer.push_back({
-					.pos = glm::vec4(glm::make_vec3(&positionBuffer[v * 3]), 1.0f),
-					.normal = normalsBuffer ? glm::normalize(glm::vec3(glm::make_vec3(&normalsBuffer[v * 3]))) : glm::vec3(0.0f),
-					.tangent = tangentsBuffer ? glm::vec4(glm::make_vec4(&tangentsBuffer[v * 4])) : glm::vec4(0.0f),
-					.uv = texCoordsBuffer ? glm::make_vec2(&texCoordsBuffer[v * 2]) : glm::vec2(0.0f),
-					.color = glm::vec3(1.0f)
-					});
+				primitivePositions[v] = glm::make_vec3(&positionBuffer[v * 3]);
+				primitiveVertices[v] = PackVertex(
+					normalsBuffer ? glm::normalize(glm::vec3(glm::make_vec3(&normalsBuffer[v * 3]))) : glm::vec3(0.0f),
+					tangentsBuffer ? glm::vec4(glm::make_vec4(&tangentsBuffer[v * 4])) : glm::vec4(0.0f),
+					texCoordsBuffer ? glm::make_vec2(&texCoordsBuffer[v * 2]) : glm::vec2(0.0f)
+				);
 			}
 
 			// Load indices
@@ -169,28 +257,28 @@ static void LoadNode(const tinygltf::Node& inputNode, const tinygltf::Model& mod
 			const tinygltf::Buffer& buffer = model.buffers[bufferView.buffer];
 			u32 indexCount = (u32)accessor.count;
 
-			indexBuffer.reserve(indexBuffer.size() + indexCount);
+			primitiveIndices.reserve(indexCount);
 
 			// glTF supports different component types of indices
 			switch (accessor.componentType) {
 			case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT: {
 				const u32* buf = (const u32*)(&buffer.data[accessor.byteOffset + bufferView.byteOffset]);
 				for (size_t index = 0; index < indexCount; index++) {
-					indexBuffer.push_back(buf[index] + vertexStart);
+					primitiveIndices.push_back(buf[index]);
 				}
 				break;
 			}
 			case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: {
 				const u16* buf = (const u16*)(&buffer.data[accessor.byteOffset + bufferView.byteOffset]);
 				for (size_t index = 0; index < indexCount; index++) {
-					indexBuffer.push_back(buf[index] + vertexStart);
+					primitiveIndices.push_back(buf[index]);
 				}
 				break;
 			}
 			case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE: {
 				const u8* buf = (const u8*)(&buffer.data[accessor.byteOffset + bufferView.byteOffset]);
 				for (size_t index = 0; index < indexCount; index++) {
-					indexBuffer.push_back(buf[index] + vertexStart);
+					primitiveIndices.push_back(buf[index]);
 				}
 				break;
 			}
@@ -199,24 +287,36 @@ static void LoadNode(const tinygltf::Node& inputNode, const tinygltf::Model& mod
 			}
 			}
 
-			node->mesh.primitives.push_back({
+			OptimizePrimitive(primitiveIndices, primitivePositions, primitiveVertices, stats);
+
+			// Indices stay relative to the primitive's first vertex, which is added by the draw's vertexOffset.
+			indexBuffer.insert(indexBuffer.end(), primitiveIndices.begin(), primitiveIndices.end());
+			positions.insert(positions.end(), primitivePositions.begin(), primitivePositions.end());
+			vertexBuffer.insert(vertexBuffer.end(), primitiveVertices.begin(), primitiveVertices.end());
+
+			primitives.push_back({
 				.firstIndex = firstIndex,
 				.indexCount = indexCount,
-				.materialIndex = primitive.material
+				.vertexOffset = vertexOffset,
+				.materialIndex = primitive.material,
+				.boundsMin = boundsMin,
+				.boundsMax = boundsMax
 			});
 		}
 	}
 
-	if (parent) {
-		parent->children.push_back(node);
-	}
-	else {
-		nodes.push_back(node);
+	hierarchy.primitiveCount[node] = (u32)primitives.size() - hierarchy.firstPrimitive[node];
+
+	// Recursively load the children of the input node. Children are loaded after the primitives, so the primitives of each node stay contiguous.
+	for (size_t i = 0; i < inputNode.children.size(); i++) {
+		LoadNode(model.nodes[inputNode.children[i]], model, hierarchy, primitives, (i32)node, indexBuffer, positions, vertexBuffer, stats);
 	}
+
+	hierarchy.subtreeEnd[node] = (u32)hierarchy.parents.size();
 }
 
-GLTFModel::GLTFModel(Device* device, Handle<BindGroupLayout> materialLayout, const char* path) 
-	: m_device{ device }, m_materialBindGroupLayout{ materialLayout } 
+GLTFModel::GLTFModel(Device* device, Handle<BindGroupLayout> materialLayout, Handle<BindGroupLayout> drawLayout, const char* path) 
+	: m_device{ device }, m_materialBindGroupLayout{ materialLayout }, m_drawBindGroupLayout{ drawLayout }
 {
 	ResourceManager* rm = ResourceManager::ptr;
 
@@ -270,48 +370,79 @@ GLTFModel::GLTFModel(Device* device, Handle<BindGroupLayout> materialLayout, con
 		});
 	}
 
-	std::vector<u32>	indexBuffer;
-	std::vector<Vertex> vertexBuffer;
+	std::vector<u32>	   indexBuffer;
+	std::vector<glm::vec3> positions;
+	std::vector<Vertex>	   vertexBuffer;
+	MeshStats			   stats;
 
 	const tinygltf::Scene& scene = gltfInput.scenes[gltfInput.defaultScene == -1 ? 0 : gltfInput.defaultScene];
 
-	// Reserve space for the number of nodes in the scene.
-	m_nodes.reserve(m_nodes.size() + scene.nodes.size());
 	for (size_t i = 0; i < scene.nodes.size(); i++) {
-		const tinygltf::Node node = gltfInput.nodes[scene.nodes[i]];
-		LoadNode(node, gltfInput, m_nodes, nullptr, indexBuffer, vertexBuffer);
+		const tinygltf::Node& node = gltfInput.nodes[scene.nodes[i]];
+		LoadNode(node, gltfInput, m_hierarchy, m_primitives, -1, indexBuffer, positions, vertexBuffer, stats);
+	}
+
+	// 16 bit indices suffice unless a primitive has more than 65536 vertices. They are padded to whole words, as the
+	// visibility buffer resolve reads them from the index buffer as words.
+	std::vector<u16> shortIndices;
+	if (indexBuffer.empty() || *std::max_element(indexBuffer.begin(), indexBuffer.end()) <= 0xFFFF) {
+		m_indexType = IndexType::UINT16;
+
+		shortIndices.resize((indexBuffer.size() + 1) & ~(size_t)1, 0);
+		for (size_t i = 0; i < indexBuffer.size(); i++)
+			shortIndices[i] = (u16)indexBuffer[i];
 	}
 
-	u64 vertexBufferSize = vertexBuffer.size() * sizeof(Vertex);
-	u64 indexBufferSize  = indexBuffer.size()  * sizeof(u32);
+	printf(SGR_SET_BG_GRAY "[INFO]" SGR_SET_DEFAULT "    Optimized `%s`: %u -> %u vertices, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %s indices.\n", path,
+		stats.before.vertices, stats.after.vertices, stats.before.ACMR(), stats.after.ACMR(), stats.before.ATVR(), stats.after.ATVR(),
+		m_indexType == IndexType::UINT16 ? "16 bit" : "32 bit");
+
+	const void* indexData = m_indexType == IndexType::UINT16 ? (const void*)shortIndices.data() : (const void*)indexBuffer.data();
+
+	m_positionBufferSize = positions.size()	   * sizeof(glm::vec3);
+	m_vertexBufferSize	 = vertexBuffer.size() * sizeof(Vertex);
+	m_indexBufferSize	 = m_indexType == IndexType::UINT16 ? shortIndices.size() * sizeof(u16) : indexBuffer.size() * sizeof(u32);
+
+	// Create the GPU-local position, vertex and index buffers
+	m_positions = rm->CreateBuffer({
+		.debugName = "glTF position buffer", // TODO: better debug name
+		.byteSize = m_positionBufferSize,
+		.usage = Usage::VERTEX_BUFFER | Usage::SHADER_RESOURCE | Usage::TRANSFER_DST
+	});
 
-	// Create the GPU-local vertex and index buffers
 	m_vertices = rm->CreateBuffer({
 		.debugName = "glTF vertex buffer", // TODO: better debug name
-		.byteSize = vertexBufferSize,
-		.usage = Usage::VERTEX_BUFFER | Usage::TRANSFER_DST
+		.byteSize = m_vertexBufferSize,
+		.usage = Usage::VERTEX_BUFFER | Usage::SHADER_RESOURCE | Usage::TRANSFER_DST
 	});
 
 	m_indices = rm->CreateBuffer({
 		.debugName = "glTF index buffer", // TODO: better debug name
-		.byteSize = indexBufferSize,
-		.usage = Usage::INDEX_BUFFER | Usage::TRANSFER_DST
+		.byteSize = m_indexBufferSize,
+		.usage = Usage::INDEX_BUFFER | Usage::SHADER_RESOURCE | Usage::TRANSFER_DST
 	});
 
-	// Upload the gltf vertex and index buffer ot the GPU.
-	rm->Upload(m_vertices, vertexBuffer.data(), (u32)vertexBufferSize);
-	rm->Upload(m_indices, indexBuffer.data(),   (u32)indexBufferSize);
+	// Upload the gltf position, vertex and index buffer ot the GPU.
+	rm->Upload(m_positions, positions.data(),   (u32)m_positionBufferSize);
+	rm->Upload(m_vertices, vertexBuffer.data(), (u32)m_vertexBufferSize);
+	rm->Upload(m_indices, indexData,			(u32)m_indexBufferSize);
+
+	BuildDraws();
 }
 
 GLTFModel::~GLTFModel() {
 	ResourceManager* rm = ResourceManager::ptr;
 
-	for (GLTFModel::Node* node : m_nodes) {
-		delete node;
-	}
-
+	rm->DestroyBuffer(m_positions);
 	rm->DestroyBuffer(m_vertices);
 	rm->DestroyBuffer(m_indices);
+	rm->DestroyBuffer(m_drawCommands);
+
+	for (u32 i = 0; i < Device::MaxFramesInFlight; i++) {
+		rm->DestroyBuffer(m_viewCommands[i]);
+		rm->DestroyBuffer(m_objectBuffers[i]);
+		rm->DestroyBuffer(m_materialBuffers[i]);
+	}
 
 	for (Handle<Texture> image : m_images) {
 		rm->DestroyTexture(image);
@@ -320,48 +451,405 @@ GLTFModel::~GLTFModel() {
 	rm->DestroyTexture(m_dummyTexture);
 }
 
-void GLTFModel::DrawNode(CommandBuffer& cmd, Node* node, bool shadowMap) const {
-	if (node->mesh.primitives.size() > 0) {
-		glm::mat4 nodeTransform = node->transform;
-		Node* parent = node->parent;
-		while (parent) {
-			nodeTransform = parent->transform * nodeTransform;
-			parent = parent->parent;
+void GLTFModel::BuildDraws() {
+	ResourceManager* rm = ResourceManager::ptr;
+
+	const u32 nodeCount = NodeCount();
+
+	// Gather the drawable primitives of every node.
+	m_drawNodes.clear();
+	m_drawPrimitives.clear();
+	for (u32 node = 0; node < nodeCount; node++) {
+		const u32 first = m_hierarchy.firstPrimitive[node];
+		for (u32 p = first; p < first + m_hierarchy.primitiveCount[node]; p++) {
+			if (m_primitives[p].indexCount > 0) {
+				// The visibility buffer stores the triangle of each pixel in TriangleBits bits.
+				const u32 triangles = m_primitives[p].indexCount / 3;
+				Check(triangles <= 1u << VisibilityBuffer::TriangleBits, "Primitive %u has %u triangles, the visibility buffer supports at most %u per draw", p, triangles, 1u << VisibilityBuffer::TriangleBits);
+				m_drawNodes.push_back(node);
+				m_drawPrimitives.push_back(p);
+			}
 		}
+	}
+
+	m_drawCount = (u32)m_drawPrimitives.size();
+
+	// Sort draws by material, so each material only has to be bound once.
+	std::vector<u32> order(m_drawCount);
+	for (u32 i = 0; i < m_drawCount; i++) order[i] = i;
+
+	std::stable_sort(order.begin(), order.end(), [&](u32 a, u32 b) {
+		return m_primitives[m_drawPrimitives[a]].materialIndex < m_primitives[m_drawPrimitives[b]].materialIndex;
+	});
+
+	std::vector<u32> drawNodes(m_drawCount), drawPrimitives(m_drawCount);
+	for (u32 i = 0; i < m_drawCount; i++) {
+		drawNodes[i]	  = m_drawNodes[order[i]];
+		drawPrimitives[i] = m_drawPrimitives[order[i]];
+	}
+	m_drawNodes		 = std::move(drawNodes);
+	m_drawPrimitives = std::move(drawPrimitives);
+
+	std::vector<DrawIndexedIndirectCommand>& commands = m_commands;
+	commands.resize(m_drawCount);
+	m_objectData.resize(m_drawCount);
+	m_bounds.Resize(m_drawCount);
+	m_visible.resize(m_drawCount);
+	m_drawDynamic.assign(m_drawCount, 0);
+	m_primitiveDraws.assign(m_primitives.size(), ~0u);
+
+	for (u32 i = 0; i < m_drawCount; i++) {
+		const Primitive& p = m_primitives[m_drawPrimitives[i]];
+
+		// firstInstance is the index of the draw, which the shaders use to look up its ObjectData.
+		commands[i] = {
+			.indexCount	   = p.indexCount,
+			.instanceCount = 1,
+			.firstIndex	   = p.firstIndex,
+			.vertexOffset  = (i32)p.vertexOffset,
+			.firstInstance = i
+		};
+
+		m_primitiveDraws[m_drawPrimitives[i]] = i;
+		m_objectData[i].materialIndex = (u32)p.materialIndex;
+		m_objectData[i].firstIndex	  = p.firstIndex;
+		m_objectData[i].vertexOffset  = p.vertexOffset;
+
+		if (m_batches.empty() || m_batches.back().materialIndex != p.materialIndex) {
+			m_batches.push_back({ .materialIndex = p.materialIndex, .firstDraw = i, .drawCount = 0 });
+		}
+		m_batches.back().drawCount++;
+	}
+
+	// Compute the initial world transforms and object data by marking all root nodes dirty.
+	for (u32 node = 0; node < nodeCount; node = m_hierarchy.subtreeEnd[node]) {
+		m_dirtyNodes.push_back(node);
+	}
+	UpdateTransforms();
+	m_movedBounds.clear();
+	m_movedStaticBounds.clear();
 
-		for (const Primitive& p : node->mesh.primitives) {
-			if (p.indexCount <= 0) continue;
+	m_materialData.resize(m_materials.size());
 
-			if (shadowMap) {
-				cmd.PushConstants(&nodeTransform, 0, sizeof(nodeTransform), ShaderStage::VERTEX);
+	// Vulkan does not allow zero-sized buffers, so always allocate room for at least one element.
+	const u32 commandsSize = glm::max(m_drawCount, 1u) * sizeof(DrawIndexedIndirectCommand);
+	const u32 objectsSize  = glm::max(m_drawCount, 1u) * sizeof(ObjectData);
+	const u32 materialSize = glm::max((u32)m_materialData.size(), 1u) * sizeof(MaterialData);
+
+	m_drawCommands = rm->CreateBuffer({
+		.debugName = "glTF indirect draw buffer",
+		.byteSize = commandsSize,
+		.usage = Usage::INDIRECT_BUFFER | Usage::TRANSFER_DST
+	});
+
+	if (m_drawCount > 0) {
+		rm->Upload(m_drawCommands, commands.data(), m_drawCount * sizeof(DrawIndexedIndirectCommand));
+	}
+
+	for (u32 i = 0; i < Device::MaxFramesInFlight; i++) {
+		m_viewCommands[i] = rm->CreateBuffer({
+			.debugName = "glTF culled indirect draw buffer",
+			.byteSize = commandsSize * MaxViews,
+			.usage = Usage::INDIRECT_BUFFER,
+			.memory = Memory::Upload
+		});
+		Check(rm->MapBuffer(m_viewCommands[i]), "Failed to map glTF culled indirect draw buffer");
+
+		m_objectBuffers[i] = rm->CreateBuffer({
+			.debugName = "glTF object data buffer",
+			.byteSize = objectsSize,
+			.usage = Usage::SHADER_RESOURCE,
+			.memory = Memory::Upload
+		});
+
+		m_materialBuffers[i] = rm->CreateBuffer({
+			.debugName = "glTF material data buffer",
+			.byteSize = materialSize,
+			.usage = Usage::SHADER_RESOURCE,
+			.memory = Memory::Upload
+		});
+
+		m_drawBindings[i] = rm->CreateBindGroup({
+			.debugName = "glTF draw data bindgroup",
+			.layout = m_drawBindGroupLayout,
+			.buffers = {
+				{.binding = 0, .buffer = m_objectBuffers[i],   .offset = 0, .size = objectsSize  },
+				{.binding = 1, .buffer = m_materialBuffers[i], .offset = 0, .size = materialSize },
+				{.binding = 2, .buffer = m_positions,		   .offset = 0, .size = m_positionBufferSize },
+				{.binding = 3, .buffer = m_vertices,		   .offset = 0, .size = m_vertexBufferSize },
+				{.binding = 4, .buffer = m_indices,			   .offset = 0, .size = m_indexBufferSize }
 			}
-			else {
-				cmd.SetBindGroup(m_materials[p.materialIndex].bindgroup, 1);
+		});
+	}
+}
+
+void GLTFModel::UpdateObjectData(u32 draw) {
+	const Primitive& p	  = m_primitives[m_drawPrimitives[draw]];
+	const glm::mat4 world = m_hierarchy.world[m_drawNodes[draw]];
 
-				PushConstants pc = {
-					.model		   = nodeTransform,
-					.parallaxMode  = m_materials[p.materialIndex].parallaxMode,
-					.parallaxSteps = m_materials[p.materialIndex].parallaxSteps,
-					.parallaxScale = m_materials[p.materialIndex].parallaxScale
-				};
+	// Transform the object space bounding box to a world space bounding box.
+	const glm::vec3 center = (p.boundsMax + p.boundsMin) * 0.5f;
+	const glm::vec3 extent = (p.boundsMax - p.boundsMin) * 0.5f;
+	const glm::mat3 absWorld = glm::mat3(glm::abs(glm::vec3(world[0])), glm::abs(glm::vec3(world[1])), glm::abs(glm::vec3(world[2])));
 
-				cmd.PushConstants(&pc, 0, sizeof(pc), ShaderStage::VERTEX | ShaderStage::FRAGMENT);
+	m_objectData[draw].world		= world;
+	m_objectData[draw].normal		= glm::transpose(glm::inverse(world));
+	m_objectData[draw].boundsCenter = glm::vec4(glm::vec3(world * glm::vec4(center, 1.0f)), 1.0f);
+	m_objectData[draw].boundsExtent = glm::vec4(absWorld * extent, 0.0f);
+
+	m_bounds.Set(draw, glm::vec3(m_objectData[draw].boundsCenter), glm::vec3(m_objectData[draw].boundsExtent));
+}
+
+void GLTFModel::UpdateTransforms() {
+	if (m_dirtyNodes.empty()) return;
+
+	// Dirty nodes are processed in pre-order. A dirty node inside the subtree of an already updated node is skipped,
+	// so every node is updated at most once, and parents are always updated before their children.
+	std::sort(m_dirtyNodes.begin(), m_dirtyNodes.end());
+
+	u32 updatedEnd = 0;
+	for (u32 root : m_dirtyNodes) {
+		if (root < updatedEnd) continue;
+
+		updatedEnd = m_hierarchy.subtreeEnd[root];
+		for (u32 node = root; node < updatedEnd; node++) {
+			const i32 parent = m_hierarchy.parents[node];
+			m_hierarchy.world[node] = (parent < 0 ? m_transform : m_hierarchy.world[parent]) * m_hierarchy.local[node];
+
+			const u32 first = m_hierarchy.firstPrimitive[node];
+			for (u32 p = first; p < first + m_hierarchy.primitiveCount[node]; p++) {
+				const u32 draw = m_primitiveDraws[p];
+				if (draw == ~0u) continue;
+
+				const AABB before = { glm::vec3(m_objectData[draw].boundsCenter), glm::vec3(m_objectData[draw].boundsExtent) };
+				UpdateObjectData(draw);
+				const AABB after  = { glm::vec3(m_objectData[draw].boundsCenter), glm::vec3(m_objectData[draw].boundsExtent) };
+
+				m_movedBounds.push_back(before);
+				m_movedBounds.push_back(after);
+
+				if (!m_drawDynamic[draw]) {
+					m_movedStaticBounds.push_back(before);
+					m_movedStaticBounds.push_back(after);
+				}
+			}
+		}
+	}
+
+	m_dirtyNodes.clear();
+	m_objectsDirty = Device::MaxFramesInFlight;
+}
+
+void GLTFModel::SetTransform(const glm::mat4& transform) {
+	m_transform = transform;
+
+	// The model transform applies to every root node.
+	for (u32 node = 0; node < NodeCount(); node = m_hierarchy.subtreeEnd[node]) {
+		m_dirtyNodes.push_back(node);
+	}
+}
+
+void GLTFModel::SetNodeTransform(u32 node, const glm::mat4& transform) {
+	Check(node < NodeCount(), "Node index %u out of range", node);
+
+	m_hierarchy.local[node] = transform;
+	m_dirtyNodes.push_back(node);
+}
+
+void GLTFModel::SetNodeDynamic(u32 node, bool dynamic) {
+	Check(node < NodeCount(), "Node index %u out of range", node);
+
+	for (u32 n = node; n < m_hierarchy.subtreeEnd[node]; n++) {
+		const u32 first = m_hierarchy.firstPrimitive[n];
+		for (u32 p = first; p < first + m_hierarchy.primitiveCount[n]; p++) {
+			const u32 draw = m_primitiveDraws[p];
+			if (draw == ~0u || m_drawDynamic[draw] == (u8)dynamic) continue;
+
+			// The draw enters or leaves the static draws, which invalidates the static caches it overlaps.
+			m_drawDynamic[draw] = dynamic;
+			m_changedStaticBounds.push_back({ glm::vec3(m_objectData[draw].boundsCenter), glm::vec3(m_objectData[draw].boundsExtent) });
+		}
+	}
+}
+
+void GLTFModel::Update() {
+	const u32 frame = Device::ptr->FrameIdx();
+
+	m_movedBounds.clear();
+	m_movedStaticBounds.swap(m_changedStaticBounds);
+	m_changedStaticBounds.clear();
+	UpdateTransforms();
+
+	if (m_objectsDirty > 0 && m_drawCount > 0) {
+		ResourceManager::ptr->WriteBuffer(m_objectBuffers[frame], m_objectData.data(), m_drawCount * sizeof(ObjectData));
+	}
+
+	if (m_materialsDirty > 0 && m_materialData.size() > 0) {
+		ResourceManager::ptr->WriteBuffer(m_materialBuffers[frame], m_materialData.data(), (u32)m_materialData.size() * sizeof(MaterialData));
+	}
+
+	m_objectsDirty	 = m_objectsDirty	> 0 ? m_objectsDirty - 1	: 0;
+	m_materialsDirty = m_materialsDirty > 0 ? m_materialsDirty - 1 : 0;
+}
+
+u32 GLTFModel::FilterVisible(DrawFilter filter, u32 visibleCount) {
+	if (filter == DrawFilter::ALL) return visibleCount;
+
+	const u8 dynamic = filter == DrawFilter::DYNAMIC;
+
+	visibleCount = 0;
+	for (u32 i = 0; i < m_drawCount; i++) {
+		m_visible[i] &= m_drawDynamic[i] == dynamic;
+		visibleCount += m_visible[i];
+	}
+
+	return visibleCount;
+}
+
+u32 GLTFModel::Cull(u32 view, const Frustum& frustum, DrawFilter filter) {
+	Check(view < MaxViews, "View %u exceeds the maximum of %u views", view, MaxViews);
+
+	std::vector<DrawBatch>& batches = m_viewBatches[view];
+	std::vector<u32>& draws = m_viewDraws[view];
+	batches.clear();
+	draws.clear();
+
+	if (m_drawCount == 0) return 0;
+
+	FilterVisible(filter, FrustumCull(frustum, m_bounds, m_visible.data()));
+
+	// Compact the visible draws into the view's region of the indirect buffer, keeping them grouped by material.
+	const Handle<Buffer> buffer = m_viewCommands[Device::ptr->FrameIdx()];
+	DrawIndexedIndirectCommand* commands = (DrawIndexedIndirectCommand*)ResourceManager::ptr->GetMapped(buffer) + view * m_drawCount;
+
+	u32 visibleCount = 0;
+	for (const DrawBatch& batch : m_batches) {
+		const u32 firstDraw = visibleCount;
+
+		for (u32 i = batch.firstDraw; i < batch.firstDraw + batch.drawCount; i++) {
+			if (m_visible[i]) {
+				commands[visibleCount++] = m_commands[i];
+				draws.push_back(i);
 			}
+		}
 
-			cmd.DrawIndexed(p.indexCount, 1, p.firstIndex, 0, 0);
+		if (visibleCount > firstDraw) {
+			batches.push_back({ .materialIndex = batch.materialIndex, .firstDraw = firstDraw, .drawCount = visibleCount - firstDraw });
 		}
 	}
 
-	for (Node* child : node->children) {
-		DrawNode(cmd, child, shadowMap);
+	if (visibleCount > 0) {
+		ResourceManager::ptr->FlushBuffer(buffer, visibleCount * sizeof(DrawIndexedIndirectCommand), view * m_drawCount * sizeof(DrawIndexedIndirectCommand));
+	}
+
+	return visibleCount;
+}
+
+void GLTFModel::CullLayered(u32 view, span<const Frustum> frustums, u32 layerMask, u32* layerDrawn, DrawFilter filter) {
+	Check(view < MaxViews, "View %u exceeds the maximum of %u views", view, MaxViews);
+	Check(frustums.size() <= MaxLayers, "Layered views support at most %u layers", MaxLayers);
+	Check(m_drawCount <= (1u << 16), "Layered views support at most 65536 draws");
+
+	std::vector<DrawBatch>& batches = m_viewBatches[view];
+	std::vector<u32>& draws = m_viewDraws[view];
+	batches.clear();
+	draws.clear();
+
+	if (m_drawCount == 0) return;
+
+	m_layerMasks.assign(m_drawCount, 0);
+	for (u32 layer = 0; layer < frustums.size(); layer++) {
+		if (!HasFlag(layerMask, 1u << layer)) continue;
+
+		layerDrawn[layer] += FilterVisible(filter, FrustumCull(frustums[layer], m_bounds, m_visible.data()));
+		for (u32 i = 0; i < m_drawCount; i++)
+			m_layerMasks[i] |= m_visible[i] << layer;
+	}
+
+	// Materials don't matter in layered views, so the visible draws are written as a single batch.
+	const Handle<Buffer> buffer = m_viewCommands[Device::ptr->FrameIdx()];
+	DrawIndexedIndirectCommand* commands = (DrawIndexedIndirectCommand*)ResourceManager::ptr->GetMapped(buffer) + view * m_drawCount;
+
+	u32 visibleCount = 0;
+	for (u32 i = 0; i < m_drawCount; i++) {
+		const u32 mask = m_layerMasks[i];
+		if (mask == 0) continue;
+
+		draws.push_back(i);
+
+		DrawIndexedIndirectCommand& command = commands[visibleCount++];
+		command = m_commands[i];
+		command.instanceCount = (u32)std::popcount(mask);
+		command.firstInstance = (m_commands[i].firstInstance << 16) | (mask << 8);
+	}
+
+	if (visibleCount > 0) {
+		ResourceManager::ptr->FlushBuffer(buffer, visibleCount * sizeof(DrawIndexedIndirectCommand), view * m_drawCount * sizeof(DrawIndexedIndirectCommand));
+		batches.push_back({ .materialIndex = -1, .firstDraw = 0, .drawCount = visibleCount });
 	}
 }
 
-void GLTFModel::Draw(CommandBuffer& cmd, bool shadowMap) const {
-	cmd.SetVertexBuffer(m_vertices, 0);
-	cmd.SetIndexBuffer(m_indices, 0, IndexType::UINT32);
+void GLTFModel::GetVisibleBounds(u32 view, std::vector<AABB>& bounds) const {
+	Check(view < MaxViews, "View %u exceeds the maximum of %u views", view, MaxViews);
+
+	for (u32 draw : m_viewDraws[view])
+		bounds.push_back({ glm::vec3(m_objectData[draw].boundsCenter), glm::vec3(m_objectData[draw].boundsExtent) });
+}
+
+void GLTFModel::GetVisibleMaterials(u32 view, std::vector<u32>& materials, MaterialFilter filter) const {
+	Check(view < MaxViews, "View %u exceeds the maximum of %u views", view, MaxViews);
+
+	// Visible draws stay grouped by material, so each batch has a different material.
+	for (const DrawBatch& batch : m_viewBatches[view]) {
+		if (filter != MaterialFilter::ALL) {
+			const bool discarding = m_materialData[batch.materialIndex].parallaxMode > 0;
+			if (discarding != (filter == MaterialFilter::DISCARDING))
+				continue;
+		}
+
+		materials.push_back((u32)batch.materialIndex);
+	}
+}
+
+void GLTFModel::Draw(CommandBuffer& cmd, u32 view, bool shadowMap, MaterialFilter filter) const {
+	if (m_drawCount == 0) return;
+
+	// Depth-only passes don't read the vertex attributes, so only the position stream is bound for them.
+	cmd.SetVertexBuffer(m_positions, 0, 0);
+	if (!shadowMap)
+		cmd.SetVertexBuffer(m_vertices, 0, 1);
+	cmd.SetIndexBuffer(m_indices, 0, m_indexType);
+
+	// The draw data is bound right after the pass bindgroups: set 1 in the shadow pass, and set 2 after the material in the GBuffer pass.
+	cmd.SetBindGroup(m_drawBindings[Device::ptr->FrameIdx()], shadowMap ? 1 : 2);
+
+	// Unculled draws read from the static indirect buffer. Culled views read from their region of the per-frame buffer.
+	const bool culled = view != Unculled;
+	const Handle<Buffer> buffer = culled ? m_viewCommands[Device::ptr->FrameIdx()] : m_drawCommands;
+	const u64 viewOffset		= culled ? (u64)view * m_drawCount * sizeof(DrawIndexedIndirectCommand) : 0;
+	const std::vector<DrawBatch>& batches = culled ? m_viewBatches[view] : m_batches;
+
+	// Shadow passes don't care about materials, so the whole view is drawn with a single call.
+	if (shadowMap && filter == MaterialFilter::ALL) {
+		u32 drawCount = 0;
+		for (const DrawBatch& batch : batches)
+			drawCount += batch.drawCount;
+
+		if (drawCount > 0)
+			cmd.DrawIndexedIndirect(buffer, viewOffset, drawCount);
+		return;
+	}
+
+	// NOTE: Without bindless textures, materials can't change within a multi-draw. We issue one multi-draw per material instead.
+	for (const DrawBatch& batch : batches) {
+		if (filter != MaterialFilter::ALL) {
+			const bool discarding = m_materialData[batch.materialIndex].parallaxMode > 0;
+			if (discarding != (filter == MaterialFilter::DISCARDING))
+				continue;
+		}
 
-	for (Node* node : m_nodes) {
-		DrawNode(cmd, node, shadowMap);
+		if (!shadowMap)
+			cmd.SetBindGroup(m_materials[batch.materialIndex].bindgroup, 1);
+		cmd.DrawIndexedIndirect(buffer, viewOffset + batch.firstDraw * sizeof(DrawIndexedIndirectCommand), batch.drawCount);
 	}
 }
\ No newline at end of file
@@ -3,63 +3,164 @@
 #include "../Core/Graphics.h"
 #include "../Core/Device.h"
 
+#include "Culling.h"
+
 #include <glm/glm.hpp>
+#include <glm/gtc/type_precision.hpp>
 
 class GLTFModel {
 public:
-	GLTFModel(Device* device, Handle<BindGroupLayout> materialLayout, const char* path);
+	// drawLayout must hold five STORAGE_BUFFER bindings: the per-draw object data, read by SV_InstanceID, the per-material data,
+	// and the model's position, vertex attribute and index buffers, which the visibility buffer resolve fetches triangles from.
+	GLTFModel(Device* device, Handle<BindGroupLayout> materialLayout, Handle<BindGroupLayout> drawLayout, const char* path);
 	~GLTFModel();
 
 	// NOTE: temporary interface to allow the use of parallax mapping. This should be removed once we can load parallax settings directly.
 	void UpdateMaterialParallax(u32 mode, u32 steps, float scale) {
-		for (Material& material : m_materials) {
-			material.parallaxMode = mode;
-			material.parallaxSteps = steps;
-			material.parallaxScale = scale;
+		for (MaterialData& material : m_materialData) {
+			if (material.parallaxMode != mode || material.parallaxSteps != steps || material.parallaxScale != scale) {
+				material = { .parallaxMode = mode, .parallaxSteps = steps, .parallaxScale = scale };
+				m_materialsDirty = Device::MaxFramesInFlight;
+			}
 		}
 	}
 
-	void Draw(CommandBuffer& cmd, bool shadowMap = false) const;
+	// Set the model to world transform. Object data is recomputed on the next call to Update, and rewritten for MaxFramesInFlight frames.
+	void SetTransform(const glm::mat4& transform);
+
+	// Set the local transform of a node. World transforms of the node's subtree are recomputed on the next call to Update.
+	void SetNodeTransform(u32 node, const glm::mat4& transform);
+	u32  NodeCount() const { return (u32)m_hierarchy.parents.size(); }
+
+	// Mark the primitives of a node's subtree as dynamic or static. All primitives are static by default.
+	// Static primitives are expected to rarely move, which lets passes like the shadow map cache them. They may still be moved,
+	// but every move of a static primitive invalidates those caches.
+	void SetNodeDynamic(u32 node, bool dynamic);
+
+	// Recompute dirty world transforms, and write object and material data for the current frame if they changed.
+	// This must be called *after* a successful Device.BeginFrame() call to avoid a race condition.
+	void Update();
+
+	// Each view (camera, shadow cascade, ...) has its own region of the per-frame indirect buffer, holding the draws that passed culling.
+	static constexpr u32 MaxViews = 24;
+
+	// Pass as view to Draw to draw every primitive of the model, without culling.
+	static constexpr u32 Unculled = ~0u;
+
+	// Selects which draws are written to a view when culling.
+	enum class DrawFilter {
+		ALL,
+		STATIC,
+		DYNAMIC
+	};
+
+	// Cull the draws against the frustum and write the visible draws to the indirect buffer region of the view.
+	// This must be called after Update, and before the view is drawn in the same frame. Returns the number of visible draws.
+	u32 Cull(u32 view, const Frustum& frustum, DrawFilter filter = DrawFilter::ALL);
+	u32 DrawCount() const { return m_drawCount; }
+
+	// Layered views draw into several layers (up to 8) of a layered render target in a single pass.
+	// Each draw is issued once, instanced over the layers it is visible in. The instance index encodes the draw and
+	// the layer: (draw << 16) | (layerMask << 8) | n, where n is the n-th set bit of layerMask, and thus the layer.
+	static constexpr u32 MaxLayers = 8;
+
+	// Cull the draws against the frustum of each layer in layerMask, and write the visible draws to the indirect buffer
+	// region of the view. layerDrawn[i] is incremented by the number of draws visible in layer i.
+	void CullLayered(u32 view, span<const Frustum> frustums, u32 layerMask, u32* layerDrawn, DrawFilter filter = DrawFilter::ALL);
+
+	// Append the world space bounds of the draws that passed the last cull of the view.
+	void GetVisibleBounds(u32 view, std::vector<AABB>& bounds) const;
+
+	// World space bounds, before and after, of every draw that moved during the last call to Update.
+	const std::vector<AABB>& GetMovedBounds() const { return m_movedBounds; }
+
+	// World space bounds of every static draw that moved, or was made static or dynamic, during the last call to Update.
+	const std::vector<AABB>& GetMovedStaticBounds() const { return m_movedStaticBounds; }
+
+	// Selects the draws of a view that are drawn, by material. Parallax mapped materials may discard fragments, so a depth
+	// prepass can't write their depth ahead of the GBuffer pass.
+	enum class MaterialFilter {
+		ALL,
+		NON_DISCARDING,
+		DISCARDING
+	};
+
+	// Draw the view. Shadow maps, the depth prepass and the visibility buffer don't read materials; they draw with shadowMap
+	// set, which binds the draw data to set 1 and draws the whole view at once, unless the draws are filtered by material.
+	// They must use Vertex::PositionInputState, as only the position stream is bound.
+	void Draw(CommandBuffer& cmd, u32 view, bool shadowMap = false, MaterialFilter filter = MaterialFilter::ALL) const;
+
+	// Materials are bound as bindgroups laid out as the materialLayout passed to the constructor.
+	u32 MaterialCount() const { return (u32)m_materials.size(); }
+	Handle<BindGroup> GetMaterialBindings(u32 material) const { return m_materials[material].bindgroup; }
+
+	// Append the materials of the draws that passed the last cull of the view, each listed once.
+	void GetVisibleMaterials(u32 view, std::vector<u32>& materials, MaterialFilter filter = MaterialFilter::ALL) const;
+
+	Handle<BindGroup> GetDrawBindings() const { return m_drawBindings[Device::ptr->FrameIdx()]; }
 
-	// TODO: slim down vertices
+	// Indices are relative to the first vertex of their primitive. They are 16 bit unless a primitive has more vertices.
+	IndexType GetIndexType() const { return m_indexType; }
+
+	// Vertices are split into two streams: positions (glm::vec3), bound to vertex binding 0, and the remaining attributes,
+	// bound to binding 1. Depth-only passes only fetch the positions. The attributes are quantized, see Shaders/vertex.hlsli.
 	struct Vertex {
-		glm::vec3 pos;
-		glm::vec3 normal;
-		glm::vec4 tangent;
-		glm::vec2 uv;
-		glm::vec3 color;
+		glm::u16vec4 normalTangent;	// RGBA16_SNORM octahedral normal (xy) and tangent (zw), with the bitangent sign in w
+		glm::u16vec2 uv;			// RG16_SFLOAT
 
+		// Position at location 0, followed by the attributes.
 		static const GraphicsState::VertexInputState InputState;
+		// Only the position, for depth-only passes.
+		static const GraphicsState::VertexInputState PositionInputState;
 	};
 
 	struct Primitive {
 		u32 firstIndex;
 		u32 indexCount;
+		u32 vertexOffset;
 		i32 materialIndex;
+
+		// Object space bounding box of the primitive
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
 	};
 
-	struct Mesh {
-		std::vector<Primitive> primitives;
+	// The node hierarchy is stored as flat arrays in pre-order. Parents always come before their children,
+	// and the subtree of node i is the contiguous range [i, subtreeEnd[i]). The primitives of node i are
+	// the range [firstPrimitive[i], firstPrimitive[i] + primitiveCount[i]) of the model's primitives.
+	struct Hierarchy {
+		std::vector<i32>	   parents;
+		std::vector<u32>	   subtreeEnd;
+		std::vector<glm::mat4> local;
+		std::vector<glm::mat4> world;
+		std::vector<u32>	   firstPrimitive;
+		std::vector<u32>	   primitiveCount;
 	};
 
-	struct Node {
-		Node* parent;
-		std::vector<Node*> children;
-		Mesh mesh;
-		glm::mat4 transform;
+private:
+	// Per-draw object data indexed by the instance index. Each draw is issued with firstInstance set to its own index.
+	struct alignas(16) ObjectData {
+		glm::mat4 world;
+		glm::mat4 normal;		  // Inverse transpose of world. Stored as a mat4 to match the shader layout.
+		glm::vec4 boundsCenter;   // World space bounding box center
+		glm::vec4 boundsExtent;   // World space bounding box half-extents
+		u32		  materialIndex;
+		u32		  firstIndex;	  // First index of the primitive in the index buffer
+		u32		  vertexOffset;	  // First vertex of the primitive, which its indices are relative to
+	};
 
-		~Node() {
-			for (Node* child : children)
-				delete child;
-		}
+	// Per-material data indexed by ObjectData.materialIndex.
+	struct MaterialData {
+		u32   parallaxMode  = 0;
+		u32   parallaxSteps = 0;
+		float parallaxScale = 0.0f;
 	};
 
-private:
-	struct PushConstants {
-		glm::mat4 model;
-		u32   parallaxMode;
-		u32   parallaxSteps;
-		float parallaxScale;
+	// A range of draws in the indirect buffer sharing the same material.
+	struct DrawBatch {
+		i32 materialIndex;
+		u32 firstDraw;
+		u32 drawCount;
 	};
 
 	struct Material {
@@ -67,23 +168,72 @@ private:
 		Handle<Texture>   normal;
 		Handle<Texture>   metallicRoughness;
 		Handle<BindGroup> bindgroup;
-
-		u32 parallaxMode = 0;
-		u32 parallaxSteps = 0;
-		float parallaxScale = 0.0f;
 	};
 
-	void DrawNode(CommandBuffer& cmd, Node* node, bool shadowMap) const;
+	void BuildDraws();
+	void UpdateTransforms();
+	void UpdateObjectData(u32 draw);
+
+	// Clear the visibility of the draws rejected by the filter. Returns the number of draws that are still visible.
+	u32 FilterVisible(DrawFilter filter, u32 visibleCount);
 
 	Device* m_device;
 	Handle<BindGroupLayout> m_materialBindGroupLayout;
+	Handle<BindGroupLayout> m_drawBindGroupLayout;
 
 	std::vector<Handle<Texture>> m_images;
 	std::vector<Material>		 m_materials;
-	std::vector<Node*>			 m_nodes;
+	std::vector<Primitive>		 m_primitives;
+	Hierarchy					 m_hierarchy;
+
+	// Nodes whose local transform changed since the last Update.
+	std::vector<u32> m_dirtyNodes;
 
 	// TODO: get rid of this dummy. Invalid handles should be handled by backend code.
 	Handle<Texture> m_dummyTexture;
+	Handle<Buffer>  m_positions;
 	Handle<Buffer>  m_vertices;
 	Handle<Buffer>  m_indices;
+	u64				m_positionBufferSize = 0;
+	u64				m_vertexBufferSize	 = 0;
+	u64				m_indexBufferSize	 = 0;
+	IndexType		m_indexType			 = IndexType::UINT32;
+
+	// Indirect draw commands sorted by material.
+	std::vector<DrawBatch> m_batches;
+	u32				  m_drawCount = 0;
+	Handle<Buffer>	  m_drawCommands;
+	std::vector<DrawIndexedIndirectCommand> m_commands;
+
+	// World space bounds of each draw, and the culling results of the last call to Cull.
+	BoundsSoA		m_bounds;
+	std::vector<u8> m_visible;
+	std::vector<u8> m_layerMasks;
+	std::vector<AABB> m_movedBounds;
+	std::vector<AABB> m_movedStaticBounds;
+	std::vector<AABB> m_changedStaticBounds;	// bounds of draws made static or dynamic since the last Update
+
+	// Per-frame, persistently mapped indirect buffers holding MaxViews regions of m_drawCount commands, and the batches of each view.
+	Handle<Buffer>		   m_viewCommands[Device::MaxFramesInFlight];
+	std::vector<DrawBatch> m_viewBatches[MaxViews];
+	std::vector<u32>	   m_viewDraws[MaxViews];
+
+	// Node and primitive of each draw, and the draw of each primitive (~0u if the primitive is never drawn).
+	std::vector<u32> m_drawNodes;
+	std::vector<u32> m_drawPrimitives;
+	std::vector<u32> m_primitiveDraws;
+	std::vector<u8>  m_drawDynamic;
+
+	glm::mat4 m_transform = glm::mat4(1.0f);
+
+	// CPU copies of the object and material data. Each frame in flight has its own GPU buffers, which are
+	// rewritten while the dirty counters are non-zero. Every pass reuses the same data through the instance index.
+	std::vector<ObjectData>	  m_objectData;
+	std::vector<MaterialData> m_materialData;
+	u32 m_objectsDirty	 = Device::MaxFramesInFlight;
+	u32 m_materialsDirty = Device::MaxFramesInFlight;
+
+	Handle<Buffer>	  m_objectBuffers[Device::MaxFramesInFlight];
+	Handle<Buffer>	  m_materialBuffers[Device::MaxFramesInFlight];
+	Handle<BindGroup> m_drawBindings[Device::MaxFramesInFlight];
 };
\ No newline at end of file
@@ -2,6 +2,8 @@
 
 #include "../Core/ResourceManager.h"
 
+#include "Camera.h"
+
 GTAO::GTAO(u32 width, u32 height, Handle<Texture> depth, Handle<Texture> normal)
     : m_width{ width }, m_height{ height }, m_depth{ depth }, m_normal{ normal }
 {
@@ -33,7 +35,7 @@ GTAO::GTAO(u32 width, u32 height, Handle<Texture> depth, Handle<Texture> normal)
 
     m_aoOutputLayout = rm->CreateBindGroupLayout({
         .debugName = "GTAO output layout",
-        .bindings = { {.type = Binding::Type::TEXTURE, .stages = ShaderStage::FRAGMENT } }
+        .bindings = { {.type = Binding::Type::TEXTURE, .stages = ShaderStage::FRAGMENT | ShaderStage::COMPUTE } }
     });
 
     // -- Per-frame UBOs and bind groups --
@@ -62,6 +64,7 @@ GTAO::GTAO(u32 width, u32 height, Handle<Texture> depth, Handle<Texture> normal)
     });
 
     // -- Pipelines --
+    // Both passes bind the depth buffer read-only, and skip sky pixels with the depth bounds test.
     std::vector<u32> fullscreenVert = ReadShaderSpv("Shaders/deferred.vert.spv");
     std::vector<u32> gtaoFrag      = ReadShaderSpv("Shaders/gtao.frag.spv");
     std::vector<u32> blurFrag      = ReadShaderSpv("Shaders/gtao_blur.frag.spv");
@@ -75,7 +78,12 @@ GTAO::GTAO(u32 width, u32 height, Handle<Texture> depth, Handle<Texture> normal)
         .bindgroupLayouts = { m_gtaoUBOLayout, m_gtaoTextureLayout },
         .graphicsState = {
             .colorAttachments = { Format::R8_UNORM },
-            .depthStencilState = {},
+            .depthStencilState = {
+                .depthStencilFormat = Format::D24_UNORM_S8_UINT,
+                .depthTestEnable = false,
+                .depthWriteEnable = false,
+                .depthBoundsTestEnable = true
+            },
             .rasterizationState = {.cullMode = CullMode::Front }
         }
     });
@@ -89,7 +97,12 @@ GTAO::GTAO(u32 width, u32 height, Handle<Texture> depth, Handle<Texture> normal)
         .bindgroupLayouts = { m_gtaoUBOLayout, m_blurTextureLayout },
         .graphicsState = {
             .colorAttachments = { Format::R8_UNORM },
-            .depthStencilState = {},
+            .depthStencilState = {
+                .depthStencilFormat = Format::D24_UNORM_S8_UINT,
+                .depthTestEnable = false,
+                .depthWriteEnable = false,
+                .depthBoundsTestEnable = true
+            },
             .rasterizationState = {.cullMode = CullMode::Front }
         }
     });
@@ -201,7 +214,8 @@ void GTAO::Render(CommandBuffer& cmd) {
     cmd.SetBindGroup(m_gtaoUBOBindings[frame], 0);
     cmd.SetBindGroup(m_gtaoTextureBindings[frame], 1);
 
-    cmd.BeginRendering(extent, { m_aoRaw });
+    cmd.BeginRendering(extent, { m_aoRaw }, m_depth, true);
+    cmd.SetDepthBounds(Camera::MinSurfaceDepth, 1.0f);
     cmd.Draw(3, 1, 0, 0);
     cmd.EndRendering();
 
@@ -213,7 +227,8 @@ void GTAO::Render(CommandBuffer& cmd) {
     cmd.SetBindGroup(m_gtaoUBOBindings[frame], 0);
     cmd.SetBindGroup(m_blurTextureBindings[frame], 1);
 
-    cmd.BeginRendering(extent, { m_aoBlurred });
+    cmd.BeginRendering(extent, { m_aoBlurred }, m_depth, true);
+    cmd.SetDepthBounds(Camera::MinSurfaceDepth, 1.0f);
     cmd.Draw(3, 1, 0, 0);
     cmd.EndRendering();
 
@@ -12,6 +12,7 @@ public:
 
     void Resize(u32 width, u32 height, Handle<Texture> depth, Handle<Texture> normal);
     void Update(const glm::mat4& proj, const glm::mat4& invProj);
+    // Depth and normal must be in shader resource usage. Sky pixels are skipped, and their AO is left undefined.
     void Render(CommandBuffer& cmd);
 
     Handle<BindGroupLayout> GetAOBindingsLayout() { return m_aoOutputLayout; }
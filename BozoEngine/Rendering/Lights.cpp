@@ -0,0 +1,344 @@
+#include "Lights.h"
+
+#include "../Core/ResourceManager.h"
+
+// MSVC does not define __SSE2__, but SSE2 is always available on x64.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define LIGHTS_SSE
+    #include <emmintrin.h>
+#endif
+
+LightManager::LightManager() {
+    for (u32 i = 0; i < Device::MaxFramesInFlight; i++) {
+        m_lightBuffers[i] = ResourceManager::ptr->CreateBuffer({
+            .debugName = "Point light buffer",
+            .byteSize  = sizeof(GPULight) * MaxLights,
+            .usage     = Usage::SHADER_RESOURCE,
+            .memory    = Memory::Upload
+        });
+    }
+}
+
+LightManager::~LightManager() {
+    for (Handle<Buffer> buffer : m_lightBuffers)
+        ResourceManager::ptr->DestroyBuffer(buffer);
+}
+
+u32 LightManager::Index(Handle<PointLight> handle) const {
+    return m_indices.valid(handle) ? *m_indices.get(handle) : MaxLights;
+}
+
+Handle<PointLight> LightManager::AddPointLight(const PointLight& light) {
+    if (m_count == MaxLights) return {};
+
+    const u32 index = m_count++;
+    const Handle<PointLight> handle = m_indices.insert(index);
+    m_handles[index] = handle;
+
+    m_positionX[index] = light.position.x; m_positionY[index] = light.position.y; m_positionZ[index] = light.position.z;
+    m_colorR[index]    = light.color.r;    m_colorG[index]    = light.color.g;    m_colorB[index]    = light.color.b;
+    m_radius[index]    = light.radius;
+
+    MarkDirty();
+    return handle;
+}
+
+void LightManager::RemovePointLight(Handle<PointLight> handle) {
+    const u32 index = Index(handle);
+    if (index == MaxLights) return;
+
+    // Move the last light into the freed slot, and point its handle at the new slot.
+    const u32 last = --m_count;
+    if (index != last) {
+        m_positionX[index] = m_positionX[last]; m_positionY[index] = m_positionY[last]; m_positionZ[index] = m_positionZ[last];
+        m_colorR[index]    = m_colorR[last];    m_colorG[index]    = m_colorG[last];    m_colorB[index]    = m_colorB[last];
+        m_radius[index]    = m_radius[last];
+
+        m_handles[index] = m_handles[last];
+        *m_indices.get(m_handles[index]) = index;
+    }
+
+    m_indices.free(handle);
+    MarkDirty();
+}
+
+void LightManager::SetPosition(Handle<PointLight> handle, glm::vec3 position) {
+    const u32 i = Index(handle);
+    if (i == MaxLights) return;
+
+    if (m_positionX[i] == position.x && m_positionY[i] == position.y && m_positionZ[i] == position.z) return;
+
+    m_positionX[i] = position.x; m_positionY[i] = position.y; m_positionZ[i] = position.z;
+    MarkDirty();
+}
+
+void LightManager::SetRadius(Handle<PointLight> handle, float radius) {
+    const u32 i = Index(handle);
+    if (i == MaxLights || m_radius[i] == radius) return;
+
+    m_radius[i] = radius;
+    MarkDirty();
+}
+
+void LightManager::SetColor(Handle<PointLight> handle, glm::vec3 color) {
+    const u32 i = Index(handle);
+    if (i == MaxLights) return;
+
+    if (m_colorR[i] == color.r && m_colorG[i] == color.g && m_colorB[i] == color.b) return;
+
+    m_colorR[i] = color.r; m_colorG[i] = color.g; m_colorB[i] = color.b;
+    MarkDirty();
+}
+
+PointLight LightManager::GetPointLight(Handle<PointLight> handle) const {
+    const u32 i = Index(handle);
+    Check(i != MaxLights, "Invalid point light handle");
+
+    return {
+        .position = glm::vec3(m_positionX[i], m_positionY[i], m_positionZ[i]),
+        .radius   = m_radius[i],
+        .color    = glm::vec3(m_colorR[i], m_colorG[i], m_colorB[i])
+    };
+}
+
+void LightManager::Update(const glm::mat4& view) {
+    const u32 frame = Device::ptr->FrameIdx();
+
+    // GetLightVolumes reads the staged lights, so they are restaged even if this frame's buffer is up to date, as the other
+    // frame in flight may have staged another view. It may also already have staged this one.
+    if (m_stagingVersion != m_version || m_stagingView != view)
+        TransformLights(view);
+
+    if (m_bufferVersion[frame] == m_version && m_bufferView[frame] == view) return;
+
+    if (m_count > 0)
+        ResourceManager::ptr->WriteBuffer(m_lightBuffers[frame], m_gpuLights, sizeof(GPULight) * m_count, 0);
+
+    m_bufferVersion[frame] = m_version;
+    m_bufferView[frame]    = view;
+}
+
+void LightManager::TransformLights(const glm::mat4& view) {
+    u32 i = 0;
+
+#if defined(LIGHTS_SSE)
+    // Transform 4 lights at a time, then transpose the SoA registers into 4 GPULights.
+    const __m128 m00 = _mm_set1_ps(view[0][0]), m10 = _mm_set1_ps(view[1][0]), m20 = _mm_set1_ps(view[2][0]), m30 = _mm_set1_ps(view[3][0]);
+    const __m128 m01 = _mm_set1_ps(view[0][1]), m11 = _mm_set1_ps(view[1][1]), m21 = _mm_set1_ps(view[2][1]), m31 = _mm_set1_ps(view[3][1]);
+    const __m128 m02 = _mm_set1_ps(view[0][2]), m12 = _mm_set1_ps(view[1][2]), m22 = _mm_set1_ps(view[2][2]), m32 = _mm_set1_ps(view[3][2]);
+
+    for (; i + 4 <= m_count; i += 4) {
+        const __m128 px = _mm_load_ps(&m_positionX[i]);
+        const __m128 py = _mm_load_ps(&m_positionY[i]);
+        const __m128 pz = _mm_load_ps(&m_positionZ[i]);
+
+        __m128 x = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, px), _mm_mul_ps(m10, py)), _mm_add_ps(_mm_mul_ps(m20, pz), m30));
+        __m128 y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m01, px), _mm_mul_ps(m11, py)), _mm_add_ps(_mm_mul_ps(m21, pz), m31));
+        __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m02, px), _mm_mul_ps(m12, py)), _mm_add_ps(_mm_mul_ps(m22, pz), m32));
+        __m128 w = _mm_load_ps(&m_radius[i]);
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+
+        __m128 r = _mm_load_ps(&m_colorR[i]);
+        __m128 g = _mm_load_ps(&m_colorG[i]);
+        __m128 b = _mm_load_ps(&m_colorB[i]);
+        __m128 a = _mm_setzero_ps();
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+
+        _mm_storeu_ps(&m_gpuLights[i + 0].positionRadius.x, x); _mm_storeu_ps(&m_gpuLights[i + 0].color.x, r);
+        _mm_storeu_ps(&m_gpuLights[i + 1].positionRadius.x, y); _mm_storeu_ps(&m_gpuLights[i + 1].color.x, g);
+        _mm_storeu_ps(&m_gpuLights[i + 2].positionRadius.x, z); _mm_storeu_ps(&m_gpuLights[i + 2].color.x, b);
+        _mm_storeu_ps(&m_gpuLights[i + 3].positionRadius.x, w); _mm_storeu_ps(&m_gpuLights[i + 3].color.x, a);
+    }
+#endif
+
+    // Scalar fallback for the remaining lights
+    for (; i < m_count; i++) {
+        const glm::vec4 position = view * glm::vec4(m_positionX[i], m_positionY[i], m_positionZ[i], 1.0f);
+
+        m_gpuLights[i] = {
+            .positionRadius = glm::vec4(glm::vec3(position), m_radius[i]),
+            .color          = glm::vec4(m_colorR[i], m_colorG[i], m_colorB[i], 0.0f)
+        };
+    }
+
+    m_stagingVersion = m_version;
+    m_stagingView    = view;
+}
+
+// Bounds of the projection of a sphere onto one screen axis, from the two planes through the camera that are tangent to it.
+// c is the sphere center in the plane spanned by the axis and the view direction, and must be farther than r from the camera.
+static glm::vec2 ProjectSphereAxis(glm::vec2 c, float r, float scale) {
+    const float sinA = r / glm::length(c);
+    const float cosA = glm::sqrt(1.0f - sinA * sinA);
+
+    // Rotate the direction to the center by +-asin(r / |c|) to get the directions of the two tangents.
+    const glm::vec2 t0 = glm::vec2(c.x * cosA - c.y * sinA, c.x * sinA + c.y * cosA);
+    const glm::vec2 t1 = glm::vec2(c.x * cosA + c.y * sinA, c.y * cosA - c.x * sinA);
+
+    const float a = scale * t0.x / t0.y;
+    const float b = scale * t1.x / t1.y;
+    return glm::vec2(glm::min(a, b), glm::max(a, b));
+}
+
+void LightManager::GetLightVolumes(const glm::mat4& projection, Extent2D extent, std::vector<LightVolume>& volumes) const {
+    volumes.clear();
+
+    // View space depth of the near plane, where device depth reaches 1 in reversed-Z.
+    const float nearZ = projection[3][2] / (1.0f - projection[2][2]);
+
+    auto deviceDepth = [&](float z) {
+        return glm::clamp((projection[2][2] * z + projection[3][2]) / (projection[2][3] * z + projection[3][3]), 0.0f, 1.0f);
+    };
+
+    for (u32 i = 0; i < m_count; i++) {
+        const glm::vec3 p = glm::vec3(m_gpuLights[i].positionRadius);
+        const float     r = m_gpuLights[i].positionRadius.w;
+
+        // View space z points forward, so lights entirely behind the near plane are never visible.
+        if (p.z + r <= nearZ) continue;
+
+        // Spheres crossing the near plane can cover any part of the screen. Otherwise, bound their projection on both axes.
+        glm::vec2 ndcMin = glm::vec2(-1.0f);
+        glm::vec2 ndcMax = glm::vec2( 1.0f);
+        if (p.z - r > nearZ) {
+            const glm::vec2 x = ProjectSphereAxis(glm::vec2(p.x, p.z), r, projection[0][0]);
+            const glm::vec2 y = ProjectSphereAxis(glm::vec2(p.y, p.z), r, projection[1][1]);
+            ndcMin = glm::max(ndcMin, glm::vec2(x.x, y.x));
+            ndcMax = glm::min(ndcMax, glm::vec2(x.y, y.y));
+        }
+
+        const glm::vec2 size = glm::vec2(extent.width, extent.height);
+        const glm::ivec2 pixelMin = glm::ivec2(glm::floor((ndcMin * 0.5f + 0.5f) * size));
+        const glm::ivec2 pixelMax = glm::ivec2(glm::ceil ((ndcMax * 0.5f + 0.5f) * size));
+        if (pixelMin.x >= pixelMax.x || pixelMin.y >= pixelMax.y) continue;
+
+        // Reversed-Z: the far side of the sphere has the smallest depth.
+        volumes.push_back({
+            .light    = i,
+            .scissor  = {
+                .offset = { pixelMin.x, pixelMin.y },
+                .extent = { u32(pixelMax.x - pixelMin.x), u32(pixelMax.y - pixelMin.y) }
+            },
+            .minDepth = deviceDepth(p.z + r),
+            .maxDepth = deviceDepth(glm::max(p.z - r, nearZ))
+        });
+    }
+}
+
+ClusteredLights::ClusteredLights(Camera* camera, LightManager* lights) : m_camera{ camera }, m_lights{ lights } {
+    ResourceManager* rm = ResourceManager::ptr;
+
+    m_clusterCounts = rm->CreateBuffer({
+        .debugName = "Cluster light counts",
+        .byteSize  = sizeof(u32) * ClusterCount,
+        .usage     = Usage::UNORDERED_ACCESS | Usage::SHADER_RESOURCE
+    });
+
+    m_clusterIndices = rm->CreateBuffer({
+        .debugName = "Cluster light indices",
+        .byteSize  = sizeof(u32) * ClusterCount * MaxLightsPerCluster,
+        .usage     = Usage::UNORDERED_ACCESS | Usage::SHADER_RESOURCE
+    });
+
+    m_cullLayout = rm->CreateBindGroupLayout({
+        .debugName = "Light culling bindgroup layout",
+        .bindings  = {
+            {.type = Binding::Type::STORAGE_BUFFER, .stages = ShaderStage::COMPUTE },
+            {.type = Binding::Type::STORAGE_BUFFER, .stages = ShaderStage::COMPUTE },
+            {.type = Binding::Type::STORAGE_BUFFER, .stages = ShaderStage::COMPUTE }
+        }
+    });
+
+    m_lightBindingsLayout = rm->CreateBindGroupLayout({
+        .debugName = "Light bindgroup layout",
+        .bindings  = {
+            {.type = Binding::Type::STORAGE_BUFFER, .stages = ShaderStage::FRAGMENT | ShaderStage::COMPUTE },
+            {.type = Binding::Type::STORAGE_BUFFER, .stages = ShaderStage::FRAGMENT | ShaderStage::COMPUTE },
+            {.type = Binding::Type::STORAGE_BUFFER, .stages = ShaderStage::FRAGMENT | ShaderStage::COMPUTE }
+        }
+    });
+
+    for (u32 i = 0; i < Device::MaxFramesInFlight; i++) {
+        const BufferBinding buffers[] = {
+            {.binding = 0, .buffer = lights->GetLightBuffer(i), .offset = 0, .size = sizeof(GPULight) * LightManager::MaxLights },
+            {.binding = 1, .buffer = m_clusterCounts,   .offset = 0, .size = sizeof(u32) * ClusterCount },
+            {.binding = 2, .buffer = m_clusterIndices,  .offset = 0, .size = sizeof(u32) * ClusterCount * MaxLightsPerCluster }
+        };
+
+        m_cullBindings[i] = rm->CreateBindGroup({
+            .debugName = "Light culling bindgroup",
+            .layout    = m_cullLayout,
+            .buffers   = buffers
+        });
+
+        m_lightBindings[i] = rm->CreateBindGroup({
+            .debugName = "Light bindgroup",
+            .layout    = m_lightBindingsLayout,
+            .buffers   = buffers
+        });
+    }
+
+    std::vector<u32> cullShader = ReadShaderSpv("Shaders/clusterLights.comp.spv");
+
+    m_cullPipeline = rm->CreatePipeline({
+        .debugName = "Light culling pipeline",
+        .shaderDescs = { {.spirv = cullShader, .stage = ShaderStage::COMPUTE } },
+        .bindgroupLayouts = { m_cullLayout }
+    });
+
+    // The cluster buffers are read by the deferred pass, and written again by the culling pass of the next frame.
+    CommandBuffer& cmd = Device::ptr->GetCommandBuffer();
+    cmd.BufferBarrier(m_clusterCounts,  Usage::UNORDERED_ACCESS, Usage::SHADER_RESOURCE);
+    cmd.BufferBarrier(m_clusterIndices, Usage::UNORDERED_ACCESS, Usage::SHADER_RESOURCE);
+    Device::ptr->FlushCommandBuffer(cmd);
+}
+
+ClusteredLights::~ClusteredLights() {
+    ResourceManager* rm = ResourceManager::ptr;
+
+    rm->DestroyPipeline(m_cullPipeline);
+
+    rm->DestroyBuffer(m_clusterCounts);
+    rm->DestroyBuffer(m_clusterIndices);
+
+    rm->DestroyBindGroupLayout(m_cullLayout);
+    rm->DestroyBindGroupLayout(m_lightBindingsLayout);
+}
+
+void ClusteredLights::Update() {
+    const float logRange = glm::log2(settings.farZ / settings.nearZ);
+
+    m_clusterData = {
+        .lightCount = m_lights->PointLightCount(),
+        .clustered  = settings.clustered,
+        .sliceScale = GridZ / logRange,
+        .sliceBias  = -(GridZ * glm::log2(settings.nearZ)) / logRange
+    };
+}
+
+void ClusteredLights::CullLights(CommandBuffer& cmd) {
+    if (!settings.clustered) return;
+
+    struct {
+        glm::mat4 invProj;
+        float     nearZ;
+        float     farZ;
+        u32       lightCount;
+    } pc = {
+        .invProj    = glm::inverse(m_camera->projection),
+        .nearZ      = settings.nearZ,
+        .farZ       = settings.farZ,
+        .lightCount = m_clusterData.lightCount
+    };
+
+    cmd.BufferBarrier(m_clusterCounts,  Usage::SHADER_RESOURCE, Usage::UNORDERED_ACCESS);
+    cmd.BufferBarrier(m_clusterIndices, Usage::SHADER_RESOURCE, Usage::UNORDERED_ACCESS);
+
+    cmd.SetPipeline(m_cullPipeline);
+    cmd.SetBindGroup(m_cullBindings[Device::ptr->FrameIdx()], 0);
+    cmd.PushConstants(&pc, 0, sizeof(pc), ShaderStage::COMPUTE);
+    cmd.Dispatch((ClusterCount + 63) / 64, 1, 1);
+
+    cmd.BufferBarrier(m_clusterCounts,  Usage::UNORDERED_ACCESS, Usage::SHADER_RESOURCE);
+    cmd.BufferBarrier(m_clusterIndices, Usage::UNORDERED_ACCESS, Usage::SHADER_RESOURCE);
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "../Core/Graphics.h"
+#include "../Core/Device.h"
+#include "../Core/Pool.h"
+
+#include "Camera.h"
+
+#include <glm/glm.hpp>
+
+struct PointLight {
+    glm::vec3 position;     // world space
+    float     radius;       // distance at which the light falls off to zero
+    glm::vec3 color;
+};
+
+// View space light, as read by the shaders.
+struct GPULight {
+    glm::vec4 positionRadius;
+    glm::vec4 color;
+};
+
+// Screen space bounds of a point light's sphere of influence, for shading it as a light volume.
+struct LightVolume {
+    u32    light;       // index of the light in the light buffer
+    Rect2D scissor;     // pixels the sphere can project to
+    float  minDepth;    // device depth range the sphere spans
+    float  maxDepth;
+};
+
+// Owns the point lights of the scene. Lights are stored in SoA layout, so they can be transformed to view space several at
+// a time with SIMD, and are addressed through stable handles that survive the removal of other lights.
+// Each frame in flight has its own light buffer, which is only re-uploaded when the lights or the view changed since it was last written.
+class LightManager {
+public:
+    static constexpr u32 MaxLights = 4096;
+
+    LightManager();
+    ~LightManager();
+
+    // Returns an invalid handle if MaxLights lights have already been added.
+    Handle<PointLight> AddPointLight(const PointLight& light);
+    void RemovePointLight(Handle<PointLight> handle);
+
+    void SetPosition(Handle<PointLight> handle, glm::vec3 position);
+    void SetRadius(Handle<PointLight> handle, float radius);
+    void SetColor(Handle<PointLight> handle, glm::vec3 color);
+
+    PointLight GetPointLight(Handle<PointLight> handle) const;
+    u32 PointLightCount() const { return m_count; }
+
+    // Transform the lights to view space and upload them to the light buffer of the current frame, if it is out of date.
+    // Must be called after a successful Device.BeginFrame().
+    void Update(const glm::mat4& view);
+
+    Handle<Buffer> GetLightBuffer(u32 frame) { return m_lightBuffers[frame]; }
+
+    // Compute the light volumes of the lights transformed by the last call to Update, for a camera with the given reversed-Z
+    // projection rendering to a target of the given extent. Lights that cannot cover any pixel are skipped.
+    void GetLightVolumes(const glm::mat4& projection, Extent2D extent, std::vector<LightVolume>& volumes) const;
+
+private:
+    // Write the view space lights to m_gpuLights.
+    void TransformLights(const glm::mat4& view);
+
+    // Dense index of the light, or MaxLights if the handle is invalid.
+    u32 Index(Handle<PointLight> handle) const;
+
+    // Bumped whenever a light is added, removed or modified.
+    void MarkDirty() { m_version++; }
+
+    // Handles map to dense indices into the SoA arrays. Removing a light moves the last light into its slot, so the arrays
+    // stay packed; m_handles maps each dense index back to its handle to patch the moved light's entry in the pool.
+    Pool<u32, PointLight> m_indices;
+    Handle<PointLight>    m_handles[MaxLights];
+    u32                   m_count = 0;
+
+    alignas(16) float m_positionX[MaxLights];
+    alignas(16) float m_positionY[MaxLights];
+    alignas(16) float m_positionZ[MaxLights];
+    alignas(16) float m_radius[MaxLights];
+    alignas(16) float m_colorR[MaxLights];
+    alignas(16) float m_colorG[MaxLights];
+    alignas(16) float m_colorB[MaxLights];
+
+    // Staging copy of the view space lights, holding the lights of version m_stagingVersion transformed by m_stagingView.
+    GPULight  m_gpuLights[MaxLights];
+    u64       m_stagingVersion = 0;
+    glm::mat4 m_stagingView;
+
+    // Light buffer i holds the lights of version m_bufferVersion[i], transformed by m_bufferView[i].
+    u64       m_version = 1;
+    u64       m_bufferVersion[Device::MaxFramesInFlight] = {};
+    glm::mat4 m_bufferView[Device::MaxFramesInFlight];
+
+    Handle<Buffer> m_lightBuffers[Device::MaxFramesInFlight];
+};
+
+// Bins point lights into a froxel grid: the screen is split into GridX x GridY tiles, and view space depth into GridZ
+// logarithmic slices. Each froxel (cluster) holds the indices of the lights whose sphere of influence overlaps it, so
+// shading a pixel only loops over the lights of its cluster. The lights are read from the buffers of a LightManager.
+class ClusteredLights {
+public:
+    static constexpr u32 MaxLightsPerCluster = 128;
+
+    static constexpr u32 GridX = 16;
+    static constexpr u32 GridY = 9;
+    static constexpr u32 GridZ = 24;
+    static constexpr u32 ClusterCount = GridX * GridY * GridZ;
+
+    ClusteredLights(Camera* camera, LightManager* lights);
+    ~ClusteredLights();
+
+    // Update the cluster data of the current frame. Must be called after the LightManager has been updated.
+    void Update();
+
+    // Assign the lights of the LightManager to the clusters they overlap.
+    void CullLights(CommandBuffer& cmd);
+
+    Handle<BindGroupLayout> GetLightBindingsLayout() { return m_lightBindingsLayout; }
+    Handle<BindGroup>       GetLightBindings()       { return m_lightBindings[Device::ptr->FrameIdx()]; }
+
+    struct Settings {
+        // Shade each pixel with the lights of its cluster only. Otherwise every pixel loops over every light.
+        bool clustered = true;
+
+        // View space depth range split into the GridZ slices. Pixels closer than nearZ use the first slice, and pixels
+        // farther than farZ the last one, which only holds the lights reaching into [.., farZ].
+        float nearZ = 0.1f;
+        float farZ  = 256.0f;
+    } settings;
+
+    struct ClusterDataUBO {
+        u32 lightCount;
+        u32 clustered;
+        float sliceScale;   // slice = log2(z) * sliceScale + sliceBias
+        float sliceBias;
+    } m_clusterData;
+
+private:
+    Camera*       m_camera;
+    LightManager* m_lights;
+
+    // Number of lights in each cluster, and MaxLightsPerCluster light indices per cluster.
+    Handle<Buffer> m_clusterCounts;
+    Handle<Buffer> m_clusterIndices;
+
+    Handle<Pipeline>        m_cullPipeline;
+    Handle<BindGroupLayout> m_cullLayout;
+    Handle<BindGroup>       m_cullBindings[Device::MaxFramesInFlight];
+
+    Handle<BindGroupLayout> m_lightBindingsLayout;
+    Handle<BindGroup>       m_lightBindings[Device::MaxFramesInFlight];
+};
@@ -0,0 +1,263 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+VertexCacheStats AnalyzeVertexCache(span<const u32> indices, u32 vertexCount, u32 cacheSize) {
+    VertexCacheStats stats = { .triangles = (u32)indices.size() / 3 };
+
+    // FIFO cache: a vertex is cached if fewer than cacheSize vertices were inserted after it, i.e. if
+    // time - inserted[v] <= cacheSize. Timestamps start at cacheSize + 1, so vertices that were never inserted miss.
+    std::vector<u32> inserted(vertexCount, 0);
+    std::vector<u8>  referenced(vertexCount, 0);
+    u32 time = cacheSize + 1;
+
+    for (u32 index : indices) {
+        if (time - inserted[index] > cacheSize) {
+            inserted[index] = time++;
+            stats.misses++;
+        }
+
+        stats.vertices += referenced[index] ? 0 : 1;
+        referenced[index] = 1;
+    }
+
+    return stats;
+}
+
+// FNV-1a over the bytes of the vertex in every stream.
+static u64 HashVertex(span<const VertexStream> streams, u32 vertex) {
+    u64 hash = 0xcbf29ce484222325ull;
+    for (const VertexStream& stream : streams) {
+        const u8* bytes = (const u8*)stream.data + (u64)vertex * stream.stride;
+        for (u32 i = 0; i < stream.stride; i++) {
+            hash ^= bytes[i];
+            hash *= 0x100000001b3ull;
+        }
+    }
+    return hash;
+}
+
+static bool VerticesEqual(span<const VertexStream> streams, u32 a, u32 b) {
+    for (const VertexStream& stream : streams) {
+        const u8* bytes = (const u8*)stream.data;
+        if (memcmp(bytes + (u64)a * stream.stride, bytes + (u64)b * stream.stride, stream.stride) != 0)
+            return false;
+    }
+    return true;
+}
+
+u32 WeldVertices(span<const u32> indices, u32 vertexCount, span<const VertexStream> streams, std::vector<u32>& remap) {
+    remap.assign(vertexCount, ~0u);
+
+    std::vector<u8> referenced(vertexCount, 0);
+    for (u32 index : indices)
+        referenced[index] = 1;
+
+    // Open addressing hash table of the first vertex seen with each value, at most half full.
+    const u32 tableSize = std::bit_ceil(std::max(vertexCount * 2, 16u));
+    std::vector<u32> table(tableSize, ~0u);
+
+    u32 count = 0;
+    for (u32 v = 0; v < vertexCount; v++) {
+        if (!referenced[v]) continue;
+
+        u32 slot = (u32)HashVertex(streams, v) & (tableSize - 1);
+        while (table[slot] != ~0u && !VerticesEqual(streams, table[slot], v))
+            slot = (slot + 1) & (tableSize - 1);
+
+        if (table[slot] == ~0u) {
+            table[slot] = v;
+            remap[v] = count++;
+        }
+        else {
+            remap[v] = remap[table[slot]];
+        }
+    }
+
+    return count;
+}
+
+void OptimizeVertexCache(span<u32> indices, u32 vertexCount, std::vector<u32>& clusters, u32 cacheSize) {
+    const u32 triangleCount = (u32)indices.size() / 3;
+
+    clusters.clear();
+    if (triangleCount == 0) return;
+
+    // Triangles adjacent to each vertex. The triangles of vertex v are adjacency[offsets[v]] to adjacency[offsets[v + 1]].
+    std::vector<u32> live(vertexCount, 0);
+    for (u32 i = 0; i < indices.size(); i++)
+        live[indices[i]]++;
+
+    std::vector<u32> offsets(vertexCount + 1, 0);
+    for (u32 v = 0; v < vertexCount; v++)
+        offsets[v + 1] = offsets[v] + live[v];
+
+    std::vector<u32> adjacency(indices.size());
+    std::vector<u32> fill(offsets.begin(), offsets.end() - 1);
+    for (u32 t = 0; t < triangleCount; t++) {
+        for (u32 k = 0; k < 3; k++)
+            adjacency[fill[indices[3 * t + k]]++] = t;
+    }
+
+    // Cache timestamps as in AnalyzeVertexCache: a vertex is cached if time - cached[v] <= cacheSize.
+    std::vector<u32> cached(vertexCount, 0);
+    std::vector<u8>  emitted(triangleCount, 0);
+    std::vector<u32> deadEnd;
+    std::vector<u32> candidates;
+    std::vector<u32> output;
+    output.reserve(indices.size());
+
+    u32 time   = cacheSize + 1;
+    u32 cursor = 0;
+
+    while (live[cursor] == 0) cursor++;
+    u32 fanning = cursor;
+    clusters.push_back(0);
+
+    while (true) {
+        // Emit every remaining triangle around the fanning vertex.
+        candidates.clear();
+        for (u32 a = offsets[fanning]; a < offsets[fanning + 1]; a++) {
+            const u32 t = adjacency[a];
+            if (emitted[t]) continue;
+            emitted[t] = 1;
+
+            for (u32 k = 0; k < 3; k++) {
+                const u32 v = indices[3 * t + k];
+                output.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+
+                if (time - cached[v] > cacheSize)
+                    cached[v] = time++;
+            }
+        }
+
+        // Fan around the candidate that has been cached the longest, while staying cached once its own triangles are
+        // emitted. Failing that, any candidate with triangles left will do.
+        u32 next = ~0u;
+        i32 bestPriority = -1;
+        for (u32 v : candidates) {
+            if (live[v] == 0) continue;
+
+            const i32 priority = time - cached[v] + 2 * live[v] <= cacheSize ? (i32)(time - cached[v]) : 0;
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                next = v;
+            }
+        }
+
+        if (next == ~0u) {
+            // Dead end: resume from the most recently emitted vertex with triangles left, or else the next one in input
+            // order. If that vertex has left the cache, nothing is reused across the jump, so a new cluster starts.
+            while (next == ~0u && !deadEnd.empty()) {
+                const u32 v = deadEnd.back();
+                deadEnd.pop_back();
+                if (live[v] > 0) next = v;
+            }
+            while (next == ~0u && cursor < vertexCount) {
+                if (live[cursor] > 0) next = cursor;
+                else cursor++;
+            }
+
+            if (next == ~0u) break;
+
+            if (time - cached[next] > cacheSize)
+                clusters.push_back((u32)output.size() / 3);
+        }
+
+        fanning = next;
+    }
+
+    memcpy(indices.data(), output.data(), output.size() * sizeof(u32));
+}
+
+void OptimizeOverdraw(span<u32> indices, span<const glm::vec3> positions, span<const u32> clusters) {
+    if (clusters.size() < 2) return;
+
+    const u32 triangleCount = (u32)indices.size() / 3;
+
+    struct Cluster {
+        u32 firstTriangle;
+        u32 triangleCount;
+        glm::vec3 center;   // area weighted centroid
+        glm::vec3 normal;   // area weighted normal
+        float area;
+        float sortKey;
+    };
+
+    std::vector<Cluster> sorted(clusters.size());
+    glm::vec3 meshCenter = glm::vec3(0.0f);
+    float meshArea = 0.0f;
+
+    for (u32 c = 0; c < clusters.size(); c++) {
+        Cluster& cluster = sorted[c];
+        cluster = {
+            .firstTriangle = clusters[c],
+            .triangleCount = (c + 1 < clusters.size() ? clusters[c + 1] : triangleCount) - clusters[c],
+            .center = glm::vec3(0.0f),
+            .normal = glm::vec3(0.0f),
+            .area = 0.0f
+        };
+
+        for (u32 t = cluster.firstTriangle; t < cluster.firstTriangle + cluster.triangleCount; t++) {
+            const glm::vec3 p0 = positions[indices[3 * t + 0]];
+            const glm::vec3 p1 = positions[indices[3 * t + 1]];
+            const glm::vec3 p2 = positions[indices[3 * t + 2]];
+
+            // Counter-clockwise triangles face along the cross product, whose length is twice their area.
+            const glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            const float area = 0.5f * glm::length(n);
+
+            cluster.center += area * (p0 + p1 + p2) / 3.0f;
+            cluster.normal += n;
+            cluster.area   += area;
+        }
+
+        meshCenter += cluster.center;
+        meshArea   += cluster.area;
+
+        if (cluster.area > 0.0f)
+            cluster.center /= cluster.area;
+    }
+
+    if (meshArea > 0.0f)
+        meshCenter /= meshArea;
+
+    // Clusters facing away from the center are on the outside of the mesh, and drawn first.
+    for (Cluster& cluster : sorted) {
+        const float length = glm::length(cluster.normal);
+        cluster.sortKey = length > 0.0f ? glm::dot(cluster.center - meshCenter, cluster.normal / length) : 0.0f;
+    }
+
+    std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+    std::vector<u32> output;
+    output.reserve(indices.size());
+    for (const Cluster& cluster : sorted) {
+        for (u32 i = 3 * cluster.firstTriangle; i < 3 * (cluster.firstTriangle + cluster.triangleCount); i++)
+            output.push_back(indices[i]);
+    }
+
+    memcpy(indices.data(), output.data(), output.size() * sizeof(u32));
+}
+
+u32 OptimizeVertexFetch(span<const u32> indices, u32 vertexCount, std::vector<u32>& remap) {
+    remap.assign(vertexCount, ~0u);
+
+    u32 count = 0;
+    for (u32 index : indices) {
+        if (remap[index] == ~0u)
+            remap[index] = count++;
+    }
+
+    return count;
+}
+
+void RemapIndices(span<u32> indices, span<const u32> remap) {
+    for (u32 i = 0; i < indices.size(); i++)
+        indices[i] = remap[indices[i]];
+}
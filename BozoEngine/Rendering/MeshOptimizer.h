@@ -0,0 +1,72 @@
+#pragma once
+
+#include "../Core/Graphics.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Load-time optimization of indexed triangle lists. The stages are meant to run in order:
+//  1. WeldVertices merges bitwise identical vertices, so triangles sharing a vertex share its index.
+//  2. OptimizeVertexCache reorders the triangles for the post-transform vertex cache (Tipsify), and splits them into clusters.
+//  3. OptimizeOverdraw reorders the clusters so outward facing clusters are drawn first, reducing overdraw.
+//  4. OptimizeVertexFetch renumbers the vertices in the order they are first used, so vertex fetches stay local.
+
+// Entries of the simulated post-transform vertex cache.
+constexpr u32 VertexCacheSize = 16;
+
+// A vertex attribute stream: vertex i is the stride bytes at data + i * stride.
+struct VertexStream {
+    const void* data;
+    u32 stride;
+};
+
+// Vertex shader invocations of a triangle list, simulated with a FIFO vertex cache.
+struct VertexCacheStats {
+    u32 triangles = 0;
+    u32 vertices  = 0;  // distinct vertices referenced
+    u32 misses    = 0;  // vertices transformed
+
+    // Average cache miss ratio: vertices transformed per triangle. 0.5 at best, 3 at worst.
+    float ACMR() const { return triangles ? (float)misses / triangles : 0.0f; }
+    // Average transform to vertex ratio: vertices transformed per distinct vertex. 1 at best.
+    float ATVR() const { return vertices ? (float)misses / vertices : 0.0f; }
+
+    VertexCacheStats& operator+=(const VertexCacheStats& other) {
+        triangles += other.triangles;
+        vertices  += other.vertices;
+        misses    += other.misses;
+        return *this;
+    }
+};
+
+VertexCacheStats AnalyzeVertexCache(span<const u32> indices, u32 vertexCount, u32 cacheSize = VertexCacheSize);
+
+// Build a remap merging the vertices that are equal in every stream. remap[i] is the new index of vertex i, or ~0u if
+// no triangle references it. Returns the number of vertices left.
+u32 WeldVertices(span<const u32> indices, u32 vertexCount, span<const VertexStream> streams, std::vector<u32>& remap);
+
+// Reorder the triangles with Tipsify (Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw").
+// clusters receives the first triangle of each cluster: runs of triangles started wherever the cache is effectively
+// flushed, which can be reordered without hurting vertex locality.
+void OptimizeVertexCache(span<u32> indices, u32 vertexCount, std::vector<u32>& clusters, u32 cacheSize = VertexCacheSize);
+
+// Sort the clusters found by OptimizeVertexCache so clusters facing away from the center of the mesh come first. They
+// are the most likely to occlude the rest of the mesh, whatever the view.
+void OptimizeOverdraw(span<u32> indices, span<const glm::vec3> positions, span<const u32> clusters);
+
+// Build a remap numbering the vertices in the order the triangles first use them. Returns the number of vertices used.
+u32 OptimizeVertexFetch(span<const u32> indices, u32 vertexCount, std::vector<u32>& remap);
+
+void RemapIndices(span<u32> indices, span<const u32> remap);
+
+// Move the vertices to their remapped positions, dropping the ones remapped to ~0u.
+template<typename T>
+void RemapVertices(std::vector<T>& vertices, span<const u32> remap, u32 remappedCount) {
+    std::vector<T> remapped(remappedCount);
+    for (u32 i = 0; i < remap.size(); i++) {
+        if (remap[i] != ~0u)
+            remapped[remap[i]] = vertices[i];
+    }
+    vertices = std::move(remapped);
+}
@@ -2,37 +2,149 @@
 
 #include "../Core/ResourceManager.h"
 
-CascadedShadowMap::CascadedShadowMap(u32 resolution, Camera* camera, span<const glm::vec2> distances)
-    : m_resolution{ resolution }, m_camera{ camera }
+#include <algorithm>
+#include <limits>
+
+// Pack square tiles of the given power of two sizes into the atlas with a simple shelf packer. Tiles are placed largest first,
+// left to right in rows as high as the first tile of the row. Returns false if the tiles don't fit.
+static bool PackAtlas(u32 atlasSize, span<const u32> resolutions, Rect2D* tiles) {
+    u32 order[CascadedShadowMap::MaxCascades];
+    for (u32 i = 0; i < resolutions.size(); i++) order[i] = i;
+    std::stable_sort(order, order + resolutions.size(), [&](u32 a, u32 b) { return resolutions[a] > resolutions[b]; });
+
+    u32 x = 0, y = 0, rowHeight = 0;
+    for (u32 i = 0; i < resolutions.size(); i++) {
+        const u32 res = resolutions[order[i]];
+
+        if (x + res > atlasSize) {
+            x = 0;
+            y += rowHeight;
+            rowHeight = 0;
+        }
+
+        if (res > atlasSize || y + res > atlasSize)
+            return false;
+
+        tiles[order[i]] = { .offset = { (i32)x, (i32)y }, .extent = { res, res } };
+        x += res;
+        rowHeight = glm::max(rowHeight, res);
+    }
+
+    return true;
+}
+
+// Split [n, f] into count overlapping cascades with the practical split scheme, blending logarithmic and uniform splits.
+// Split distances are quantized to a geometric ladder of 4 steps per power of two, so small changes of n and f rarely
+// change the cascades. Neighbouring cascades overlap by 10% of the previous cascade, to blend between them in the shader.
+static void SplitCascades(float n, float f, float lambda, u32 count, glm::vec2* distances) {
+    auto quantize = [](float x, bool up) {
+        const float steps = 4.0f * glm::log2(glm::max(x, 1e-3f));
+        return glm::exp2((up ? glm::ceil(steps) : glm::floor(steps)) * 0.25f);
+    };
+
+    auto split = [&](u32 i) {
+        const float t = (float)i / count;
+        const float logSplit = n * glm::pow(f / n, t);
+        const float uniSplit = n + (f - n) * t;
+        return glm::mix(uniSplit, logSplit, lambda);
+    };
+
+    distances[0] = glm::vec2(quantize(n, false), quantize(split(1), true));
+    for (u32 k = 1; k < count; k++) {
+        const float b = glm::max(quantize(split(k + 1), true), distances[k - 1].y * 1.01f);
+        const float a = distances[k - 1].y - 0.1f * (distances[k - 1].y - distances[k - 1].x);
+        distances[k] = glm::vec2(a, b);
+    }
+}
+
+// Planes bounding the cascade space box [min, max], in world space. The box is left open toward the light (increasing z),
+// so it also contains every caster between the light and the box.
+static Frustum CascadeBoxFrustum(const glm::mat4& world_to_cascade, glm::vec3 min, glm::vec3 max) {
+    Frustum frustum;
+
+    // The box is empty: reject everything.
+    if (min.x > max.x || min.y > max.y || min.z > max.z) {
+        frustum.planes[frustum.count++] = glm::vec4(0.0f, 0.0f, 0.0f, -1.0f);
+        return frustum;
+    }
+
+    // Row i of world_to_cascade maps a world space point to cascade space coordinate i.
+    for (u32 i = 0; i < 3; i++) {
+        const glm::vec4 row = glm::vec4(world_to_cascade[0][i], world_to_cascade[1][i], world_to_cascade[2][i], world_to_cascade[3][i]);
+
+        frustum.planes[frustum.count++] = row - glm::vec4(0.0f, 0.0f, 0.0f, min[i]);
+        if (i < 2) frustum.planes[frustum.count++] = glm::vec4(0.0f, 0.0f, 0.0f, max[i]) - row;
+    }
+
+    return frustum;
+}
+
+CascadedShadowMap::CascadedShadowMap(u32 atlasSize, Camera* camera, Handle<BindGroupLayout> drawLayout, Handle<Texture> depth, span<const CascadeDesc> cascades)
+    : m_atlasSize{ atlasSize }, m_camera{ camera }
 {
-    InitCascades(distances);
+    Check(SetCascades(cascades), "Shadow cascades don't fit in a %ux%u atlas", m_atlasSize, m_atlasSize);
 
     ResourceManager* rm = ResourceManager::ptr;
 
     m_shadowMap = rm->CreateTexture({
-        .debugName = "Cascaded shadow map",
-        .type      = TextureDesc::Type::TEXTURE2DARRAY,
-        .width     = m_resolution, .height = m_resolution,
-        .numLayers = MaxCascades,
+        .debugName = "Cascaded shadow map atlas",
+        .width     = m_atlasSize, .height = m_atlasSize,
         .format    = Format::D32_SFLOAT,
         .usage     = Usage::DEPTH_STENCIL | Usage::SHADER_RESOURCE,
         .sampler   = { true, CompareOp::Greater }
     });
 
+    // Depth of the static casters only, with the same tile layout. Re-rendered tiles of the shadow map are copied from it.
+    m_staticMap = rm->CreateTexture({
+        .debugName = "Static shadow casters atlas",
+        .width     = m_atlasSize, .height = m_atlasSize,
+        .format    = Format::D32_SFLOAT,
+        .usage     = Usage::DEPTH_STENCIL | Usage::TRANSFER_SRC
+    });
+
+    CreateMoments();
+
     // shadowmap will be created in depth_stencil layout, but our render loop expects it to begin in shader_resource layout.
     CommandBuffer& cmd = Device::ptr->GetCommandBuffer();
-    cmd.ImageBarrier(m_shadowMap, Usage::DEPTH_STENCIL, Usage::SHADER_RESOURCE, 0, 1, 0, -1);
+    cmd.ImageBarrier(m_shadowMap, Usage::DEPTH_STENCIL, Usage::SHADER_RESOURCE);
+    cmd.ImageBarrier(m_staticMap, Usage::DEPTH_STENCIL, Usage::TRANSFER_SRC);
     Device::ptr->FlushCommandBuffer(cmd);
 
     m_shadowBindingsLayout = rm->CreateBindGroupLayout({
         .debugName = "Shadow bindgroup layout",
-        .bindings  = { {.type = Binding::Type::TEXTURE, .stages = ShaderStage::FRAGMENT } }
+        .bindings  = {
+            {.type = Binding::Type::TEXTURE, .stages = ShaderStage::FRAGMENT | ShaderStage::COMPUTE },
+            {.type = Binding::Type::TEXTURE, .stages = ShaderStage::FRAGMENT | ShaderStage::COMPUTE }
+        }
     });
 
     m_shadowBindings = rm->CreateBindGroup({
         .debugName = "Shadowmap bindgroup",
         .layout    = m_shadowBindingsLayout,
-        .textures  = { {0, m_shadowMap } }
+        .textures  = { {0, m_shadowMap }, {1, m_moments } }
+    });
+
+    m_evsmLayout = rm->CreateBindGroupLayout({
+        .debugName = "EVSM bindgroup layout",
+        .bindings  = {
+            {.type = Binding::Type::TEXTURE,         .stages = ShaderStage::COMPUTE },
+            {.type = Binding::Type::STORAGE_TEXTURE, .stages = ShaderStage::COMPUTE },
+            {.type = Binding::Type::STORAGE_TEXTURE, .stages = ShaderStage::COMPUTE }
+        }
+    });
+
+    m_evsmBindings = rm->CreateBindGroup({
+        .debugName = "EVSM bindgroup",
+        .layout    = m_evsmLayout,
+        .textures  = { {0, m_shadowMap }, {1, m_momentsBlur }, {2, m_moments } }
+    });
+
+    std::vector<u32> evsmShader = ReadShaderSpv("Shaders/evsm.comp.spv");
+
+    m_evsmPipeline = rm->CreatePipeline({
+        .debugName = "EVSM filter pipeline",
+        .shaderDescs = { {.spirv = evsmShader, .stage = ShaderStage::COMPUTE } },
+        .bindgroupLayouts = { m_evsmLayout }
     });
 
     m_cascadeBindingsLayout = rm->CreateBindGroupLayout({
@@ -53,14 +165,56 @@ CascadedShadowMap::CascadedShadowMap(u32 resolution, Camera* camera, span<const
             .layout    = m_cascadeBindingsLayout,
             .buffers   = { {.binding = 0, .buffer = m_cascadeUBO[i], .size = sizeof(glm::mat4) } }
         });
+
+        m_layeredBindings[i] = rm->CreateBindGroup({
+            .debugName = "Layered cascade bindgroup",
+            .layout    = m_cascadeBindingsLayout,
+            .buffers   = { {.binding = 0, .buffer = m_cascadeUBO[i], .size = 256 * MaxCascades } }
+        });
+    }
+
+    m_reduceLayout = rm->CreateBindGroupLayout({
+        .debugName = "Depth reduction bindgroup layout",
+        .bindings  = {
+            {.type = Binding::Type::TEXTURE,        .stages = ShaderStage::COMPUTE },
+            {.type = Binding::Type::STORAGE_BUFFER, .stages = ShaderStage::COMPUTE }
+        }
+    });
+
+    // NOTE: the reduction result is written by the GPU and read on the CPU, so it lives in host visible readback memory.
+    // It is only 8 bytes per frame.
+    const u32 reset[2] = { ~0u, 0u };
+    for (u32 i = 0; i < Device::MaxFramesInFlight; i++) {
+        m_reduceBuffers[i] = rm->CreateBuffer({
+            .debugName = "Depth reduction buffer",
+            .byteSize  = sizeof(reset),
+            .usage     = Usage::UNORDERED_ACCESS,
+            .memory    = Memory::Readback
+        });
+        rm->WriteBuffer(m_reduceBuffers[i], reset, sizeof(reset), 0);
+
+        m_reduceBindings[i] = rm->CreateBindGroup({
+            .debugName = "Depth reduction bindgroup",
+            .layout    = m_reduceLayout,
+            .textures  = { {0, depth} },
+            .buffers   = { {.binding = 1, .buffer = m_reduceBuffers[i], .size = sizeof(reset) } }
+        });
     }
 
+    std::vector<u32> reduceShader = ReadShaderSpv("Shaders/depthReduce.comp.spv");
+
+    m_reducePipeline = rm->CreatePipeline({
+        .debugName = "Depth reduction pipeline",
+        .shaderDescs = { {.spirv = reduceShader, .stage = ShaderStage::COMPUTE } },
+        .bindgroupLayouts = { m_reduceLayout }
+    });
+
     std::vector<u32> vertShader = ReadShaderSpv("Shaders/shadowMap.vert.spv");
 
     m_pipeline = rm->CreatePipeline({
         .debugName = "Cascaded shadow map render pipeline",
         .shaderDescs = { {.spirv = vertShader, .stage = ShaderStage::VERTEX } },
-        .bindgroupLayouts = { m_cascadeBindingsLayout },
+        .bindgroupLayouts = { m_cascadeBindingsLayout, drawLayout },
         .graphicsState = {
             .depthStencilState = {.depthStencilFormat = Format::D32_SFLOAT },
             .rasterizationState = {
@@ -68,10 +222,25 @@ CascadedShadowMap::CascadedShadowMap(u32 resolution, Camera* camera, span<const
                 .depthBiasEnable = true,
                 .cullMode = CullMode::Back
             },
-            .vertexInputState = {
-                .vertexStride = sizeof(GLTFModel::Vertex),
-                .attributes = { {.format = Format::RGB32_SFLOAT } }
-            }
+            .vertexInputState = GLTFModel::Vertex::PositionInputState
+        }
+    });
+
+    std::vector<u32> layeredVertShader = ReadShaderSpv("Shaders/shadowMapLayered.vert.spv");
+
+    m_layeredPipeline = rm->CreatePipeline({
+        .debugName = "Cascaded shadow map layered render pipeline",
+        .shaderDescs = { {.spirv = layeredVertShader, .stage = ShaderStage::VERTEX } },
+        .bindgroupLayouts = { m_cascadeBindingsLayout, drawLayout },
+        .graphicsState = {
+            .depthStencilState = {.depthStencilFormat = Format::D32_SFLOAT },
+            .rasterizationState = {
+                .depthClampEnable = true,
+                .depthBiasEnable = true,
+                .cullMode = CullMode::Back
+            },
+            .vertexInputState = GLTFModel::Vertex::PositionInputState,
+            .viewportCount = MaxCascades
         }
     });
 }
@@ -80,6 +249,15 @@ CascadedShadowMap::~CascadedShadowMap() {
     ResourceManager* rm = ResourceManager::ptr;
 
     rm->DestroyPipeline(m_pipeline);
+    rm->DestroyPipeline(m_layeredPipeline);
+    rm->DestroyPipeline(m_reducePipeline);
+    rm->DestroyPipeline(m_evsmPipeline);
+    rm->DestroyBindGroupLayout(m_evsmLayout);
+
+    for (Handle<Buffer> buffer : m_reduceBuffers)
+        rm->DestroyBuffer(buffer);
+
+    rm->DestroyBindGroupLayout(m_reduceLayout);
 
     for (Handle<Buffer> buffer : m_cascadeUBO)
         rm->DestroyBuffer(buffer);
@@ -87,9 +265,173 @@ CascadedShadowMap::~CascadedShadowMap() {
     rm->DestroyBindGroupLayout(m_cascadeBindingsLayout);
     rm->DestroyBindGroupLayout(m_shadowBindingsLayout);
     rm->DestroyTexture(m_shadowMap);
+    rm->DestroyTexture(m_staticMap);
+    DestroyMoments();
 }
 
-void CascadedShadowMap::UpdateCascadeUBO(glm::vec3 lightDir) {
+void CascadedShadowMap::CreateMoments() {
+    ResourceManager* rm = ResourceManager::ptr;
+
+    // EVSM moments of the atlas at half resolution, and the intermediate result of the separable blur. Without EVSM they
+    // are never read, but the bindgroups still need a texture, so a single texel is allocated instead.
+    const u32 size = settings.evsm ? m_atlasSize / 2 : 1;
+
+    m_moments = rm->CreateTexture({
+        .debugName = "EVSM moments atlas",
+        .width     = size, .height = size,
+        .format    = Format::RG32_SFLOAT,
+        .usage     = Usage::SHADER_RESOURCE | Usage::UNORDERED_ACCESS
+    });
+
+    m_momentsBlur = rm->CreateTexture({
+        .debugName = "EVSM moments blur",
+        .width     = size, .height = size,
+        .format    = Format::RG32_SFLOAT,
+        .usage     = Usage::UNORDERED_ACCESS
+    });
+
+    // The render loop expects the moments to begin in shader_resource layout.
+    CommandBuffer& cmd = Device::ptr->GetCommandBuffer();
+    cmd.ImageBarrier(m_moments, Usage::UNORDERED_ACCESS, Usage::SHADER_RESOURCE);
+    Device::ptr->FlushCommandBuffer(cmd);
+
+    m_momentsAllocated = settings.evsm;
+    for (u32 k = 0; k < MaxCascades; k++)
+        m_momentsValid[k] = false;
+}
+
+void CascadedShadowMap::DestroyMoments() {
+    ResourceManager* rm = ResourceManager::ptr;
+    rm->DestroyTexture(m_moments);
+    rm->DestroyTexture(m_momentsBlur);
+}
+
+void CascadedShadowMap::UpdateMoments() {
+    if (m_momentsAllocated == settings.evsm) return;
+
+    DestroyMoments();
+    CreateMoments();
+
+    ResourceManager* rm = ResourceManager::ptr;
+    rm->UpdateBindGroupTextures(m_shadowBindings, { {0, m_shadowMap }, {1, m_moments } });
+    rm->UpdateBindGroupTextures(m_evsmBindings, { {0, m_shadowMap }, {1, m_momentsBlur }, {2, m_moments } });
+}
+
+bool CascadedShadowMap::SetCascades(span<const CascadeDesc> cascades) {
+    Check(cascades.size() >= 1 && cascades.size() <= MaxCascades, "Between 1 and %u cascades must be specified", MaxCascades);
+
+    u32 resolutions[MaxCascades];
+    Rect2D tiles[MaxCascades];
+    for (u32 k = 0; k < cascades.size(); k++)
+        resolutions[k] = cascades[k].resolution;
+
+    if (!PackAtlas(m_atlasSize, span<const u32>(resolutions, cascades.size()), tiles))
+        return false;
+
+    m_cascadeCount = (u32)cascades.size();
+    for (u32 k = 0; k < m_cascadeCount; k++) {
+        m_distances[k]   = cascades[k].distances;
+        m_resolutions[k] = cascades[k].resolution;
+        m_tiles[k]       = tiles[k];
+
+        // Every tile has to be rendered again with the new layout.
+        m_valid[k] = false;
+        m_dirty[k] = false;
+        m_staticValid[k] = false;
+        m_momentsValid[k] = false;
+    }
+
+    InitCascades(span<const glm::vec2>(m_distances, m_cascadeCount));
+
+    // Offsets for shadow samples, in atlas texture coordinates. They are the same number of texels for every cascade.
+    float d = 3.0f / (16.0f * m_atlasSize);
+    m_shadowData.shadowOffsets[0] = glm::vec4(glm::vec2(-d, -3 * d), glm::vec2(3 * d, -d));
+    m_shadowData.shadowOffsets[1] = glm::vec4(glm::vec2(d, 3 * d), glm::vec2(-3 * d, d));
+    m_shadowData.cascadeCount = m_cascadeCount;
+    m_shadowData.texelSize = 1.0f / m_atlasSize;
+
+    return true;
+}
+
+void CascadedShadowMap::SetCascadeCount(u32 count) {
+    Check(count >= 1 && count <= MaxCascades, "Between 1 and %u cascades must be specified", MaxCascades);
+
+    CascadeDesc cascades[MaxCascades];
+
+    // Keep the current far distance. The first cascade always starts at the camera.
+    glm::vec2 distances[MaxCascades];
+    SplitCascades(0.5f, m_distances[m_cascadeCount - 1].y, 0.8f, count, distances);
+    distances[0].x = 0.0f;
+
+    // Start every cascade at a quarter of the atlas, and halve the farthest of the largest tiles until they all fit.
+    for (u32 k = 0; k < count; k++)
+        cascades[k] = { .distances = distances[k], .resolution = m_atlasSize / 2 };
+
+    while (!SetCascades(span<const CascadeDesc>(cascades, count))) {
+        u32 largest = 0;
+        for (u32 k = 0; k < count; k++) {
+            if (cascades[k].resolution >= cascades[largest].resolution) largest = k;
+        }
+
+        Check(cascades[largest].resolution > 1, "Failed to fit %u cascades in the shadow atlas", count);
+        cascades[largest].resolution /= 2;
+    }
+}
+
+void CascadedShadowMap::SetDepthBuffer(Handle<Texture> depth) {
+    for (Handle<BindGroup> bindgroup : m_reduceBindings)
+        ResourceManager::ptr->UpdateBindGroupTextures(bindgroup, { {0, depth} });
+}
+
+void CascadedShadowMap::ReduceDepth(CommandBuffer& cmd, u32 width, u32 height) {
+    if (!settings.sdsm) return;
+
+    const Handle<Buffer> buffer = m_reduceBuffers[Device::ptr->FrameIdx()];
+
+    cmd.SetPipeline(m_reducePipeline);
+    cmd.SetBindGroup(m_reduceBindings[Device::ptr->FrameIdx()], 0);
+    cmd.Dispatch((width + 15) / 16, (height + 15) / 16, 1);
+
+    // Make the result visible to the host once the frame has finished.
+    cmd.BufferBarrier(buffer, Usage::UNORDERED_ACCESS, Usage::USAGE_NONE);
+}
+
+void CascadedShadowMap::FitCascadesToDepth() {
+    ResourceManager* rm = ResourceManager::ptr;
+    const Handle<Buffer> buffer = m_reduceBuffers[Device::ptr->FrameIdx()];
+
+    // The buffer of this frame index was last written MaxFramesInFlight frames ago, and BeginFrame has waited for that frame.
+    // Depths are positive floats, so they were reduced as uints. The buffer is reset for this frame's reduction right after reading.
+    u32 result[2];
+    rm->ReadBuffer(buffer, result, sizeof(result));
+
+    const u32 reset[2] = { ~0u, 0u };
+    rm->WriteBuffer(buffer, reset, sizeof(reset), 0);
+
+    glm::vec2 distances[MaxCascades];
+    for (u32 k = 0; k < m_cascadeCount; k++)
+        distances[k] = m_distances[k];
+
+    // Nothing but sky was visible (or nothing has been reduced yet). Fall back to the fixed distances.
+    if (settings.sdsm && result[0] <= result[1]) {
+        float minDepth, maxDepth;
+        memcpy(&minDepth, &result[0], sizeof(float));
+        memcpy(&maxDepth, &result[1], sizeof(float));
+
+        // Reversed-z infinite projection: depth = P[2][2] + P[3][2] / z, so the nearest point has the largest depth.
+        const glm::mat4& P = m_camera->projection;
+        const float n = P[3][2] / (maxDepth - P[2][2]);
+        const float f = glm::max(P[3][2] / (minDepth - P[2][2]), n * 1.01f);
+
+        SplitCascades(n, f, settings.sdsmLambda, m_cascadeCount, distances);
+    }
+
+    InitCascades(span<const glm::vec2>(distances, m_cascadeCount));
+}
+
+void CascadedShadowMap::UpdateCascadeUBO(glm::vec3 lightDir, span<GLTFModel* const> models) {
+    FitCascadesToDepth();
+
     // Calculate light matrix from light direction. (This breaks when x,z are zero)
     const glm::vec3 z = -glm::normalize(lightDir);
     const glm::vec3 x = glm::normalize(glm::cross(glm::vec3(0.0f, 1.0f, 0.0f), z));
@@ -99,7 +441,42 @@ void CascadedShadowMap::UpdateCascadeUBO(glm::vec3 lightDir) {
     // Camera space to light space matrix
     const glm::mat4 L = glm::inverse(light) * glm::inverse(m_camera->view);
 
-    for (int k = 0; k < MaxCascades; k++) {
+    // Light-space bounds of the receivers visible to the camera in each cascade. Casters only have to be drawn into a cascade
+    // if their shadow can land on one of them: if they overlap the receivers in x/y, and are not entirely below them.
+    constexpr float inf = std::numeric_limits<float>::infinity();
+    glm::vec3 receiverMin[MaxCascades], receiverMax[MaxCascades];
+    for (u32 k = 0; k < m_cascadeCount; k++) {
+        receiverMin[k] = glm::vec3( inf);
+        receiverMax[k] = glm::vec3(-inf);
+    }
+
+    if (settings.receiverCulling) {
+        m_receivers.clear();
+        for (const GLTFModel* model : models)
+            model->GetVisibleBounds(0, m_receivers);
+
+        const glm::mat3 worldToLight    = glm::transpose(glm::mat3(light));
+        const glm::mat3 absWorldToLight = glm::mat3(glm::abs(worldToLight[0]), glm::abs(worldToLight[1]), glm::abs(worldToLight[2]));
+        const glm::vec3 viewZ           = glm::vec3(m_camera->view[0][2], m_camera->view[1][2], m_camera->view[2][2]);
+
+        for (const AABB& box : m_receivers) {
+            const glm::vec3 center = worldToLight * box.center;
+            const glm::vec3 extent = absWorldToLight * box.extent;
+
+            // View space depth range of the receiver, used to find the cascades it is shaded with.
+            const float z  = glm::dot(viewZ, box.center) + m_camera->view[3][2];
+            const float dz = glm::dot(glm::abs(viewZ), box.extent);
+
+            for (u32 k = 0; k < m_cascadeCount; k++) {
+                if (z + dz < m_cascades[k].a || z - dz > m_cascades[k].b) continue;
+
+                receiverMin[k] = glm::min(receiverMin[k], center - extent);
+                receiverMax[k] = glm::max(receiverMax[k], center + extent);
+            }
+        }
+    }
+
+    for (u32 k = 0; k < m_cascadeCount; k++) {
         // Transform cascade frustum points from camera view space to light space
         const glm::vec4 Lv[8] = {
             L * glm::vec4(m_cascades[k].v0, 1.0f),
@@ -130,8 +507,14 @@ void CascadedShadowMap::UpdateCascadeUBO(glm::vec3 lightDir) {
             m_cascades[k].zmax = glm::max(m_cascades[k].zmax, Lvi.z);
         }
 
+        // Snap the depth range outward to a coarse grid. The x/y origin is already snapped below, but the exact depth range
+        // changes whenever the camera moves, which would force every cascade to be re-rendered even when caching is enabled.
+        const float Q = m_cascades[k].d * 0.125f;
+        m_cascades[k].zmin = glm::floor(m_cascades[k].zmin / Q) * Q;
+        m_cascades[k].zmax = glm::ceil(m_cascades[k].zmax / Q) * Q;
+
         // Calculate the physical size of shadow map texels
-        const float T = m_cascades[k].d / m_resolution;
+        const float T = m_cascades[k].d / m_resolutions[k];
 
         // Shadow edges are stable if the viewport coordinates of each vertex belonging to an object rendered into the shadow map
         // have *constant fractional parts*. (Triangle are rasterized identically if moved by an integral number of texels).
@@ -140,7 +523,7 @@ void CascadedShadowMap::UpdateCascadeUBO(glm::vec3 lightDir) {
         // we thus require that the light-space x and y coordinates of the camera position always are integral multiples of T.
         //	
         //	Note: For this calculation to be completely effective, T must be exactly representable as a floating point number.
-        //        We thus have to make sure that n is always a power of 2. This is also why take the ceiling of d.
+        //        We thus have to make sure that the resolution is always a power of 2. This is also why take the ceiling of d.
 
         // Calculate light-space coordinates of the camera position we will be rendering the shadow map cascade from.
         const glm::vec3 s = glm::vec3(glm::floor((m_cascades[k].xmax + m_cascades[k].xmin) / (T * 2.0f)) * T,
@@ -155,6 +538,10 @@ void CascadedShadowMap::UpdateCascadeUBO(glm::vec3 lightDir) {
         const glm::mat4 lightT = glm::transpose(light);
         m_cascades[k].world_to_cascade = glm::mat4(lightT[0], lightT[1], lightT[2], glm::vec4(-s, 1.0f));
 
+        // Without receiver culling, the receivers are unbounded, so that no caster inside the cascade is culled.
+        m_cascades[k].receiverMin = settings.receiverCulling ? receiverMin[k] - s : glm::vec3(-inf);
+        m_cascades[k].receiverMax = settings.receiverCulling ? receiverMax[k] - s : glm::vec3( inf);
+
         // Calculate the cascade projection matrix
         const float d  = m_cascades[k].d;
         const float zd = m_cascades[k].zmax - m_cascades[k].zmin;
@@ -168,83 +555,332 @@ void CascadedShadowMap::UpdateCascadeUBO(glm::vec3 lightDir) {
         // Full MVP matrix is then cascade.viewProj * M_object
         m_cascades[k].world_to_proj = m_cascades[k].cascade_to_proj * m_cascades[k].world_to_cascade;
 
+        // The cached layer is out of date if the projection changed (camera moved by a texel or more, or the light direction
+        // changed), or if any caster moved inside the cascade. Both the old and new bounds of moved draws are tested, so
+        // casters leaving the cascade are removed from it as well.
+        bool changed = !m_valid[k] || m_rendered[k].world_to_proj != m_cascades[k].world_to_proj;
+        if (!changed) {
+            const Frustum frustum = Frustum::FromMatrix(m_rendered[k].world_to_proj, Frustum::ALL & ~Frustum::ZMAX);
+            for (const GLTFModel* model : models) {
+                for (const AABB& box : model->GetMovedBounds()) {
+                    if (FrustumTest(frustum, box)) { changed = true; break; }
+                }
+                if (changed) break;
+            }
+        }
+
+        // Receivers outside those the tile was rendered for may be missing shadows from casters that were culled.
+        if (!changed) {
+            changed = glm::any(glm::lessThan(m_cascades[k].receiverMin, m_rendered[k].receiverMin))
+                   || glm::any(glm::greaterThan(m_cascades[k].receiverMax, m_rendered[k].receiverMax));
+        }
+
+        // Static casters that moved inside the cascade invalidate its static tile, which holds the casters seen
+        // through the projection the tile was rendered with.
+        if (m_staticValid[k] && !m_staticDirty[k]) {
+            const Frustum frustum = Frustum::FromMatrix(m_staticProj[k], Frustum::ALL & ~Frustum::ZMAX);
+            for (const GLTFModel* model : models) {
+                for (const AABB& box : model->GetMovedStaticBounds()) {
+                    if (FrustumTest(frustum, box)) { m_staticDirty[k] = true; break; }
+                }
+                if (m_staticDirty[k]) break;
+            }
+        }
+
+        m_dirty[k] |= changed || m_staticDirty[k] || !settings.caching;
+
+        // With time slicing, dirty cascades wait for their next update slot. Slots are staggered so the cascades
+        // sharing an interval are not all updated on the same frame.
+        const u32 interval = glm::max(settings.updateIntervals[k], 1u);
+        const bool due = !settings.timeSlicing || (m_frame + k) % interval == 0;
+
+        m_render[k] = m_dirty[k] && (due || !m_valid[k]);
+        if (m_render[k]) {
+            m_rendered[k] = m_cascades[k];
+            m_valid[k] = true;
+            m_dirty[k] = false;
+        }
+
         // Update cascade ubo
         // TODO: 256 is the max possible minUniformBufferOffsetAlignment. Use device.properties.minUniformBufferOffsetAlignment instead.
-        ResourceManager::ptr->WriteBuffer(m_cascadeUBO[Device::ptr->FrameIdx()], &m_cascades[k].world_to_proj, sizeof(glm::mat4), k * 256);
+        ResourceManager::ptr->WriteBuffer(m_cascadeUBO[Device::ptr->FrameIdx()], &m_rendered[k].world_to_proj, sizeof(glm::mat4), k * 256);
     }
 
-    // Calculate world to shadow map texture coordinates texture.
-    const float d0  = m_cascades[0].d;
-    const float zd0 = m_cascades[0].zmax - m_cascades[0].zmin;
-    const glm::mat4 shadowProj = glm::mat4(
-        1.0f / d0, 0.0f,      0.0f,       0.0f,
-        0.0f,      1.0f / d0, 0.0f,       0.0f,
-        0.0f,      0.0f,      1.0f / zd0, 0.0f,
-        0.5f,      0.5f,      0.0f,       1.0f
-    );
+    m_frame++;
+
+    // Calculate world to atlas texture coordinates for each cascade. The cascade's [-d/2, d/2] light-space extent maps to its tile,
+    // and [zmin, zmax] to [0, 1] depth.
+    // NOTE: shadow lookups must use the cascades the tiles were rendered with, which may be older than this frame's cascades.
+    for (u32 k = 0; k < m_cascadeCount; k++) {
+        const Cascade& cascade = m_rendered[k];
+
+        const float scale   = (float)m_tiles[k].extent.width / m_atlasSize;
+        const glm::vec2 min = glm::vec2(m_tiles[k].offset.x, m_tiles[k].offset.y) / (float)m_atlasSize;
+        const glm::vec2 max = min + scale;
+
+        const float d  = cascade.d;
+        const float zd = cascade.zmax - cascade.zmin;
+        const glm::mat4 shadowProj = glm::mat4(
+            scale / d,            0.0f,                 0.0f,      0.0f,
+            0.0f,                 scale / d,            0.0f,      0.0f,
+            0.0f,                 0.0f,                 1.0f / zd, 0.0f,
+            min.x + 0.5f * scale, min.y + 0.5f * scale, 0.0f,      1.0f
+        );
+
+        // Lookups are clamped to the tile, so PCF taps never read a neighbouring cascade.
+        const float halfTexel = 0.5f / m_atlasSize;
+
+        m_shadowData.cascades[k] = {
+            .worldToShadow = shadowProj * cascade.world_to_cascade,
+            .atlasRect     = glm::vec4(min + halfTexel, max - halfTexel),
+            .range         = glm::vec4(cascade.a, cascade.b, 0.0f, 0.0f)
+        };
+    }
 
-    m_shadowData.shadowMat = shadowProj * m_cascades[0].world_to_cascade;
+    m_shadowData.evsm = glm::vec4(settings.evsmExponent, settings.evsmBleedReduction, 0.0001f, 0.0f);
+}
 
-    // We only calculate the shadow matrix for cascade 0.
-    // To convert the texture coordinates between cascades, we just use some scales and offsets.
-    for (int k = 1; k < MaxCascades; k++) {
-        const float dk  = m_cascades[k].d;
-        const float zdk = m_cascades[k].zmax - m_cascades[k].zmin;
+void CascadedShadowMap::Render(CommandBuffer& cmd, span<GLTFModel* const> models) {
+    bool renderAny = false;
+    for (u32 cascade = 0; cascade < m_cascadeCount; cascade++) {
+        m_stats[cascade] = { .cached = !m_render[cascade] };
+        renderAny |= m_render[cascade];
 
-        const glm::vec3 s0 = -m_cascades[0].world_to_cascade[3];
-        const glm::vec3 sk = -m_cascades[k].world_to_cascade[3];
+        if (m_render[cascade]) {
+            for (const GLTFModel* model : models)
+                m_stats[cascade].tested += model->DrawCount();
+        }
+    }
 
-        m_shadowData.cascadeScales[k - 1] = glm::vec4(d0 / dk, d0 / dk, zd0 / zdk, 0.0f);
+    if (renderAny)
+        RenderTiles(cmd, models);
 
-        m_shadowData.cascadeOffsets[k - 1].x = (s0.x - sk.x) / dk - d0 / (2.0f * dk) + 0.5f;
-        m_shadowData.cascadeOffsets[k - 1].y = (s0.y - sk.y) / dk - d0 / (2.0f * dk) + 0.5f;
-        m_shadowData.cascadeOffsets[k - 1].z = (s0.z - sk.z) / zdk;
+    // Tiles re-rendered without EVSM leave their moments out of date.
+    if (settings.evsm) {
+        FilterMoments(cmd);
+    }
+    else {
+        for (u32 cascade = 0; cascade < m_cascadeCount; cascade++)
+            m_momentsValid[cascade] = m_momentsValid[cascade] && !m_render[cascade];
     }
 }
 
-void CascadedShadowMap::Render(CommandBuffer& cmd, span<const GLTFModel* const> models) {
-    cmd.ImageBarrier(m_shadowMap, Usage::SHADER_RESOURCE, Usage::DEPTH_STENCIL, 0, 1, 0, -1);
+void CascadedShadowMap::RenderTiles(CommandBuffer& cmd, span<GLTFModel* const> models) {
+    // The whole atlas is the attachment, so it is transitioned as a whole. The transition keeps the contents of the
+    // cached tiles, and the pass loads them instead of clearing.
+    if (settings.staticCaching) {
+        RenderStatic(cmd, models);
+
+        // Re-rendered tiles start out as a copy of their static casters, instead of being cleared.
+        Rect2D tiles[MaxCascades];
+        u32 tileCount = 0;
+        for (u32 cascade = 0; cascade < m_cascadeCount; cascade++) {
+            if (m_render[cascade]) tiles[tileCount++] = m_tiles[cascade];
+        }
+
+        cmd.ImageBarrier(m_shadowMap, Usage::SHADER_RESOURCE, Usage::TRANSFER_DST);
+        cmd.CopyTexture(m_staticMap, m_shadowMap, span<const Rect2D>(tiles, tileCount));
+        cmd.ImageBarrier(m_shadowMap, Usage::TRANSFER_DST, Usage::DEPTH_STENCIL);
+
+        cmd.BeginRendering(m_shadowMap, 0, m_atlasSize, m_atlasSize, false);
+        DrawCasters(cmd, models, m_render, GLTFModel::DrawFilter::DYNAMIC, 1);
+    }
+    else {
+        cmd.ImageBarrier(m_shadowMap, Usage::SHADER_RESOURCE, Usage::DEPTH_STENCIL);
+        cmd.BeginRendering(m_shadowMap, 0, m_atlasSize, m_atlasSize, false);
 
-    cmd.SetViewport((float)m_resolution, (float)m_resolution);
-    cmd.SetScissor({ .offset = {0, 0}, .extent = {m_resolution, m_resolution} });
+        for (u32 cascade = 0; cascade < m_cascadeCount; cascade++) {
+            if (m_render[cascade])
+                cmd.ClearDepth(m_tiles[cascade]);
+        }
+
+        DrawCasters(cmd, models, m_render, GLTFModel::DrawFilter::ALL, 1);
+    }
+
+    cmd.EndRendering();
+
+    cmd.ImageBarrier(m_shadowMap, Usage::DEPTH_STENCIL, Usage::SHADER_RESOURCE);
+}
+
+void CascadedShadowMap::FilterMoments(CommandBuffer& cmd) {
+    bool filter[MaxCascades] = {};
+    bool filterAny = false;
+    for (u32 cascade = 0; cascade < m_cascadeCount; cascade++) {
+        filter[cascade] = m_render[cascade] || !m_momentsValid[cascade];
+        filterAny |= filter[cascade];
+    }
+
+    if (!filterAny) return;
+
+    struct {
+        i32   tileOffset[2];
+        i32   tileSize[2];
+        u32   pass;
+        i32   radius;
+        float exponent;
+    } pc = {
+        .radius   = (i32)settings.evsmBlurRadius,
+        .exponent = settings.evsmExponent
+    };
+
+    cmd.ImageBarrier(m_moments, Usage::SHADER_RESOURCE, Usage::UNORDERED_ACCESS);
+
+    cmd.SetPipeline(m_evsmPipeline);
+    cmd.SetBindGroup(m_evsmBindings, 0);
+
+    // Both blur passes are dispatched per tile, as taps are clamped to the tile.
+    for (pc.pass = 0; pc.pass < 2; pc.pass++) {
+        for (u32 cascade = 0; cascade < m_cascadeCount; cascade++) {
+            if (!filter[cascade]) continue;
+
+            const Rect2D& tile = m_tiles[cascade];
+            pc.tileOffset[0] = tile.offset.x / 2;
+            pc.tileOffset[1] = tile.offset.y / 2;
+            pc.tileSize[0]   = (i32)tile.extent.width / 2;
+            pc.tileSize[1]   = (i32)tile.extent.height / 2;
+
+            cmd.PushConstants(&pc, 0, sizeof(pc), ShaderStage::COMPUTE);
+            cmd.Dispatch((pc.tileSize[0] + 7) / 8, (pc.tileSize[1] + 7) / 8, 1);
+        }
+
+        if (pc.pass == 0)
+            cmd.ImageBarrier(m_momentsBlur, Usage::UNORDERED_ACCESS, Usage::UNORDERED_ACCESS);
+    }
+
+    cmd.ImageBarrier(m_moments, Usage::UNORDERED_ACCESS, Usage::SHADER_RESOURCE);
+
+    for (u32 cascade = 0; cascade < m_cascadeCount; cascade++)
+        m_momentsValid[cascade] = true;
+}
+
+void CascadedShadowMap::RenderStatic(CommandBuffer& cmd, span<GLTFModel* const> models) {
+    // A static tile only has to be re-rendered if the cascade is rendered with a new projection, or a static caster in it moved.
+    bool refresh[MaxCascades] = {};
+    bool refreshAny = false;
+
+    for (u32 cascade = 0; cascade < m_cascadeCount; cascade++) {
+        if (!m_render[cascade]) continue;
+
+        refresh[cascade] = !m_staticValid[cascade] || m_staticDirty[cascade] || m_staticProj[cascade] != m_rendered[cascade].world_to_proj;
+        refreshAny |= refresh[cascade];
+
+        if (refresh[cascade]) {
+            m_staticProj[cascade]  = m_rendered[cascade].world_to_proj;
+            m_staticValid[cascade] = true;
+            m_staticDirty[cascade] = false;
+        }
+    }
+
+    if (!refreshAny) return;
+
+    // The static atlas is kept in transfer_src layout between frames, ready to be copied from.
+    cmd.ImageBarrier(m_staticMap, Usage::TRANSFER_SRC, Usage::DEPTH_STENCIL);
+    cmd.BeginRendering(m_staticMap, 0, m_atlasSize, m_atlasSize, false);
+
+    for (u32 cascade = 0; cascade < m_cascadeCount; cascade++) {
+        if (refresh[cascade])
+            cmd.ClearDepth(m_tiles[cascade]);
+    }
+
+    // The static pass is culled into its own views, as the dynamic pass of the same frame uses views 1 to MaxCascades.
+    DrawCasters(cmd, models, refresh, GLTFModel::DrawFilter::STATIC, 1 + MaxCascades);
+
+    cmd.EndRendering();
+    cmd.ImageBarrier(m_staticMap, Usage::DEPTH_STENCIL, Usage::TRANSFER_SRC);
+}
+
+void CascadedShadowMap::DrawCasters(CommandBuffer& cmd, span<GLTFModel* const> models, const bool* cascades, GLTFModel::DrawFilter filter, u32 firstView) {
+    if (settings.singlePass) {
+        DrawCastersLayered(cmd, models, cascades, filter, firstView);
+        return;
+    }
 
     cmd.SetPipeline(m_pipeline);
 
-    for (u32 cascade = 0; cascade < MaxCascades; cascade++) {
+    for (u32 cascade = 0; cascade < m_cascadeCount; cascade++) {
+        if (!cascades[cascade]) continue;
+
+        cmd.SetViewports({ m_tiles[cascade] });
+
         u32 dynamicOffset = cascade * 256; // TODO: again, this should be taken from device
         cmd.SetBindGroup(m_cascadeBindings[Device::ptr->FrameIdx()], 0, {dynamicOffset});
 
-        cmd.BeginRendering(m_shadowMap, cascade, m_resolution, m_resolution);
+        // Cull casters against the light-space box of the cascade, extended toward the light. The static tiles outlive the
+        // receivers visible this frame, so static casters are not culled against them.
+        const Frustum frustum = CasterFrustum(cascade, filter != GLTFModel::DrawFilter::STATIC);
+
+        for (GLTFModel* model : models)
+            m_stats[cascade].drawn += model->Cull(firstView + cascade, frustum, filter);
 
         for (const GLTFModel* model : models)
-            model->Draw(cmd, true);
+            model->Draw(cmd, firstView + cascade, true);
+    }
+}
+
+// Every caster is drawn once, instanced over the cascades it is visible in. The vertex shader routes each instance to the
+// viewport of its cascade's tile with SV_ViewportArrayIndex.
+void CascadedShadowMap::DrawCastersLayered(CommandBuffer& cmd, span<GLTFModel* const> models, const bool* cascades, GLTFModel::DrawFilter filter, u32 view) {
+    u32 renderMask = 0;
+    Frustum frustums[MaxCascades];
+    u32 drawn[MaxCascades] = {};
+
+    for (u32 cascade = 0; cascade < m_cascadeCount; cascade++) {
+        if (!cascades[cascade]) continue;
+
+        renderMask |= 1u << cascade;
+        frustums[cascade] = CasterFrustum(cascade, filter != GLTFModel::DrawFilter::STATIC);
+    }
+
+    for (GLTFModel* model : models)
+        model->CullLayered(view, span<const Frustum>(frustums, m_cascadeCount), renderMask, drawn, filter);
+
+    for (u32 cascade = 0; cascade < m_cascadeCount; cascade++)
+        m_stats[cascade].drawn += drawn[cascade];
 
-        cmd.EndRendering();
+    // The layered pipeline has MaxCascades viewports, all of which must be set. Unused ones repeat the first tile.
+    Rect2D viewports[MaxCascades];
+    for (u32 cascade = 0; cascade < MaxCascades; cascade++)
+        viewports[cascade] = m_tiles[cascade < m_cascadeCount ? cascade : 0];
+
+    cmd.SetViewports(viewports);
+
+    cmd.SetPipeline(m_layeredPipeline);
+    cmd.SetBindGroup(m_layeredBindings[Device::ptr->FrameIdx()], 0, { 0u });
+
+    for (const GLTFModel* model : models)
+        model->Draw(cmd, view, true);
+}
+
+Frustum CascadedShadowMap::CasterFrustum(u32 cascade, bool receivers) const {
+    const Cascade& c = m_rendered[cascade];
+
+    // Cascade space box of the cascade: [-d/2, d/2] in x/y, and [0, zmax - zmin] in z.
+    glm::vec3 min = glm::vec3(-0.5f * c.d, -0.5f * c.d, 0.0f);
+    glm::vec3 max = glm::vec3( 0.5f * c.d,  0.5f * c.d, c.zmax - c.zmin);
+
+    if (receivers) {
+        min = glm::max(min, c.receiverMin);
+        max = glm::min(max, c.receiverMax);
     }
 
-    cmd.ImageBarrier(m_shadowMap, Usage::DEPTH_STENCIL, Usage::SHADER_RESOURCE, 0, 1, 0, -1);
+    // Depth increases toward the light, so the box is only bounded by the receivers from below. Casters above them still cast onto them.
+    max.z = std::numeric_limits<float>::infinity();
+
+    return CascadeBoxFrustum(c.world_to_cascade, min, max);
 }
 
 void CascadedShadowMap::InitCascades(span<const glm::vec2> distances) {
-    Check(distances.size() == MaxCascades, "All %u cascade distances must be specified", MaxCascades);
-
-    // Offsets for shadow samples.
-    float d = 3.0f / (16.0f * m_resolution);
-    m_shadowData.shadowOffsets[0] = glm::vec4(glm::vec2(-d, -3 * d), glm::vec2(3 * d, -d));
-    m_shadowData.shadowOffsets[1] = glm::vec4(glm::vec2(d, 3 * d), glm::vec2(-3 * d, d));
+    Check(distances.size() == m_cascadeCount, "All %u cascade distances must be specified", m_cascadeCount);
 
     const float s = m_camera->aspect;
     const float g = 1.0f / glm::tan(glm::radians(m_camera->fov) * 0.5f);
 
-    for (int k = 0; k < MaxCascades; k++) {
+    for (u32 k = 0; k < m_cascadeCount; k++) {
         const float a = distances[k].x;
         const float b = distances[k].y;
 
-        // Save cascade distances; they are used in the shader for cascade transitions.
-        m_shadowData.a[k] = a;
-        m_shadowData.b[k] = b;
-
-        // Calculate the eight view-space frustum coordinates of the cascade
+        // Calculate the eight view-space frustum coordinates of the cascade. The distances are saved, as they are used in the
+        // shader for cascade transitions.
         m_cascades[k] = {
             .v0 = glm::vec3(a * s / g, -a / g, a),
             .v1 = glm::vec3(a * s / g,  a / g, a),
@@ -255,6 +891,8 @@ void CascadedShadowMap::InitCascades(span<const glm::vec2> distances) {
             .v5 = glm::vec3(b * s / g,  b / g, b),
             .v6 = glm::vec3(-b * s / g,  b / g, b),
             .v7 = glm::vec3(-b * s / g, -b / g, b),
+
+            .a = a, .b = b
         };
 
         // Calculate shadow map size (diameter of the cascade)
@@ -10,55 +10,199 @@
 
 class CascadedShadowMap {
 public:
-    static constexpr u32 MaxCascades = 4;
-    
-    CascadedShadowMap(u32 resolution, Camera* camera, span<const glm::vec2> distances);
+    static constexpr u32 MaxCascades = 8;
+
+    // View space depth range [distances.x, distances.y] of a cascade, and the resolution of its tile in the shadow atlas.
+    // Neighbouring cascades should overlap; the shader blends between them in the overlap. Resolutions must be powers of two.
+    struct CascadeDesc {
+        glm::vec2 distances;
+        u32       resolution;
+    };
+
+    // All cascades are packed into a single atlasSize x atlasSize depth texture.
+    // drawLayout is the per-draw data layout passed to the GLTFModels rendered into the shadow map.
+    // depth is the camera depth buffer, which is reduced to fit the cascades to the visible depth range when settings.sdsm is enabled.
+    CascadedShadowMap(u32 atlasSize, Camera* camera, Handle<BindGroupLayout> drawLayout, Handle<Texture> depth, span<const CascadeDesc> cascades);
     ~CascadedShadowMap();
 
-    void UpdateCascadeUBO(glm::vec3 lightDir);
-    void Render(CommandBuffer& cmd, span<const GLTFModel* const> models);
+    // Replace the cascades and repack the atlas. Returns false, leaving the current cascades untouched, if they don't fit in the atlas.
+    bool SetCascades(span<const CascadeDesc> cascades);
+
+    // Replace the cascades with count cascades covering the current distance range, at the highest resolutions that fit in the atlas.
+    void SetCascadeCount(u32 count);
+    u32  CascadeCount() const { return m_cascadeCount; }
+
+    // Must be called whenever the camera depth buffer is recreated.
+    void SetDepthBuffer(Handle<Texture> depth);
+
+    // Reduce the camera depth buffer to its min/max depth. The result is read back MaxFramesInFlight frames later by UpdateCascadeUBO.
+    // depth must be in shader_resource layout, and hold the depth of the current frame.
+    void ReduceDepth(CommandBuffer& cmd, u32 width, u32 height);
+
+    // Compute the cascades for the current camera and light, and decide which of them are re-rendered this frame.
+    // Must be called after the models have been updated, as caster movement is read from GLTFModel::GetMovedBounds, and after
+    // view 0 of each model has been culled against the camera, as the receivers are the draws visible in it.
+    void UpdateCascadeUBO(glm::vec3 lightDir, span<GLTFModel* const> models);
+    // Cull and render the models into every cascade selected by UpdateCascadeUBO. Cascade k uses view 1 + k of each model,
+    // or all cascades share view 1 when rendering in a single pass. Static casters use views 1 + MaxCascades and up the same way.
+    void Render(CommandBuffer& cmd, span<GLTFModel* const> models);
+
+    struct Settings {
+        // Render all cascades in one pass, submitting each caster once instanced over the cascades it is visible in.
+        bool singlePass = true;
+
+        // Only re-render a cascade if its projection changed or a caster inside it moved.
+        bool caching = true;
+
+        // Keep the depth of the static casters in a separate atlas, only re-rendered when a cascade's projection changes or a
+        // static caster moves. Re-rendered cascades then start from a copy of it, and only draw the dynamic casters on top.
+        bool staticCaching = true;
+
+        // Skip casters whose shadow cannot land on any receiver visible to the camera. Static casters are never culled this
+        // way, as the static tiles outlive the receivers they would be culled against.
+        bool receiverCulling = true;
+
+        // Spread cascade updates over several frames. Cascade k is updated at most every updateIntervals[k] frames.
+        bool timeSlicing = false;
+        u32  updateIntervals[MaxCascades] = { 1, 2, 3, 4, 4, 4, 4, 4 };
+
+        // Sample distribution shadow maps: split the cascades over the depth range that is actually visible, instead of
+        // the fixed distances. sdsmLambda blends between uniform (0) and logarithmic (1) splits.
+        bool  sdsm       = false;
+        float sdsmLambda = 0.8f;
+
+        // Exponential variance shadow maps: filter blurred moments of the shadow map with a single bilinear fetch, instead
+        // of comparison sampled PCF. The moments are blurred over evsmBlurRadius texels of the half resolution moment atlas.
+        // Only the positive warp is stored, as two 32 bit moments. The deferred pipeline is specialized on this setting, and
+        // must be recreated when it changes, along with the moment atlas (see UpdateMoments).
+        bool  evsm               = false;
+        u32   evsmBlurRadius     = 2;
+        float evsmExponent       = 40.0f;   // warp exponent, at most 42 for the squared moment to fit in a float
+        float evsmBleedReduction = 0.2f;    // fraction of the upper bound cut off to reduce light bleeding
+    } settings;
+
+    // Allocate the moment atlas if EVSM was enabled, or release it if it was disabled. The GPU must be idle.
+    void UpdateMoments();
 
     Handle<BindGroupLayout> GetShadowBindingsLayout() { return m_shadowBindingsLayout; }
     Handle<BindGroup>       GetShadowBindings()       { return m_shadowBindings; }
 
+    struct CascadeData {
+        alignas(16) glm::mat4 worldToShadow;    // world space to atlas texture coordinates (xy) and depth (z)
+        alignas(16) glm::vec4 atlasRect;        // min (xy) and max (zw) texture coordinates of the cascade's tile, inset by half a texel
+        alignas(16) glm::vec4 range;            // view space depth range of the cascade in xy
+    };
+
     struct ShadowDataUBO {
-        alignas(16) glm::vec4 a;
-        alignas(16) glm::vec4 b;
-        alignas(16) glm::mat4 shadowMat;
-        alignas(16) glm::vec4 cascadeScales[MaxCascades - 1];
-        alignas(16) glm::vec4 cascadeOffsets[MaxCascades - 1];
+        alignas(16) CascadeData cascades[MaxCascades];
         alignas(16) glm::vec4 shadowOffsets[2];
+        u32 cascadeCount;
+        float texelSize;    // size of an atlas texel in texture coordinates, for PCF kernels
+        alignas(16) glm::vec4 evsm;     // EVSM exponent, bleed reduction and minimum variance
     } m_shadowData;
 
+    // Number of draws tested and drawn into each cascade during the last call to Render. Cached cascades are not drawn.
+    struct CascadeStats {
+        u32  tested = 0;
+        u32  drawn  = 0;
+        bool cached = false;
+    } m_stats[MaxCascades] = {};
+
 private:
     void InitCascades(span<const glm::vec2> distances);
+    void RenderTiles(CommandBuffer& cmd, span<GLTFModel* const> models);
+
+    // Convert the depth of re-rendered or out of date tiles to EVSM moments, and blur them.
+    void FilterMoments(CommandBuffer& cmd);
+
+    // The moment atlas only has its full size while EVSM is enabled.
+    void CreateMoments();
+    void DestroyMoments();
+
+    // Re-render the static tiles of the cascades rendered this frame that are out of date.
+    void RenderStatic(CommandBuffer& cmd, span<GLTFModel* const> models);
+
+    // Cull and draw the casters passing filter into the tiles of the selected cascades, in the current rendering scope.
+    void DrawCasters(CommandBuffer& cmd, span<GLTFModel* const> models, const bool* cascades, GLTFModel::DrawFilter filter, u32 firstView);
+    void DrawCastersLayered(CommandBuffer& cmd, span<GLTFModel* const> models, const bool* cascades, GLTFModel::DrawFilter filter, u32 view);
+
+    // World space volume of the casters of a rendered cascade, optionally limited to casters that can shadow its receivers.
+    Frustum CasterFrustum(u32 cascade, bool receivers) const;
+
+    // Read back the depth range reduced MaxFramesInFlight frames ago, and fit the cascade distances to it.
+    void FitCascadesToDepth();
 
     struct Cascade {
         glm::vec3 v0, v1, v2, v3;   // near plane of the cascade portion of the camera frustum
         glm::vec3 v4, v5, v6, v7;   // far  plane of the cascade portion of the camera frustum
 
+        float a, b;                 // view space depth range of the cascade
+
         float d;                    // diameter of the cascade portion of the camera frustum
 
         float xmin, ymin, zmin;     // light-space bounding box of the cascade frustum
         float xmax, ymax, zmax;
 
+        glm::vec3 receiverMin;      // cascade space bounding box of the receivers visible to the camera
+        glm::vec3 receiverMax;
+
         glm::mat4 world_to_cascade; // world space to cascade view space
         glm::mat4 cascade_to_proj;  // cascade view space to projection
         glm::mat4 world_to_proj;    // world space to cascade projection
     };
 
+    // Cascades computed for the current frame, and the cascades the atlas tiles were last rendered with.
+    // Shadow lookups always use the rendered cascades, so a cached tile is sampled with the matrices it was rendered with.
     Cascade m_cascades[MaxCascades];
+    Cascade m_rendered[MaxCascades];
+
+    bool m_valid[MaxCascades]  = {};    // tile k holds a rendered cascade
+    bool m_dirty[MaxCascades]  = {};    // tile k is out of date, but has not been re-rendered yet due to time slicing
+    bool m_render[MaxCascades] = {};    // tile k is re-rendered this frame
+
+    // Static tile k holds the static casters seen through m_staticProj[k]. It is out of date if a static caster moved inside it.
+    bool      m_staticValid[MaxCascades] = {};
+    bool      m_staticDirty[MaxCascades] = {};
+    glm::mat4 m_staticProj[MaxCascades];
+
+    bool m_momentsValid[MaxCascades] = {};  // moment tile k matches depth tile k
+    bool m_momentsAllocated = false;        // the moment atlas is allocated at full size
+    u32  m_frame = 0;
+
+    std::vector<AABB> m_receivers;
+
+    // Cascade configuration. The fixed distances are used when SDSM is disabled or nothing has been reduced yet.
+    u32       m_cascadeCount = 0;
+    glm::vec2 m_distances[MaxCascades];
+    u32       m_resolutions[MaxCascades];
+    Rect2D    m_tiles[MaxCascades];
 
     Handle<Buffer> m_cascadeUBO[Device::MaxFramesInFlight];
     Handle<BindGroupLayout> m_cascadeBindingsLayout;
     Handle<BindGroup> m_cascadeBindings[Device::MaxFramesInFlight];
+    Handle<BindGroup> m_layeredBindings[Device::MaxFramesInFlight];     // all cascade matrices, for the single pass
 
     Handle<BindGroupLayout> m_shadowBindingsLayout;
     Handle<BindGroup> m_shadowBindings;
 
+    // Depth reduction. Each frame in flight reduces into its own host visible buffer holding the min and max depth as uints.
+    Handle<Pipeline>        m_reducePipeline;
+    Handle<BindGroupLayout> m_reduceLayout;
+    Handle<BindGroup>       m_reduceBindings[Device::MaxFramesInFlight];
+    Handle<Buffer>          m_reduceBuffers[Device::MaxFramesInFlight];
+
     Handle<Texture>  m_shadowMap;
+    Handle<Texture>  m_staticMap;
+
+    Handle<Texture>         m_moments;
+    Handle<Texture>         m_momentsBlur;
+    Handle<Pipeline>        m_evsmPipeline;
+    Handle<BindGroupLayout> m_evsmLayout;
+    Handle<BindGroup>       m_evsmBindings;
+
     Handle<Pipeline> m_pipeline;
+    Handle<Pipeline> m_layeredPipeline;
 
-    u32 m_resolution;
+    u32 m_atlasSize;
     Camera* m_camera;
-};
\ No newline at end of file
+};
@@ -74,7 +74,7 @@ UIOverlay::UIOverlay(Window* window, Device* device, Format colorFormat, Format
 			.blendStates = { Blend::PREMULTIPLY(0xF) },
 			.rasterizationState = { .cullMode = CullMode::None },
 			.vertexInputState = {
-				.vertexStride = sizeof(ImDrawVert),
+				.bindingStrides = { sizeof(ImDrawVert) },
 				.attributes = {
 					{ .offset = offsetof(ImDrawVert, pos), .format = Format::RG32_SFLOAT},
 					{ .offset = offsetof(ImDrawVert, uv),  .format = Format::RG32_SFLOAT},
@@ -104,11 +104,12 @@ void UIOverlay::Update() {
 	ImGui_ImplGlfw_NewFrame();
 	ImGui::NewFrame();
 
-	// Always render the frametime graph in the top left corner
-	ImGui::SetNextWindowSize({ 256, 80 });
+	// Always render the frametime graph and stats in the top left corner. A height of 0 auto-fits the window to its content.
+	ImGui::SetNextWindowSize({ 256, 0 });
 	ImGui::SetNextWindowPos({ 0, 0 });
 	ImGui::Begin("FrameTimeGraph", 0, ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoBringToFrontOnFocus | ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoBackground | ImGuiWindowFlags_NoMove);
 	DrawFrameTimeGraph();
+	DrawStats();
 	ImGui::End();
 
 	// Render the user-specified imgui window
@@ -282,4 +283,18 @@ void UIOverlay::DrawFrameTimeGraph() {
 			ImGui::SetTooltip("FPS: %.1f (%.2f ms)", 1.0f / m_frameTimeHistory.Get(mouseFrame), 1000.0f * m_frameTimeHistory.Get(mouseFrame));
 		}
 	}
+}
+
+// NOTE: stats are filled in during rendering, after Update has built the UI. The numbers shown are thus from the previous frame.
+void UIOverlay::DrawStats() {
+	ImGui::Text("GPU frame: %.3f ms, lighting: %.3f ms", stats.gpuFrameTime, stats.gpuLightingTime);
+	ImGui::Text("GPU GBuffer: %.3f ms (depth prepass: %.3f ms)", stats.gpuGBufferTime, stats.gpuPrepassTime);
+	ImGui::Text("Camera: %u drawn, %u culled (%u tested)", stats.camera.drawn, stats.camera.culled, stats.camera.tested);
+
+	for (u32 i = 0; i < stats.cascadeCount && i < arraysize(stats.cascades); i++) {
+		if (stats.cascades[i].cached)
+			ImGui::Text("Cascade %u: cached", i);
+		else
+			ImGui::Text("Cascade %u: %u drawn, %u culled", i, stats.cascades[i].drawn, stats.cascades[i].culled);
+	}
 }
\ No newline at end of file
@@ -20,6 +20,28 @@ public:
 	void Update();
 	void Render(CommandBuffer& cmd);
 	void DrawFrameTimeGraph();
+	void DrawStats();
+
+	struct CullStats {
+		u32 tested = 0;
+		u32 culled = 0;
+		u32 drawn  = 0;
+		bool cached = false;	// the view was not re-rendered this frame
+	};
+
+	// Per-frame render statistics, filled in by user code and shown below the frametime graph.
+	struct {
+		CullStats camera;
+		CullStats cascades[8];
+		u32 cascadeCount = 0;
+
+		// GPU time of the whole frame, of the GBuffer pass including its depth prepass, of the depth prepass alone, and of
+		// the lighting pass, in milliseconds. 0 if not measured.
+		float gpuFrameTime    = 0.0f;
+		float gpuGBufferTime  = 0.0f;
+		float gpuPrepassTime  = 0.0f;
+		float gpuLightingTime = 0.0f;
+	} stats = {};
 
 private:
 	// Frametime histogram
@@ -0,0 +1,242 @@
+#include "VisibilityBuffer.h"
+
+#include "../Core/ResourceManager.h"
+
+VisibilityBuffer::VisibilityBuffer(u32 width, u32 height, Handle<Texture> depth, span<const Handle<Texture>> gbuffer,
+                                   Handle<BindGroupLayout> cameraLayout, Handle<BindGroupLayout> materialLayout, Handle<BindGroupLayout> drawLayout)
+    : m_width{ width }, m_height{ height }
+{
+    ResourceManager* rm = ResourceManager::ptr;
+
+    SetTargets(depth, gbuffer);
+    CreateTextures();
+
+    // -- Bind groups --
+    m_visibilityLayout = rm->CreateBindGroupLayout({
+        .debugName = "Visibility buffer layout",
+        .bindings = { {.type = Binding::Type::TEXTURE, .stages = ShaderStage::FRAGMENT } }
+    });
+
+    m_visibilityBindings = rm->CreateBindGroup({
+        .debugName = "Visibility buffer bindgroup",
+        .layout = m_visibilityLayout,
+        .textures = { {0, m_visibility} }
+    });
+
+    // -- Pipelines --
+    std::vector<u32> visibilityVert = ReadShaderSpv("Shaders/visibility.vert.spv");
+    std::vector<u32> visibilityFrag = ReadShaderSpv("Shaders/visibility.frag.spv");
+    std::vector<u32> fullscreenVert = ReadShaderSpv("Shaders/deferred.vert.spv");
+    std::vector<u32> materialFrag   = ReadShaderSpv("Shaders/materialDepth.frag.spv");
+    std::vector<u32> resolveVert    = ReadShaderSpv("Shaders/visibilityResolve.vert.spv");
+    std::vector<u32> resolveFrag    = ReadShaderSpv("Shaders/visibilityResolve.frag.spv");
+
+    m_visibilityPipeline = rm->CreatePipeline({
+        .debugName = "Visibility buffer pipeline",
+        .shaderDescs = {
+            {.spirv = visibilityVert, .stage = ShaderStage::VERTEX},
+            {.spirv = visibilityFrag, .stage = ShaderStage::FRAGMENT}
+        },
+        .bindgroupLayouts = { cameraLayout, drawLayout },
+        .graphicsState = {
+            .colorAttachments = { Format::R32_UINT },
+            .depthStencilState = {.depthStencilFormat = Format::D24_UNORM_S8_UINT },
+            .vertexInputState = GLTFModel::Vertex::PositionInputState
+        }
+    });
+
+    m_materialDepthPipeline = rm->CreatePipeline({
+        .debugName = "Material depth pipeline",
+        .shaderDescs = {
+            {.spirv = fullscreenVert, .stage = ShaderStage::VERTEX},
+            {.spirv = materialFrag,   .stage = ShaderStage::FRAGMENT}
+        },
+        .bindgroupLayouts = { m_visibilityLayout, drawLayout },
+        .graphicsState = {
+            .depthStencilState = {
+                .depthStencilFormat = Format::D32_SFLOAT,
+                .depthCompareOp = CompareOp::Always
+            },
+            .rasterizationState = {.cullMode = CullMode::Front }
+        }
+    });
+
+    m_resolvePipeline = rm->CreatePipeline({
+        .debugName = "Visibility buffer resolve pipeline",
+        .shaderDescs = {
+            {.spirv = resolveVert, .stage = ShaderStage::VERTEX},
+            {.spirv = resolveFrag, .stage = ShaderStage::FRAGMENT}
+        },
+        .bindgroupLayouts = { cameraLayout, materialLayout, drawLayout, m_visibilityLayout },
+        .graphicsState = {
+            .colorAttachments = { Format::RGBA8_UNORM, Format::RG16_UNORM, Format::RG8_UNORM },
+            .depthStencilState = {
+                .depthStencilFormat = Format::D32_SFLOAT,
+                .depthWriteEnable = false,
+                .depthCompareOp = CompareOp::Equal
+            },
+            .rasterizationState = {.cullMode = CullMode::Front }
+        }
+    });
+}
+
+VisibilityBuffer::~VisibilityBuffer() {
+    ResourceManager* rm = ResourceManager::ptr;
+
+    rm->DestroyPipeline(m_visibilityPipeline);
+    rm->DestroyPipeline(m_materialDepthPipeline);
+    rm->DestroyPipeline(m_resolvePipeline);
+
+    DestroyTextures();
+
+    rm->DestroyBindGroupLayout(m_visibilityLayout);
+}
+
+void VisibilityBuffer::CreateTextures() {
+    ResourceManager* rm = ResourceManager::ptr;
+
+    m_visibility = rm->CreateTexture({
+        .debugName = "Visibility buffer",
+        .width = m_width, .height = m_height,
+        .format = Format::R32_UINT,
+        .usage = Usage::RENDER_TARGET | Usage::SHADER_RESOURCE
+    });
+
+    // Only ever tested against, but bound read-only in its shader resource layout during the resolve.
+    m_materialDepth = rm->CreateTexture({
+        .debugName = "Material depth",
+        .width = m_width, .height = m_height,
+        .format = Format::D32_SFLOAT,
+        .usage = Usage::DEPTH_STENCIL | Usage::SHADER_RESOURCE
+    });
+
+    // Transition to shader resource (render loop expects this initial state)
+    CommandBuffer& cmd = Device::ptr->GetCommandBuffer();
+    cmd.ImageBarrier(m_visibility, Usage::RENDER_TARGET, Usage::SHADER_RESOURCE);
+    Device::ptr->FlushCommandBuffer(cmd);
+}
+
+void VisibilityBuffer::DestroyTextures() {
+    ResourceManager* rm = ResourceManager::ptr;
+    rm->DestroyTexture(m_visibility);
+    rm->DestroyTexture(m_materialDepth);
+}
+
+void VisibilityBuffer::SetTargets(Handle<Texture> depth, span<const Handle<Texture>> gbuffer) {
+    Check(gbuffer.size() == arraysize(m_gbuffer), "The visibility buffer resolves to %u GBuffer targets, got %u", (u32)arraysize(m_gbuffer), (u32)gbuffer.size());
+
+    m_depth = depth;
+    for (u32 i = 0; i < arraysize(m_gbuffer); i++)
+        m_gbuffer[i] = gbuffer[i];
+}
+
+void VisibilityBuffer::Resize(u32 width, u32 height, Handle<Texture> depth, span<const Handle<Texture>> gbuffer) {
+    m_width  = width;
+    m_height = height;
+
+    SetTargets(depth, gbuffer);
+
+    DestroyTextures();
+    CreateTextures();
+
+    ResourceManager::ptr->UpdateBindGroupTextures(m_visibilityBindings, { {0, m_visibility} });
+}
+
+void VisibilityBuffer::Render(CommandBuffer& cmd, Handle<BindGroup> cameraBindings, span<GLTFModel* const> models) {
+    const Extent2D extent = { m_width, m_height };
+
+    // Global numbering of the draws and materials: each model's are offset by those of the models before it.
+    u32 drawCount = 0, materialCount = 0;
+    for (const GLTFModel* model : models) {
+        drawCount     += model->DrawCount();
+        materialCount += model->MaterialCount();
+    }
+    Check(drawCount <= MaxDraws, "The visibility buffer supports at most %u draws, got %u", MaxDraws, drawCount);
+    Check(materialCount <= MaxMaterialSlots, "The visibility buffer supports at most %u materials, got %u", MaxMaterialSlots, materialCount);
+
+    // -- Visibility pass --
+    cmd.ImageBarrier(m_visibility, Usage::SHADER_RESOURCE, Usage::RENDER_TARGET);
+
+    cmd.SetPipeline(m_visibilityPipeline);
+    cmd.SetBindGroup(cameraBindings, 0);
+
+    cmd.BeginRendering(extent, { m_visibility }, m_depth);
+
+    u32 drawOffset = 0;
+    for (const GLTFModel* model : models) {
+        cmd.PushConstants(&drawOffset, 0, sizeof(drawOffset), ShaderStage::FRAGMENT);
+        model->Draw(cmd, 0, true, GLTFModel::MaterialFilter::NON_DISCARDING);
+        drawOffset += model->DrawCount();
+    }
+
+    cmd.EndRendering();
+
+    cmd.ImageBarrier(m_visibility, Usage::RENDER_TARGET, Usage::SHADER_RESOURCE);
+
+    // -- Material depth pass --
+    // One full-screen triangle per model, writing the material slots of the pixels covered by its draws.
+    cmd.SetPipeline(m_materialDepthPipeline);
+    cmd.SetBindGroup(m_visibilityBindings, 0);
+
+    cmd.BeginRendering(m_materialDepth, 0, m_width, m_height);
+
+    struct {
+        u32 drawOffset;
+        u32 drawCount;
+        u32 firstMaterial;
+    } modelRange = {};
+
+    for (const GLTFModel* model : models) {
+        modelRange.drawCount = model->DrawCount();
+
+        cmd.SetBindGroup(model->GetDrawBindings(), 1);
+        cmd.PushConstants(&modelRange, 0, sizeof(modelRange), ShaderStage::FRAGMENT);
+        cmd.Draw(3, 1, 0, 0);
+
+        modelRange.drawOffset    += model->DrawCount();
+        modelRange.firstMaterial += model->MaterialCount();
+    }
+
+    cmd.EndRendering();
+
+    // -- Material resolve --
+    // One full-screen triangle per visible material, at the depth of its slot. The material depth buffer is bound read-only,
+    // so the equal test rejects the pixels of every other material.
+    cmd.ImageBarrier(m_materialDepth, Usage::DEPTH_STENCIL, Usage::SHADER_RESOURCE);
+
+    cmd.SetPipeline(m_resolvePipeline);
+    cmd.SetBindGroup(cameraBindings, 0);
+    cmd.SetBindGroup(m_visibilityBindings, 3);
+
+    cmd.BeginRendering(extent, m_gbuffer, m_materialDepth, true);
+
+    struct {
+        u32 drawOffset;
+        u32 materialSlot;
+        u32 shortIndices;
+    } resolve = {};
+
+    u32 firstMaterial = 0;
+    for (const GLTFModel* model : models) {
+        cmd.SetBindGroup(model->GetDrawBindings(), 2);
+        resolve.shortIndices = model->GetIndexType() == IndexType::UINT16;
+
+        m_materials.clear();
+        model->GetVisibleMaterials(0, m_materials, GLTFModel::MaterialFilter::NON_DISCARDING);
+
+        for (u32 material : m_materials) {
+            resolve.materialSlot = firstMaterial + material;
+
+            cmd.SetBindGroup(model->GetMaterialBindings(material), 1);
+            cmd.PushConstants(&resolve, 0, sizeof(resolve), ShaderStage::VERTEX | ShaderStage::FRAGMENT);
+            cmd.Draw(3, 1, 0, 0);
+        }
+
+        resolve.drawOffset += model->DrawCount();
+        firstMaterial      += model->MaterialCount();
+    }
+
+    cmd.EndRendering();
+
+    cmd.ImageBarrier(m_materialDepth, Usage::SHADER_RESOURCE, Usage::DEPTH_STENCIL);
+}
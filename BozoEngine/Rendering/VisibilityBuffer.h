@@ -0,0 +1,61 @@
+#pragma once
+
+#include "../Core/Graphics.h"
+#include "../Core/Device.h"
+
+#include "GLTFModel.h"
+
+#include <vector>
+
+// Visibility buffer rendering of the GBuffer. The geometry pass only reads vertex positions, and writes depth and the draw
+// and triangle covering each pixel. The GBuffer is then resolved from the visibility buffer: vertex attributes are fetched
+// and interpolated, and materials sampled, once per pixel instead of once per rasterized fragment.
+//
+// Without bindless textures one pass can't sample every material, so each material is resolved by its own full-screen
+// triangle, drawn at a depth unique to the material and tested for equality against a material depth buffer written from
+// the visibility buffer. The depth test rejects the pixels of every other material before they are shaded.
+//
+// Parallax mapped materials may discard pixels once their material is evaluated, which the visibility pass can't know
+// about. They are left out of the visibility buffer, and must be rasterized into the resolved GBuffer afterwards.
+class VisibilityBuffer {
+public:
+    // Must match visibility.hlsli. Draws and materials are numbered globally across all rendered models.
+    static constexpr u32 TriangleBits     = 20;
+    static constexpr u32 MaxDraws         = (1u << (32 - TriangleBits)) - 1;
+    static constexpr u32 MaxMaterialSlots = 4095;
+
+    // depth and gbuffer (albedo, normal and roughness/AO, see Shaders/gbuffer.hlsli) are the targets the models are
+    // resolved to. The bindgroup layouts are those of the camera, and the materials and draw data of the GLTFModels.
+    VisibilityBuffer(u32 width, u32 height, Handle<Texture> depth, span<const Handle<Texture>> gbuffer,
+                     Handle<BindGroupLayout> cameraLayout, Handle<BindGroupLayout> materialLayout, Handle<BindGroupLayout> drawLayout);
+    ~VisibilityBuffer();
+
+    void Resize(u32 width, u32 height, Handle<Texture> depth, span<const Handle<Texture>> gbuffer);
+
+    // Render view 0 of the models into the depth buffer and the GBuffer targets, which must be in render target usage.
+    // Must be called after view 0 of every model has been culled. Only the non-discarding materials are rendered.
+    void Render(CommandBuffer& cmd, Handle<BindGroup> cameraBindings, span<GLTFModel* const> models);
+
+private:
+    void CreateTextures();
+    void DestroyTextures();
+    void SetTargets(Handle<Texture> depth, span<const Handle<Texture>> gbuffer);
+
+    u32 m_width, m_height;
+
+    Handle<Texture> m_depth;
+    Handle<Texture> m_gbuffer[3];
+
+    Handle<Texture> m_visibility;       // draw and triangle of each pixel
+    Handle<Texture> m_materialDepth;    // material slot of each pixel, as a depth
+
+    Handle<BindGroupLayout> m_visibilityLayout;
+    Handle<BindGroup>       m_visibilityBindings;
+
+    Handle<Pipeline> m_visibilityPipeline;
+    Handle<Pipeline> m_materialDepthPipeline;
+    Handle<Pipeline> m_resolvePipeline;
+
+    // Materials of the model being resolved that are visible in view 0.
+    std::vector<u32> m_materials;
+};
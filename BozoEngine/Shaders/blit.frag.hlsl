@@ -0,0 +1,9 @@
+// Copy a texture to the render target, drawn as a full-screen triangle with deferred.vert.hlsl.
+// Used to present images written by compute shaders, as the sRGB swapchain cannot be bound as a storage image.
+
+[[vk::combinedImageSampler]] [[vk::binding(0, 0)]] Texture2D<float4> source;
+[[vk::combinedImageSampler]] [[vk::binding(0, 0)]] SamplerState      sourceState;
+
+float4 main([[vk::location(0)]] float2 inUV : TEXCOORD0) : SV_Target0 {
+    return source.SampleLevel(sourceState, inUV, 0);
+}
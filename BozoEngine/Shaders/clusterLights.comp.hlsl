@@ -0,0 +1,89 @@
+#pragma pack_matrix(column_major)
+
+// Assign point lights to the clusters of a froxel grid. Each thread builds the light list of one cluster, testing the
+// light spheres against the view space bounding box of the cluster. Lights are staged through groupshared memory in
+// batches, so each light is only read from memory once per group. Must match the grid in ClusteredLights.
+
+#define GRID_X 16
+#define GRID_Y 9
+#define GRID_Z 24
+#define CLUSTER_COUNT (GRID_X * GRID_Y * GRID_Z)
+#define MAX_LIGHTS_PER_CLUSTER 128
+#define GROUP_SIZE 64
+
+struct Light {
+    float4 positionRadius;  // view space position and radius
+    float4 color;
+};
+
+[[vk::binding(0, 0)]] StructuredBuffer<Light>  lights;
+[[vk::binding(1, 0)]] RWStructuredBuffer<uint> clusterCounts;
+[[vk::binding(2, 0)]] RWStructuredBuffer<uint> clusterIndices;
+
+struct PushConstants {
+    float4x4 invProj;
+    float    nearZ;
+    float    farZ;
+    uint     lightCount;
+};
+[[vk::push_constant]] PushConstants pc;
+
+groupshared float4 sharedLights[GROUP_SIZE];
+
+// View space direction through a point in normalized device coordinates, scaled to unit depth.
+float3 ViewRay(float2 ndc) {
+    float4 p = mul(pc.invProj, float4(ndc, 1.0, 1.0));
+    return p.xyz / p.z;
+}
+
+// View space depth of the boundary between slice k - 1 and slice k. The first slice extends to the camera.
+float SliceDepth(uint k) {
+    return k == 0 ? 0.0 : pc.nearZ * pow(pc.farZ / pc.nearZ, float(k) / GRID_Z);
+}
+
+bool SphereIntersectsAABB(float4 sphere, float3 aabbMin, float3 aabbMax) {
+    float3 d = max(aabbMin - sphere.xyz, 0.0) + max(sphere.xyz - aabbMax, 0.0);
+    return dot(d, d) <= sphere.w * sphere.w;
+}
+
+[numthreads(GROUP_SIZE, 1, 1)]
+void main(uint3 id : SV_DispatchThreadID, uint index : SV_GroupIndex) {
+    const uint cluster = id.x;
+    const bool active  = cluster < CLUSTER_COUNT;
+
+    const uint3 c = uint3(cluster % GRID_X, (cluster / GRID_X) % GRID_Y, cluster / (GRID_X * GRID_Y));
+
+    // Bounding box of the cluster: the four corner rays of its screen tile, between the depths of its slice.
+    const float2 ndcMin = float2(c.xy)     / float2(GRID_X, GRID_Y) * 2.0 - 1.0;
+    const float2 ndcMax = float2(c.xy + 1) / float2(GRID_X, GRID_Y) * 2.0 - 1.0;
+    const float  zNear  = SliceDepth(c.z);
+    const float  zFar   = SliceDepth(c.z + 1);
+
+    const float3 rays[4] = { ViewRay(ndcMin), ViewRay(float2(ndcMax.x, ndcMin.y)), ViewRay(float2(ndcMin.x, ndcMax.y)), ViewRay(ndcMax) };
+
+    float3 aabbMin = rays[0] * zNear;
+    float3 aabbMax = rays[0] * zNear;
+    for (uint i = 0; i < 4; i++) {
+        aabbMin = min(aabbMin, min(rays[i] * zNear, rays[i] * zFar));
+        aabbMax = max(aabbMax, max(rays[i] * zNear, rays[i] * zFar));
+    }
+
+    uint count = 0;
+    for (uint first = 0; first < pc.lightCount; first += GROUP_SIZE) {
+        if (first + index < pc.lightCount)
+            sharedLights[index] = lights[first + index].positionRadius;
+        GroupMemoryBarrierWithGroupSync();
+
+        const uint batch = min(GROUP_SIZE, pc.lightCount - first);
+        for (uint j = 0; j < batch; j++) {
+            if (active && count < MAX_LIGHTS_PER_CLUSTER && SphereIntersectsAABB(sharedLights[j], aabbMin, aabbMax)) {
+                clusterIndices[cluster * MAX_LIGHTS_PER_CLUSTER + count] = first + j;
+                count++;
+            }
+        }
+        GroupMemoryBarrierWithGroupSync();
+    }
+
+    if (active)
+        clusterCounts[cluster] = count;
+}
@@ -0,0 +1,398 @@
+#pragma once
+#pragma pack_matrix(column_major)
+
+#include "gbuffer.hlsli"
+
+// Deferred shading of the GBuffer, shared by the full-screen pass (deferred.frag.hlsl), the tiled compute pass
+// (tiledDeferred.comp.hlsl) and the light volume pass (lightVolume.frag.hlsl). All passes bind the same bindgroups and push constants.
+
+struct DirLight {
+    float3 direction;
+    float3 ambient;
+    float3 diffuse;
+};
+
+struct PointLight {
+    float4 positionRadius;      // view space position and radius
+    float4 color;
+};
+
+#define MAX_CASCADES 8
+
+struct CascadeData {
+    float4x4 worldToShadow;     // world space to atlas texture coordinates (xy) and depth (z)
+    float4   atlasRect;         // texture coordinate bounds of the cascade's atlas tile, inset by half a texel
+    float4   range;             // view space depth range of the cascade in xy
+};
+
+struct ShadowData {
+    CascadeData cascades[MAX_CASCADES];
+    float4 shadowOffsets[2];
+    uint cascadeCount;
+    float texelSize;            // size of a shadow atlas texel in texture coordinates
+    float4 evsm;                // EVSM exponent, light bleeding reduction and minimum variance
+};
+
+// Froxel grid the point lights are binned into. Must match ClusteredLights.
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+#define MAX_LIGHTS_PER_CLUSTER 128
+
+struct ClusterData {
+    uint  lightCount;
+    uint  clustered;            // shade with the lights of the pixel's cluster, instead of every light
+    float sliceScale;           // depth slice = log2(z) * sliceScale + sliceBias
+    float sliceBias;
+};
+
+[[vk::binding(0, 0)]]
+cbuffer UniformBufferObject {
+    float4x4 view;
+    float4x4 invProj;
+    float4 position;
+    ShadowData shadow;
+    ClusterData clusters;
+    DirLight dirLight;
+};
+
+// lightIndex is only used by the light volume pass, which pushes it separately for each light.
+struct PushConstants { uint renderMode; uint colorCascades; uint enableGTAO; uint lightIndex; };
+[[vk::push_constant]] PushConstants pc;
+
+// Number of PCF taps per shadow lookup: 1, 4 (rotated grid), 9 (3x3 grid) or 16 (per-pixel rotated Poisson disk).
+// Selected when the pipeline is created, so the unused kernels are compiled out.
+[[vk::constant_id(0)]] const uint PCF_TAPS = 4;
+
+// Filter shadows with the pre-blurred EVSM moments of the atlas instead of PCF.
+[[vk::constant_id(1)]] const bool SHADOW_EVSM = false;
+
+// Point lights are shaded by the additive light volume pass, so the full-screen pass leaves them out.
+[[vk::constant_id(2)]] const bool LIGHT_VOLUMES = false;
+
+[[vk::combinedImageSampler]] [[vk::binding(0, 1)]] Texture2D<float4>   samplerAlbedo;
+[[vk::combinedImageSampler]] [[vk::binding(0, 1)]] SamplerState        samplerAlbedoState;
+[[vk::combinedImageSampler]] [[vk::binding(1, 1)]] Texture2D<float2>   samplerNormal;
+[[vk::combinedImageSampler]] [[vk::binding(1, 1)]] SamplerState        samplerNormalState;
+[[vk::combinedImageSampler]] [[vk::binding(2, 1)]] Texture2D<float2>   samplerRoughnessAO;
+[[vk::combinedImageSampler]] [[vk::binding(2, 1)]] SamplerState        samplerRoughnessAOState;
+[[vk::combinedImageSampler]] [[vk::binding(3, 1)]] Texture2D<float4>   samplerDepth;
+[[vk::combinedImageSampler]] [[vk::binding(3, 1)]] SamplerState        samplerDepthState;
+[[vk::combinedImageSampler]] [[vk::binding(0, 2)]] Texture2D<float>   samplerShadowMap;
+[[vk::combinedImageSampler]] [[vk::binding(0, 2)]] SamplerComparisonState samplerShadowMapState;
+[[vk::combinedImageSampler]] [[vk::binding(1, 2)]] Texture2D<float2>   samplerShadowMoments;
+[[vk::combinedImageSampler]] [[vk::binding(1, 2)]] SamplerState        samplerShadowMomentsState;
+[[vk::combinedImageSampler]] [[vk::binding(0, 3)]] Texture2D<float4>   samplerGTAO;
+[[vk::combinedImageSampler]] [[vk::binding(0, 3)]] SamplerState        samplerGTAOState;
+
+[[vk::binding(0, 4)]] StructuredBuffer<PointLight> pointLights;
+[[vk::binding(1, 4)]] StructuredBuffer<uint>       clusterCounts;
+[[vk::binding(2, 4)]] StructuredBuffer<uint>       clusterIndices;
+
+// View matrix is affine (rotation + translation), so use the efficient inverse
+float4x4 InverseView(float4x4 v) {
+    float3x3 R  = (float3x3)v;
+    float3x3 Rt = transpose(R);
+    float3   t  = float3(v[0][3], v[1][3], v[2][3]);
+    float4x4 result;
+    result[0] = float4(Rt[0], -dot(Rt[0], t));
+    result[1] = float4(Rt[1], -dot(Rt[1], t));
+    result[2] = float4(Rt[2], -dot(Rt[2], t));
+    result[3] = float4(0, 0, 0, 1);
+    return result;
+}
+
+float3 reconstruct_pos_view_space(float2 inUV) {
+    float z = samplerDepth.SampleLevel(samplerDepthState, inUV, 0).r;
+    float4 clipSpacePosition = float4(inUV * 2.0 - 1.0, z, 1.0);
+    float4 viewSpacePosition = mul(invProj, clipSpacePosition);
+    return viewSpacePosition.xyz / viewSpacePosition.w;
+}
+
+static const float PI = 3.14159265359f;
+
+// GGX/Trowbridge-Reitz normal distribution function
+float D_GGX(float NdotH, float roughness) {
+    float a  = roughness * roughness;
+    float a2 = a * a;
+    float d  = NdotH * NdotH * (a2 - 1.0) + 1.0;
+    return a2 / (PI * d * d);
+}
+
+// Schlick-GGX geometry term (direct lighting: k = (roughness+1)^2 / 8)
+float G_SchlickGGX(float NdotX, float roughness) {
+    float k = (roughness + 1.0);
+    k = (k * k) / 8.0;
+    return NdotX / (NdotX * (1.0 - k) + k);
+}
+
+// Fresnel-Schlick approximation
+float3 F_Schlick(float HdotV, float3 F0) {
+    return F0 + (1.0 - F0) * pow(1.0 - HdotV, 5.0);
+}
+
+// Cook-Torrance BRDF for a single direct light contribution
+float3 pbr_direct(float3 albedo, float metallic, float roughness, float3 F0,
+                  float3 n, float3 v, float3 l, float3 lightColor) {
+    float3 h    = normalize(v + l);
+    float NdotL = max(dot(n, l), 0.0);
+    float NdotV = max(dot(n, v), 0.0);
+    float NdotH = max(dot(n, h), 0.0);
+    float HdotV = max(dot(h, v), 0.0);
+
+    float  D = D_GGX(NdotH, roughness);
+    float  G = G_SchlickGGX(NdotV, roughness) * G_SchlickGGX(NdotL, roughness);
+    float3 F = F_Schlick(HdotV, F0);
+
+    float3 specular = D * G * F / max(4.0 * NdotV * NdotL, 0.001);
+    float3 kd       = (1.0 - F) * (1.0 - metallic);
+
+    return (kd * albedo / PI + specular) * lightColor * NdotL;
+}
+
+float smooth_attenuation(float r, float2 attenuationConstants) {
+    r = clamp(r, 0.0, 2.0 / attenuationConstants.y);
+    float r2 = r * r;
+    float attenuation = r2 * attenuationConstants.x * (sqrt(r2) * attenuationConstants.y - 3.0) + 1.0;
+    return clamp(attenuation, 0.0, 1.0);
+}
+
+float3 shade_directional_light(DirLight light, float3 albedo, float metallic, float roughness, float3 n, float3 v) {
+    float3 F0 = lerp(float3(0.04, 0.04, 0.04), albedo, metallic);
+    float3 l  = -normalize(mul((float3x3)view, light.direction));
+    return pbr_direct(albedo, metallic, roughness, F0, n, v, l, light.diffuse);
+}
+
+float3 shade_point_light(PointLight light, float3 albedo, float metallic, float roughness, float3 n, float3 v, float3 p) {
+    float3 F0   = lerp(float3(0.04, 0.04, 0.04), albedo, metallic);
+    float3 lpos = light.positionRadius.xyz;
+    float3 l    = normalize(lpos - p);
+    float  d    = length(lpos - p);
+    float  rmax = light.positionRadius.w;
+    float  att  = smooth_attenuation(d, float2(1.0 / (rmax * rmax), 2.0 / rmax));
+    return pbr_direct(albedo, metallic, roughness, F0, n, v, l, light.color.rgb * att);
+}
+
+// Sample the atlas tile of a cascade at p.xy, comparing against depth p.z.
+// Coordinates are clamped to the tile, so filter taps near its border never read a neighbouring cascade.
+float SampleShadowMap(CascadeData cascade, float3 p) {
+    float2 uv = clamp(p.xy, cascade.atlasRect.xy, cascade.atlasRect.zw);
+    return samplerShadowMap.SampleCmpLevelZero(samplerShadowMapState, uv, saturate(p.z));
+}
+
+static const float2 poissonDisk[16] = {
+    float2(-0.94201624, -0.39906216), float2( 0.94558609, -0.76890725),
+    float2(-0.09418410, -0.92938870), float2( 0.34495938,  0.29387760),
+    float2(-0.91588581,  0.45771432), float2(-0.81544232, -0.87912464),
+    float2(-0.38277543,  0.27676845), float2( 0.97484398,  0.75648379),
+    float2( 0.44323325, -0.97511554), float2( 0.53742981, -0.47373420),
+    float2(-0.26496911, -0.41893023), float2( 0.79197514,  0.19090188),
+    float2(-0.24188840,  0.99706507), float2(-0.81409955,  0.91437590),
+    float2( 0.19984126,  0.78641367), float2( 0.14383161, -0.14100790)
+};
+
+// Interleaved gradient noise (Jimenez 2014), used to rotate the Poisson disk per pixel.
+float InterleavedGradientNoise(float2 pixel) {
+    return frac(52.9829189 * frac(dot(pixel, float2(0.06711056, 0.00583715))));
+}
+
+// Upper bound on the fraction of occluders at least as far from the light as t, given their mean and mean square.
+float ChebyshevUpperBound(float2 moments, float t, float minVariance) {
+    if (t <= moments.x) return 1.0;
+
+    float variance = max(moments.y - moments.x * moments.x, minVariance);
+    float d        = t - moments.x;
+    return variance / (variance + d * d);
+}
+
+// Sample the blurred EVSM moments of a cascade's tile with a single bilinear fetch. Must match the warp in evsm.comp.hlsl.
+float SampleMoments(CascadeData cascade, float3 p) {
+    // Moment texels are twice the size of atlas texels, so inset the tile by another half moment texel.
+    float2 inset   = 0.5 * shadow.texelSize;
+    float2 uv      = clamp(p.xy, cascade.atlasRect.xy + inset, cascade.atlasRect.zw - inset);
+    float2 moments = samplerShadowMoments.SampleLevel(samplerShadowMomentsState, uv, 0);
+
+    float t      = 1.0 - 2.0 * saturate(p.z);
+    float warped = exp(shadow.evsm.x * t);
+
+    // Scale the minimum variance to the derivative of the warp, so it stays a fixed fraction of a depth step.
+    float depthScale  = shadow.evsm.z * shadow.evsm.x * warped;
+    float minVariance = depthScale * depthScale;
+
+    float visibility = ChebyshevUpperBound(moments, warped, minVariance);
+
+    // Cut off the tail of the upper bound to reduce light bleeding.
+    float bleed = shadow.evsm.y;
+    return saturate((visibility - bleed) / (1.0 - bleed));
+}
+
+float SampleCascade(uint k, float4 world_pos, float2 pixel) {
+    CascadeData cascade = shadow.cascades[k];
+    float3 p = mul(cascade.worldToShadow, world_pos).xyz;
+
+    if (SHADOW_EVSM) {
+        return SampleMoments(cascade, p);
+    }
+
+    if (PCF_TAPS == 1) {
+        return SampleShadowMap(cascade, p);
+    }
+    else if (PCF_TAPS == 4) {
+        float light = SampleShadowMap(cascade, float3(p.xy + shadow.shadowOffsets[0].xy, p.z));
+        light      += SampleShadowMap(cascade, float3(p.xy + shadow.shadowOffsets[0].zw, p.z));
+        light      += SampleShadowMap(cascade, float3(p.xy + shadow.shadowOffsets[1].xy, p.z));
+        light      += SampleShadowMap(cascade, float3(p.xy + shadow.shadowOffsets[1].zw, p.z));
+        return light * 0.25;
+    }
+    else if (PCF_TAPS == 9) {
+        float light = 0.0;
+        [unroll] for (int y = -1; y <= 1; y++) {
+            [unroll] for (int x = -1; x <= 1; x++)
+                light += SampleShadowMap(cascade, float3(p.xy + float2(x, y) * shadow.texelSize, p.z));
+        }
+        return light / 9.0;
+    }
+    else {
+        float angle = InterleavedGradientNoise(pixel) * 2.0 * PI;
+        float2x2 rotation = float2x2(cos(angle), -sin(angle), sin(angle), cos(angle));
+
+        float light = 0.0;
+        [unroll] for (int i = 0; i < 16; i++)
+            light += SampleShadowMap(cascade, float3(p.xy + mul(rotation, poissonDisk[i]) * 1.5 * shadow.texelSize, p.z));
+        return light / 16.0;
+    }
+}
+
+static const float3 cascadeColors[MAX_CASCADES] = {
+    float3(1.0f,  0.25f, 0.25f),
+    float3(0.25f, 1.0f,  0.25f),
+    float3(0.25f, 0.25f, 1.0f ),
+    float3(1.0f,  1.0f,  0.25f),
+    float3(0.25f, 1.0f,  1.0f ),
+    float3(1.0f,  0.25f, 1.0f ),
+    float3(1.0f,  0.6f,  0.25f),
+    float3(0.6f,  0.25f, 1.0f ),
+};
+
+float3 get_shadow(float3 p, float2 pixel) {
+    // Find the first cascade that covers the view space depth. Anything beyond the last cascade is lit.
+    uint k = 0;
+    while (k < shadow.cascadeCount && p.z >= shadow.cascades[k].range.y)
+        k++;
+    if (k == shadow.cascadeCount)
+        return 1.0;
+
+    float4 world_pos = mul(InverseView(view), float4(p, 1.0));
+
+    // Blend towards the next cascade where the two overlap: from a (start of cascade k + 1) to b (end of cascade k).
+    // Outside of the overlap, only cascade k is sampled.
+    float weight = 1.0;
+    if (k + 1 < shadow.cascadeCount) {
+        float a = shadow.cascades[k + 1].range.x;
+        float b = shadow.cascades[k].range.y;
+        weight = 1.0 - saturate((p.z - a) / (b - a));
+    }
+
+    float light = SampleCascade(k, world_pos, pixel);
+    if (weight < 1.0)
+        light = lerp(SampleCascade(k + 1, world_pos, pixel), light, weight);
+
+    float3 shadowColor = light;
+    if (pc.colorCascades == 1) {
+        uint next = min(k + 1, shadow.cascadeCount - 1);
+        shadowColor *= lerp(cascadeColors[next], cascadeColors[k], weight);
+    }
+
+    return shadowColor;
+}
+
+// Cluster of the froxel grid containing a pixel at view space depth z. Depth slices are logarithmic in z.
+uint ClusterIndex(float2 uv, float z) {
+    uint3 c;
+    c.xy = min(uint2(uv * float2(CLUSTER_GRID_X, CLUSTER_GRID_Y)), uint2(CLUSTER_GRID_X - 1, CLUSTER_GRID_Y - 1));
+    c.z  = uint(clamp(log2(z) * clusters.sliceScale + clusters.sliceBias, 0.0, CLUSTER_GRID_Z - 1));
+    return c.x + CLUSTER_GRID_X * (c.y + CLUSTER_GRID_Y * c.z);
+}
+
+struct Surface {
+    float3 p;           // view space position
+    float3 n;           // view space normal
+    float3 v;           // view space direction towards the camera
+    float3 albedo;
+    float  metallic;
+    float  roughness;
+    float  bakedAO;
+    float  ssao;
+};
+
+// Read the GBuffer at inUV. Uses explicit LODs, so it can be called from compute shaders as well.
+Surface load_surface(float2 inUV) {
+    float4 albedo = samplerAlbedo.SampleLevel(samplerAlbedoState, inUV, 0);
+    float2 ra     = samplerRoughnessAO.SampleLevel(samplerRoughnessAOState, inUV, 0);
+
+    Surface s;
+    s.p         = reconstruct_pos_view_space(inUV);
+    s.n         = decode_normal(samplerNormal.SampleLevel(samplerNormalState, inUV, 0));
+    s.v         = normalize(mul(view, position).xyz - s.p);
+    s.albedo    = albedo.rgb;
+    s.bakedAO   = ra.g;
+    s.ssao      = pc.enableGTAO ? samplerGTAO.SampleLevel(samplerGTAOState, inUV, 0).r : 1.0;
+    s.roughness = ra.r;
+    s.metallic  = albedo.a;
+    return s;
+}
+
+float3 shade_point_light(PointLight light, Surface s) {
+    return shade_point_light(light, s.albedo, s.metallic, s.roughness, s.n, s.v, s.p);
+}
+
+// Apply SSAO independently from baked AO — affects both ambient and direct light
+float direct_ao(Surface s) {
+    return lerp(1.0, s.ssao, 0.5 * (1.0 - s.metallic));
+}
+
+// Light a surface with the ambient and shadowed directional light, plus the given point light contribution.
+float4 shade_surface(Surface s, float2 pixel, float3 pointLighting) {
+    float3 ambient = dirLight.ambient * s.albedo * s.bakedAO;
+    float3 direct  = shade_directional_light(dirLight, s.albedo, s.metallic, s.roughness, s.n, s.v) * get_shadow(s.p, pixel) + pointLighting;
+
+    return float4((ambient + direct) * direct_ao(s), 1.0);
+}
+
+float4 shade_pixel(float2 inUV, float2 pixel) {
+    Surface s = load_surface(inUV);
+
+    // Point lights are added on top by the light volume pass.
+    if (LIGHT_VOLUMES)
+        return shade_surface(s, pixel, 0.0);
+
+    float3 pointLighting = 0.0;
+    if (clusters.clustered) {
+        uint cluster = ClusterIndex(inUV, s.p.z);
+        uint count   = clusterCounts[cluster];
+        for (uint i = 0; i < count; i++) {
+            pointLighting += shade_point_light(pointLights[clusterIndices[cluster * MAX_LIGHTS_PER_CLUSTER + i]], s);
+        }
+    }
+    else {
+        for (uint i = 0; i < clusters.lightCount; i++) {
+            pointLighting += shade_point_light(pointLights[i], s);
+        }
+    }
+
+    return shade_surface(s, pixel, pointLighting);
+}
+
+// GBuffer debug views for render modes other than 0.
+float4 debug_view(float2 inUV) {
+    switch (pc.renderMode) {
+        case 1: return float4(samplerAlbedo.SampleLevel(samplerAlbedoState, inUV, 0).rgb, 1.0);
+        case 2: return float4(decode_normal(samplerNormal.SampleLevel(samplerNormalState, inUV, 0)) * 0.5 + 0.5, 1.0);
+        case 3: // metallic in blue on the left half, roughness in green on the right half
+            return inUV.x < 0.5 ? float4(0.0, 0.0, samplerAlbedo.SampleLevel(samplerAlbedoState, inUV, 0).a, 1.0)
+                                : float4(0.0, samplerRoughnessAO.SampleLevel(samplerRoughnessAOState, inUV, 0).r, 0.0, 1.0);
+        case 4: return float4(samplerDepth.SampleLevel(samplerDepthState, inUV, 0).r, 0.0, 0.0, 1.0);
+        case 5: return float4(samplerGTAO.SampleLevel(samplerGTAOState, inUV, 0).rrr, 1.0);
+        default: return float4(0, 0, 0, 1);
+    }
+}
@@ -0,0 +1,25 @@
+#pragma pack_matrix(column_major)
+
+[[vk::binding(0, 0)]]
+cbuffer UniformBufferObject {
+    float4x4 view;
+    float4x4 proj;
+    float3   camPos;
+};
+
+struct ObjectData {
+    float4x4 world;
+    float4x4 normal;
+    float4   boundsCenter;
+    float4   boundsExtent;
+    uint     materialIndex;
+};
+[[vk::binding(0, 1)]] StructuredBuffer<ObjectData> objects;
+
+// The GBuffer pass tests its fragments for equality against the depth written here, so the position must be computed
+// exactly as in offscreen.vert. Both are marked precise to keep the compiler from reordering or fusing the operations.
+float4 main([[vk::location(0)]] float3 inPos : POSITION, uint instanceID : SV_InstanceID) : SV_Position {
+    precise float4 worldPos = mul(objects[instanceID].world, float4(inPos, 1.0));
+    precise float4 position = mul(proj, mul(view, worldPos));
+    return position;
+}
@@ -0,0 +1,38 @@
+// Reduce the camera depth buffer to its min and max depth, ignoring the sky.
+// Depths are positive floats, whose bit patterns sort the same way as the floats themselves. They can thus be reduced with uint atomics.
+
+[[vk::combinedImageSampler]] [[vk::binding(0, 0)]] Texture2D<float> texDepth;
+[[vk::combinedImageSampler]] [[vk::binding(0, 0)]] SamplerState     texDepthState;
+
+// [0] = min depth, [1] = max depth. Reset to (0xFFFFFFFF, 0) by the CPU before each reduction.
+[[vk::binding(1, 0)]] RWStructuredBuffer<uint> result;
+
+groupshared uint groupMin;
+groupshared uint groupMax;
+
+[numthreads(16, 16, 1)]
+void main(uint3 id : SV_DispatchThreadID, uint index : SV_GroupIndex) {
+    if (index == 0) {
+        groupMin = 0xFFFFFFFF;
+        groupMax = 0;
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    uint width, height;
+    texDepth.GetDimensions(width, height);
+
+    // Reversed-z: the sky is cleared to 0 and is skipped.
+    if (id.x < width && id.y < height) {
+        const float depth = texDepth.Load(int3(id.xy, 0));
+        if (depth > 0.0) {
+            InterlockedMin(groupMin, asuint(depth));
+            InterlockedMax(groupMax, asuint(depth));
+        }
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    if (index == 0 && groupMin <= groupMax) {
+        InterlockedMin(result[0], groupMin);
+        InterlockedMax(result[1], groupMax);
+    }
+}
@@ -0,0 +1,64 @@
+// Convert tiles of the shadow atlas to exponential variance shadow map (EVSM) moments, and blur them with a separable gaussian.
+// Moments are stored at half the atlas resolution. Each moment texel averages the moments of a 2x2 block of depth texels.
+//
+// Pass 0: read depth, warp it to moments, and blur horizontally into the intermediate texture.
+// Pass 1: blur the intermediate texture vertically into the moment atlas.
+
+[[vk::combinedImageSampler]] [[vk::binding(0, 0)]] Texture2D<float> texDepth;
+[[vk::combinedImageSampler]] [[vk::binding(0, 0)]] SamplerState     texDepthState;
+
+[[vk::binding(1, 0)]] [[vk::image_format("rg32f")]] RWTexture2D<float2> intermediate;
+[[vk::binding(2, 0)]] [[vk::image_format("rg32f")]] RWTexture2D<float2> moments;
+
+struct PushConstants {
+    int2  tileOffset;   // tile bounds, in moment texels
+    int2  tileSize;
+    uint  pass;
+    int   radius;       // blur radius, in moment texels
+    float exponent;
+};
+[[vk::push_constant]] PushConstants pc;
+
+// Shadow map depth increases toward the light. Warp the distance from the light, remapped to [-1, 1], with the positive exponential.
+float2 WarpDepth(float depth) {
+    float t   = 1.0 - 2.0 * depth;
+    float pos = exp(pc.exponent * t);
+    return float2(pos, pos * pos);
+}
+
+float2 LoadMoments(int2 texel) {
+    int2 p = texel * 2;
+    return 0.25 * (WarpDepth(texDepth.Load(int3(p + int2(0, 0), 0)))
+                 + WarpDepth(texDepth.Load(int3(p + int2(1, 0), 0)))
+                 + WarpDepth(texDepth.Load(int3(p + int2(0, 1), 0)))
+                 + WarpDepth(texDepth.Load(int3(p + int2(1, 1), 0))));
+}
+
+[numthreads(8, 8, 1)]
+void main(uint3 id : SV_DispatchThreadID) {
+    if (any(id.xy >= uint2(pc.tileSize))) return;
+
+    const int2 texel = pc.tileOffset + int2(id.xy);
+    const int2 dir   = pc.pass == 0 ? int2(1, 0) : int2(0, 1);
+
+    // Taps are clamped to the tile, so neighbouring cascades never bleed into each other.
+    const int2 tileMin = pc.tileOffset;
+    const int2 tileMax = pc.tileOffset + pc.tileSize - 1;
+
+    const float sigma = max(pc.radius * 0.5, 0.5);
+
+    float2 sum    = 0.0;
+    float  weight = 0.0;
+    for (int i = -pc.radius; i <= pc.radius; i++) {
+        const int2  tap = clamp(texel + dir * i, tileMin, tileMax);
+        const float w   = exp(-(i * i) / (2.0 * sigma * sigma));
+
+        sum    += w * (pc.pass == 0 ? LoadMoments(tap) : intermediate[tap]);
+        weight += w;
+    }
+
+    if (pc.pass == 0)
+        intermediate[texel] = sum / weight;
+    else
+        moments[texel] = sum / weight;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+// GBuffer layout, shared by the passes writing and reading it:
+//   0: RGBA8_UNORM   albedo (rgb), metallic (a)
+//   1: RG16_UNORM    view space normal, octahedral encoded
+//   2: RG8_UNORM     roughness (r), baked AO (g)
+
+// Sign of each component, treating zero as positive.
+float2 sign_not_zero(float2 v) {
+    return float2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+float2 oct_wrap(float2 v) {
+    return (1.0 - abs(v.yx)) * sign_not_zero(v);
+}
+
+// Map a unit vector onto the octahedron, unfolded onto the [0, 1] square.
+float2 encode_normal(float3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    n.xy = n.z >= 0.0 ? n.xy : oct_wrap(n.xy);
+    return n.xy * 0.5 + 0.5;
+}
+
+float3 decode_normal(float2 e) {
+    e = e * 2.0 - 1.0;
+
+    // Folding the lower hemisphere back is a per-component offset, so no branch is needed.
+    float3 n = float3(e, 1.0 - abs(e.x) - abs(e.y));
+    float  t = saturate(-n.z);
+    n.xy -= sign_not_zero(n.xy) * t;
+    return normalize(n);
+}
@@ -1,5 +1,7 @@
 #pragma pack_matrix(column_major)
 
+#include "gbuffer.hlsli"
+
 // TODO: Just use push constants instead here
 [[vk::binding(0, 0)]]
 cbuffer GTAO_UBO
@@ -12,7 +14,7 @@ cbuffer GTAO_UBO
 
 [[vk::combinedImageSampler]] [[vk::binding(0, 1)]] Texture2D<float4> texDepth;
 [[vk::combinedImageSampler]] [[vk::binding(0, 1)]] SamplerState      texDepthState;
-[[vk::combinedImageSampler]] [[vk::binding(1, 1)]] Texture2D<float4> texNormal;
+[[vk::combinedImageSampler]] [[vk::binding(1, 1)]] Texture2D<float2> texNormal;
 [[vk::combinedImageSampler]] [[vk::binding(1, 1)]] SamplerState      texNormalState;
 
 static const float PI      = 3.14159265359f;
@@ -50,7 +52,7 @@ float4 main([[vk::location(0)]] float2 inUV : TEXCOORD0, float4 svPos : SV_Posit
     
     const float3 cPosV = ViewspacePosFromDepthBuffer(inUV);
     const float3 viewV = (float3)normalize(-cPosV);
-    const float3 normalV = normalize(texNormal.Sample(texNormalState, inUV).xyz * 2.0 - 1.0);
+    const float3 normalV = decode_normal(texNormal.Sample(texNormalState, inUV));
     
     // proj[0][0] = 1/(aspect*tan(fovY/2)), proj[1][1] = 1/tan(fovY/2).
     // Dividing 2 by each gives the NDC-to-viewspace scale per axis.
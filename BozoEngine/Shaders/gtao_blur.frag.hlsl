@@ -31,6 +31,9 @@ float4 main([[vk::location(0)]] float2 inUV : TEXCOORD0) : SV_Target0 {
             float sampleAO    = texAO.Sample(texAOState, sampleUV).r;
             float sampleDepth = texDepth.Sample(texDepthState, sampleUV).r;
 
+            // Sky pixels (reversed-z depth 0) are skipped by the GTAO pass, and hold no AO
+            if (sampleDepth == 0.0) continue;
+
             // Bilateral weight: suppress blurring across depth discontinuities
             float depthDiff = abs(centerDepth - sampleDepth);
             float bilateralW = exp(-depthDiff * depthDiff * 10000.0);
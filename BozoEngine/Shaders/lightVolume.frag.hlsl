@@ -0,0 +1,15 @@
+#include "deferred.hlsli"
+
+// Additive contribution of the point light pc.lightIndex, drawn as a full-screen triangle with deferred.vert.hlsl.
+// The scissor and depth bounds are set to the screen space bounds of the light's sphere, so only pixels that may lie
+// inside it are shaded. Pixels inside the bounds but outside the sphere are discarded.
+float4 main([[vk::location(0)]] float2 inUV : TEXCOORD0) : SV_Target0 {
+    PointLight light = pointLights[pc.lightIndex];
+    Surface s = load_surface(inUV);
+
+    float3 d = light.positionRadius.xyz - s.p;
+    if (dot(d, d) >= light.positionRadius.w * light.positionRadius.w)
+        discard;
+
+    return float4(shade_point_light(light, s) * direct_ao(s), 1.0);
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "gbuffer.hlsli"
+
+// Material evaluation shared by the passes writing the GBuffer: the offscreen GBuffer pass, and the material resolve of
+// the visibility buffer. Material textures are bound to set 1, and the per-material data to binding 1 of the draw data.
+
+[[vk::combinedImageSampler]] [[vk::binding(0, 1)]] Texture2D<float4> samplerAlbedo;
+[[vk::combinedImageSampler]] [[vk::binding(0, 1)]] SamplerState      samplerAlbedoState;
+[[vk::combinedImageSampler]] [[vk::binding(1, 1)]] Texture2D<float4> samplerNormal;
+[[vk::combinedImageSampler]] [[vk::binding(1, 1)]] SamplerState      samplerNormalState;
+[[vk::combinedImageSampler]] [[vk::binding(2, 1)]] Texture2D<float4> samplerMetallicRoughness;
+[[vk::combinedImageSampler]] [[vk::binding(2, 1)]] SamplerState      samplerMetallicRoughnessState;
+
+struct MaterialData {
+    uint  parallaxMode;
+    uint  parallaxSteps;
+    float parallaxScale;
+};
+[[vk::binding(1, 2)]] StructuredBuffer<MaterialData> materials;
+
+// Material of the surface being shaded. Loaded once by write_gbuffer.
+static MaterialData material;
+
+// Screen space derivatives of the unmodified texture coordinates. Every texture is sampled with these gradients, so
+// sampling is well defined inside the parallax loops, and in passes that can't rely on implicit derivatives.
+static float2 uvDdx;
+static float2 uvDdy;
+
+struct MaterialInput {
+    float3 normal;          // world space, not normalized
+    float4 tangent;         // world space, with the bitangent sign in w
+    float2 uv;
+    float2 uvDdx;
+    float2 uvDdy;
+    float3 tangentViewDir;  // tangent space direction towards the camera
+};
+
+struct GBufferOutput {
+    [[vk::location(0)]] float4 albedo      : SV_Target0;
+    [[vk::location(1)]] float2 normal      : SV_Target1;
+    [[vk::location(2)]] float2 roughnessAO : SV_Target2;
+};
+
+float4 sample_normal_map(float2 uv) {
+    return samplerNormal.SampleGrad(samplerNormalState, uv, uvDdx, uvDdy);
+}
+
+float3 get_view_space_normal(MaterialInput input, float2 uv, float4x4 worldToView) {
+    float3 n = normalize(input.normal);
+    float3 t = normalize(input.tangent.xyz - n * dot(input.tangent.xyz, n));
+    float3 b = cross(n, t) * input.tangent.w;
+    float3x3 tbn = float3x3(t, b, n);
+    float3 worldSpaceNormal = mul(sample_normal_map(uv).xyz * 2.0 - 1.0, tbn);
+    return normalize(mul(worldToView, float4(worldSpaceNormal, 0.0)).xyz);
+}
+
+float2 parallax(float2 uv, float3 vdir) {
+    float height = 1.0 - sample_normal_map(uv).a;
+    return uv - vdir.xy * height * material.parallaxScale;
+}
+
+float2 fged_parallax(float2 uv, float3 vdir) {
+    const int k = int(material.parallaxSteps);
+    uint w, h, mips;
+    samplerNormal.GetDimensions(0, w, h, mips);
+    float2 scale = (material.parallaxScale * 5000.0f) / (float2(w, h) * 2.0f * float(k));
+    float2 pdir = vdir.xy * scale;
+    for (int i = 0; i < k; i++) {
+        float4 s = sample_normal_map(uv);
+        float p = (s.z * 2.0 - 1.0) * (1.0 - s.a);
+        uv -= pdir * p;
+    }
+    return uv;
+}
+
+float2 steep_parallax(float2 uv, float3 vdir) {
+    const float minLayers = min(8.0f, (float)material.parallaxSteps);
+    const float maxLayers = (float)material.parallaxSteps;
+    float numLayers = lerp(maxLayers, minLayers, max(dot(float3(0.0, 0.0, 1.0), vdir), 0.0));
+    float layerDepth = 1.0 / numLayers;
+    float currentLayerDepth = 0.0;
+    float2 deltaUV = vdir.xy * material.parallaxScale / numLayers;
+    float currentDepth = 1.0 - sample_normal_map(uv).a;
+    while (currentLayerDepth < currentDepth) {
+        uv -= deltaUV;
+        currentDepth = 1.0 - sample_normal_map(uv).a;
+        currentLayerDepth += layerDepth;
+    }
+    return uv;
+}
+
+float2 parallax_occlusion(float2 uv, float3 vdir) {
+    float numLayers = (float)material.parallaxSteps;
+    float layerDepth = 1.0 / numLayers;
+    float currentLayerDepth = 0.0;
+    float2 deltaUV = vdir.xy * material.parallaxScale / numLayers;
+    float2 currentUV = uv;
+    float currentDepth = 1.0 - sample_normal_map(currentUV).a;
+    while (currentLayerDepth < currentDepth) {
+        currentUV -= deltaUV;
+        currentDepth = 1.0 - sample_normal_map(currentUV).a;
+        currentLayerDepth += layerDepth;
+    }
+    float2 prevUV = currentUV + deltaUV;
+    float nextDepth = currentDepth - currentLayerDepth;
+    float prevDepth = 1.0 - sample_normal_map(prevUV).a - currentLayerDepth + layerDepth;
+    return lerp(currentUV, prevUV, nextDepth / (nextDepth - prevDepth));
+}
+
+// Evaluate the material at the surface, and pack it into the GBuffer layout. Discards the pixel if parallax mapping
+// pushes the texture coordinates outside the texture.
+GBufferOutput write_gbuffer(MaterialInput input, uint materialIndex, float4x4 worldToView) {
+    material = materials[materialIndex];
+    uvDdx    = input.uvDdx;
+    uvDdy    = input.uvDdy;
+
+    float3 tangentViewDir = input.tangentViewDir;
+    tangentViewDir.y *= -1.0;
+
+    float2 uv = input.uv;
+    if (material.parallaxMode > 0) {
+        switch (material.parallaxMode) {
+            case 1: uv = parallax(input.uv, tangentViewDir);           break;
+            case 2: uv = fged_parallax(input.uv, tangentViewDir);      break;
+            case 3: uv = steep_parallax(input.uv, tangentViewDir);     break;
+            case 4: uv = parallax_occlusion(input.uv, tangentViewDir); break;
+            default: break;
+        }
+        if (uv.x < 0.0 || uv.x > 1.0 || uv.y < 0.0 || uv.y > 1.0) discard;
+    }
+
+    // Baked AO (r), roughness (g) and metallic (b).
+    float3 orm = samplerMetallicRoughness.SampleGrad(samplerMetallicRoughnessState, uv, uvDdx, uvDdy).xyz;
+
+    GBufferOutput output;
+    output.albedo      = float4(samplerAlbedo.SampleGrad(samplerAlbedoState, uv, uvDdx, uvDdy).rgb, orm.b);
+    output.normal      = encode_normal(get_view_space_normal(input, uv, worldToView));
+    output.roughnessAO = orm.gr;
+    return output;
+}
@@ -0,0 +1,24 @@
+#include "visibility.hlsli"
+
+// Write the material slot of every pixel covered by one of the model's draws to the material depth buffer.
+// Drawn once per model, with the model's draw data bound.
+
+[[vk::combinedImageSampler]] [[vk::binding(0, 0)]] Texture2D<uint> visibility;
+[[vk::combinedImageSampler]] [[vk::binding(0, 0)]] SamplerState    visibilityState;
+
+[[vk::binding(0, 1)]] StructuredBuffer<ObjectData> objects;
+
+struct PushConstants {
+    uint drawOffset;    // global index of the model's first draw
+    uint drawCount;
+    uint firstMaterial; // global slot of the model's first material
+};
+[[vk::push_constant]] PushConstants pc;
+
+float main(float4 position : SV_Position) : SV_Depth {
+    // Empty pixels and the draws of other models wrap around to indices past drawCount.
+    const uint draw = visibility_draw(visibility.Load(int3(position.xy, 0))) - pc.drawOffset;
+    if (draw >= pc.drawCount) discard;
+
+    return material_depth(pc.firstMaterial + objects[draw].materialIndex);
+}
@@ -1,5 +1,7 @@
 #pragma pack_matrix(column_major)
 
+#include "vertex.hlsli"
+
 [[vk::binding(0, 0)]]
 cbuffer UniformBufferObject {
     float4x4 view;
@@ -7,47 +9,56 @@ cbuffer UniformBufferObject {
     float3   camPos;
 };
 
-struct PrimitivePC {
-    float4x4 model;
-    uint     parallaxMode;
-    uint     parallaxSteps;
-    float    parallaxScale;
+struct ObjectData {
+    float4x4 world;
+    float4x4 normal;
+    float4   boundsCenter;
+    float4   boundsExtent;
+    uint     materialIndex;
 };
-[[vk::push_constant]] PrimitivePC primitive;
+[[vk::binding(0, 2)]] StructuredBuffer<ObjectData> objects;
 
 struct VSInput {
-    [[vk::location(0)]] float3 inPos     : POSITION;
-    [[vk::location(1)]] float3 inNormal  : NORMAL;
-    [[vk::location(2)]] float4 inTangent : TANGENT;
-    [[vk::location(3)]] float2 inUV      : TEXCOORD0;
-    [[vk::location(4)]] float3 inColor   : COLOR;
+    [[vk::location(0)]] float3 inPos           : POSITION;
+    [[vk::location(1)]] float4 inNormalTangent : NORMAL;
+    [[vk::location(2)]] float2 inUV            : TEXCOORD0;
+    uint instanceID : SV_InstanceID;
 };
 
 struct VSOutput {
     float4 Position : SV_Position;
     [[vk::location(0)]] float3 outNormal          : NORMAL;
     [[vk::location(1)]] float4 outTangent         : TANGENT;
-    [[vk::location(2)]] float3 outColor           : COLOR;
-    [[vk::location(3)]] float2 outUV              : TEXCOORD0;
-    [[vk::location(4)]] float3 outTangentViewPos  : TEXCOORD1;
-    [[vk::location(5)]] float3 outTangentFragPos  : TEXCOORD2;
+    [[vk::location(2)]] float2 outUV              : TEXCOORD0;
+    [[vk::location(3)]] float3 outTangentViewPos  : TEXCOORD1;
+    [[vk::location(4)]] float3 outTangentFragPos  : TEXCOORD2;
+    [[vk::location(5)]] nointerpolation uint outMaterialIndex : MATERIAL;
 };
 
 VSOutput main(VSInput input) {
-    VSOutput output;
-    output.Position = mul(proj, mul(view, mul(primitive.model, float4(input.inPos, 1.0))));
-    output.outNormal  = input.inNormal;
-    output.outTangent = input.inTangent;
-    output.outColor   = input.inColor;
-    output.outUV      = input.inUV;
+    // Draws are issued with firstInstance set to the draw index, so the instance index selects the object data.
+    ObjectData object = objects[input.instanceID];
+    // Must match depthPrepass.vert, whose depth the GBuffer pass is tested against for equality.
+    precise float4 worldPos = mul(object.world, float4(input.inPos, 1.0));
+    precise float4 position = mul(proj, mul(view, worldPos));
+
+    float3 normal;
+    float4 tangent;
+    decode_tangent_frame(input.inNormalTangent, normal, tangent);
 
-    float3x3 modelMat = (float3x3)primitive.model;
-    float3 N = normalize(mul(modelMat, input.inNormal));
-    float3 T = normalize(mul(modelMat, input.inTangent.xyz));
-    float3 B = normalize(cross(N, T) * input.inTangent.w);
+    float3 N = normalize(mul((float3x3)object.normal, normal));
+    float3 T = normalize(mul((float3x3)object.world, tangent.xyz));
+    float3 B = normalize(cross(N, T) * tangent.w);
     float3x3 TBN = float3x3(T, B, N);
 
+    VSOutput output;
+    output.Position = position;
+    output.outNormal  = N;
+    output.outTangent = float4(T, tangent.w);
+    output.outUV      = input.inUV;
+    output.outMaterialIndex = object.materialIndex;
+
     output.outTangentViewPos = mul(TBN, camPos);
-    output.outTangentFragPos = mul(TBN, mul(primitive.model, float4(input.inPos, 1.0)).xyz);
+    output.outTangentFragPos = mul(TBN, worldPos.xyz);
     return output;
 }
@@ -5,9 +5,15 @@ cbuffer UniformBufferObject {
     float4x4 viewProj;
 };
 
-struct PushConstants { float4x4 model; };
-[[vk::push_constant]] PushConstants primitive;
+struct ObjectData {
+    float4x4 world;
+    float4x4 normal;
+    float4   boundsCenter;
+    float4   boundsExtent;
+    uint     materialIndex;
+};
+[[vk::binding(0, 1)]] StructuredBuffer<ObjectData> objects;
 
-float4 main([[vk::location(0)]] float3 inPos : POSITION) : SV_Position {
-    return mul(viewProj, mul(primitive.model, float4(inPos, 1.0)));
+float4 main([[vk::location(0)]] float3 inPos : POSITION, uint instanceID : SV_InstanceID) : SV_Position {
+    return mul(viewProj, mul(objects[instanceID].world, float4(inPos, 1.0)));
 }
@@ -0,0 +1,43 @@
+#pragma pack_matrix(column_major)
+
+#define MAX_CASCADES 8
+
+// Cascade matrices are stored 256 bytes apart in the cascade UBO, to allow binding each of them with a dynamic offset.
+struct Cascade {
+    float4x4 viewProj;
+    float4   padding[12];
+};
+
+[[vk::binding(0, 0)]]
+cbuffer UniformBufferObject {
+    Cascade cascades[MAX_CASCADES];
+};
+
+struct ObjectData {
+    float4x4 world;
+    float4x4 normal;
+    float4   boundsCenter;
+    float4   boundsExtent;
+    uint     materialIndex;
+};
+[[vk::binding(0, 1)]] StructuredBuffer<ObjectData> objects;
+
+struct VSOutput {
+    float4 pos   : SV_Position;
+    uint   viewport : SV_ViewportArrayIndex;   // cascade k is rendered to its atlas tile through viewport k
+};
+
+// Each draw is instanced over the cascades it is visible in. The instance index is (draw << 16) | (cascadeMask << 8) | n,
+// and the n-th set bit of cascadeMask is the cascade of this instance. See GLTFModel::CullLayered.
+VSOutput main([[vk::location(0)]] float3 inPos : POSITION, uint instanceID : SV_InstanceID) {
+    const uint draw = instanceID >> 16;
+    uint mask = (instanceID >> 8) & 0xFF;
+
+    for (uint n = instanceID & 0xFF; n > 0; n--)
+        mask &= mask - 1;
+
+    VSOutput output;
+    output.viewport = firstbitlow(mask);
+    output.pos      = mul(cascades[output.viewport].viewProj, mul(objects[draw].world, float4(inPos, 1.0)));
+    return output;
+}
@@ -0,0 +1,98 @@
+#include "deferred.hlsli"
+
+// Tiled deferred shading in compute. Each group shades a 16x16 pixel tile: it reduces the view space depth range of the
+// tile in groupshared memory, culls the point lights against the bounding box of the tile between those depths, and
+// shades its pixels with the resulting light list.
+
+#define TILE_SIZE 16
+#define MAX_LIGHTS_PER_TILE 256
+
+[[vk::binding(0, 5)]] [[vk::image_format("rgba16f")]] RWTexture2D<float4> output;
+
+groupshared uint tileMinZ;
+groupshared uint tileMaxZ;
+groupshared uint tileLightCount;
+groupshared uint tileLights[MAX_LIGHTS_PER_TILE];
+
+// View space direction through a point in normalized device coordinates, scaled to unit depth.
+float3 ViewRay(float2 ndc) {
+    float4 p = mul(invProj, float4(ndc, 1.0, 1.0));
+    return p.xyz / p.z;
+}
+
+bool SphereIntersectsAABB(float4 sphere, float3 aabbMin, float3 aabbMax) {
+    float3 d = max(aabbMin - sphere.xyz, 0.0) + max(sphere.xyz - aabbMax, 0.0);
+    return dot(d, d) <= sphere.w * sphere.w;
+}
+
+[numthreads(TILE_SIZE, TILE_SIZE, 1)]
+void main(uint3 id : SV_DispatchThreadID, uint3 group : SV_GroupID, uint index : SV_GroupIndex) {
+    uint width, height;
+    output.GetDimensions(width, height);
+
+    const bool   inside = id.x < width && id.y < height;
+    const float2 uv     = (float2(id.xy) + 0.5) / float2(width, height);
+
+    if (index == 0) {
+        tileMinZ = 0xFFFFFFFF;
+        tileMaxZ = 0;
+        tileLightCount = 0;
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    // Reversed-z: the sky is cleared to 0 and does not contribute to the depth range. View space depths are positive
+    // floats, whose bit patterns sort the same way as the floats themselves.
+    Surface s = load_surface(uv);
+    const float depth = samplerDepth.SampleLevel(samplerDepthState, uv, 0).r;
+    if (inside && depth > 0.0) {
+        InterlockedMin(tileMinZ, asuint(s.p.z));
+        InterlockedMax(tileMaxZ, asuint(s.p.z));
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    // Cull the lights against the bounding box of the tile, spread over all threads of the group.
+    if (pc.renderMode == 0 && tileMinZ <= tileMaxZ) {
+        const float zMin = asfloat(tileMinZ);
+        const float zMax = asfloat(tileMaxZ);
+
+        const float2 ndcMin = float2(group.xy * TILE_SIZE)       / float2(width, height) * 2.0 - 1.0;
+        const float2 ndcMax = float2((group.xy + 1) * TILE_SIZE) / float2(width, height) * 2.0 - 1.0;
+
+        const float3 rays[4] = { ViewRay(ndcMin), ViewRay(float2(ndcMax.x, ndcMin.y)), ViewRay(float2(ndcMin.x, ndcMax.y)), ViewRay(ndcMax) };
+
+        float3 aabbMin = rays[0] * zMin;
+        float3 aabbMax = rays[0] * zMin;
+        for (uint i = 0; i < 4; i++) {
+            aabbMin = min(aabbMin, min(rays[i] * zMin, rays[i] * zMax));
+            aabbMax = max(aabbMax, max(rays[i] * zMin, rays[i] * zMax));
+        }
+
+        for (uint light = index; light < clusters.lightCount; light += TILE_SIZE * TILE_SIZE) {
+            if (SphereIntersectsAABB(pointLights[light].positionRadius, aabbMin, aabbMax)) {
+                uint slot;
+                InterlockedAdd(tileLightCount, 1, slot);
+                if (slot < MAX_LIGHTS_PER_TILE)
+                    tileLights[slot] = light;
+            }
+        }
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    if (!inside) return;
+
+    if (pc.renderMode != 0) {
+        output[id.xy] = debug_view(uv);
+        return;
+    }
+
+    // Sky pixels are overwritten by the skybox pass.
+    if (depth == 0.0) return;
+
+    float3 pointLighting = 0.0;
+    const uint count = min(tileLightCount, MAX_LIGHTS_PER_TILE);
+    for (uint i = 0; i < count; i++) {
+        pointLighting += shade_point_light(pointLights[tileLights[i]], s);
+    }
+
+    output[id.xy] = shade_surface(s, float2(id.xy) + 0.5, pointLighting);
+}
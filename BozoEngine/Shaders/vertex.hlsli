@@ -0,0 +1,30 @@
+#pragma once
+
+#include "gbuffer.hlsli"
+
+// Compact GLTFModel vertex attributes, must match GLTFModel::Vertex. Positions are stored in their own float stream.
+//   RGBA16_SNORM  octahedral normal (xy) and tangent (zw). The tangent's y is remapped to (0, 1], and signed by the
+//                 bitangent sign.
+//   RG16_SFLOAT   texture coordinates
+#define VERTEX_STRIDE 12
+
+// Octahedral encoding as in the GBuffer, but over [-1, 1].
+float3 decode_octahedral(float2 e) {
+    return decode_normal(e * 0.5 + 0.5);
+}
+
+void decode_tangent_frame(float4 packed, out float3 normal, out float4 tangent) {
+    normal      = decode_octahedral(packed.xy);
+    tangent.xyz = decode_octahedral(float2(packed.z, abs(packed.w) * 2.0 - 1.0));
+    tangent.w   = packed.w < 0.0 ? -1.0 : 1.0;
+}
+
+// Unpack two 16 bit values packed into a uint, as loaded from a ByteAddressBuffer. x is in the low bits.
+float2 unpack_snorm2x16(uint v) {
+    const int2 i = int2(v << 16, v) >> 16;
+    return max(float2(i) / 32767.0, -1.0);
+}
+
+float2 unpack_half2x16(uint v) {
+    return float2(f16tof32(v & 0xFFFF), f16tof32(v >> 16));
+}
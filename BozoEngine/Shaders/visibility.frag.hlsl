@@ -0,0 +1,11 @@
+#include "visibility.hlsli"
+
+struct PushConstants {
+    uint drawOffset;    // global index of the model's first draw
+};
+[[vk::push_constant]] PushConstants pc;
+
+// SV_PrimitiveID restarts at 0 for every draw of a multi-draw, so it is the triangle within the draw.
+uint main([[vk::location(0)]] nointerpolation uint inDraw : DRAW, uint primitiveID : SV_PrimitiveID) : SV_Target0 {
+    return pack_visibility(pc.drawOffset + inDraw, primitiveID);
+}
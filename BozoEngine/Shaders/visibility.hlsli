@@ -0,0 +1,39 @@
+#pragma once
+
+// Visibility buffer encoding, must match VisibilityBuffer. Each pixel holds the triangle covering it: the draw in the
+// upper bits, offset by one so 0 marks pixels no triangle was drawn to, and the triangle within the draw in the lower bits.
+// Draws are numbered globally; the draws of each model are offset by the draws of the models rendered before it.
+#define VISIBILITY_TRIANGLE_BITS 20
+#define VISIBILITY_TRIANGLE_MASK ((1u << VISIBILITY_TRIANGLE_BITS) - 1)
+
+// Materials are numbered globally the same way. Material slot k is resolved by depth testing a full-screen triangle at
+// material_depth(k) against the material depth buffer. These depths are exact in a 32 bit float depth buffer.
+#define MAX_MATERIAL_SLOTS 4095
+
+struct ObjectData {
+    float4x4 world;
+    float4x4 normal;
+    float4   boundsCenter;
+    float4   boundsExtent;
+    uint     materialIndex;
+    uint     firstIndex;
+    uint     vertexOffset;
+};
+
+uint pack_visibility(uint draw, uint tri) {
+    return ((draw + 1) << VISIBILITY_TRIANGLE_BITS) | (tri & VISIBILITY_TRIANGLE_MASK);
+}
+
+// Global draw index of a visibility value. Wraps to ~0u for empty pixels.
+uint visibility_draw(uint visibility) {
+    return (visibility >> VISIBILITY_TRIANGLE_BITS) - 1;
+}
+
+uint visibility_triangle(uint visibility) {
+    return visibility & VISIBILITY_TRIANGLE_MASK;
+}
+
+// The material depth buffer is cleared to 0, which no material slot maps to.
+float material_depth(uint slot) {
+    return float(slot + 1) / float(MAX_MATERIAL_SLOTS + 1);
+}
@@ -0,0 +1,25 @@
+#pragma pack_matrix(column_major)
+
+#include "visibility.hlsli"
+
+[[vk::binding(0, 0)]]
+cbuffer UniformBufferObject {
+    float4x4 view;
+    float4x4 proj;
+    float3   camPos;
+};
+
+[[vk::binding(0, 1)]] StructuredBuffer<ObjectData> objects;
+
+struct VSOutput {
+    float4 Position : SV_Position;
+    [[vk::location(0)]] nointerpolation uint outDraw : DRAW;
+};
+
+// Only the position is read. Every other attribute is fetched by the material resolve, for the visible triangles only.
+VSOutput main([[vk::location(0)]] float3 inPos : POSITION, uint instanceID : SV_InstanceID) {
+    VSOutput output;
+    output.Position = mul(proj, mul(view, mul(objects[instanceID].world, float4(inPos, 1.0))));
+    output.outDraw  = instanceID;
+    return output;
+}
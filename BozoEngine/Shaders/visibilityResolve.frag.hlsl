@@ -0,0 +1,146 @@
+#pragma pack_matrix(column_major)
+
+#include "material.hlsli"
+#include "vertex.hlsli"
+#include "visibility.hlsli"
+
+// Material resolve of the visibility buffer. Drawn once per material, covering only the pixels of the material, it
+// refetches the triangle of each pixel, interpolates its vertex attributes and writes the material to the GBuffer.
+// Parallax mapped materials may discard, so they are rasterized after the resolve instead, and never resolved here.
+
+[[vk::binding(0, 0)]]
+cbuffer UniformBufferObject {
+    float4x4 view;
+    float4x4 proj;
+    float3   camPos;
+};
+
+// Draw data of the model: object data, material data (material.hlsli), and the model's position, vertex attribute and index buffers.
+[[vk::binding(0, 2)]] StructuredBuffer<ObjectData> objects;
+[[vk::binding(2, 2)]] ByteAddressBuffer positions;
+[[vk::binding(3, 2)]] ByteAddressBuffer vertices;
+[[vk::binding(4, 2)]] ByteAddressBuffer indices;
+
+[[vk::combinedImageSampler]] [[vk::binding(0, 3)]] Texture2D<uint> visibility;
+[[vk::combinedImageSampler]] [[vk::binding(0, 3)]] SamplerState    visibilityState;
+
+struct PushConstants {
+    uint drawOffset;    // global index of the model's first draw
+    uint materialSlot;  // global slot of the material being resolved
+    uint shortIndices;  // whether the model's indices are 16 bit
+};
+[[vk::push_constant]] PushConstants pc;
+
+// Positions are stored in their own stream. See vertex.hlsli for the layout of the other attributes.
+#define POSITION_STRIDE 12
+
+// Indices are relative to the first vertex of the draw. 16 bit indices are packed two to a word.
+uint load_index(uint i) {
+    if (!pc.shortIndices)
+        return indices.Load(i * 4);
+
+    const uint word = indices.Load((i * 2) & ~3u);
+    return (i & 1) ? word >> 16 : word & 0xFFFF;
+}
+
+struct Vertex {
+    float3 pos;
+    float3 normal;
+    float4 tangent;
+    float2 uv;
+};
+
+Vertex load_vertex(uint index) {
+    const uint3 packed = vertices.Load3(index * VERTEX_STRIDE);
+
+    Vertex v;
+    v.pos = asfloat(positions.Load3(index * POSITION_STRIDE));
+    v.uv  = unpack_half2x16(packed.z);
+    decode_tangent_frame(float4(unpack_snorm2x16(packed.x), unpack_snorm2x16(packed.y)), v.normal, v.tangent);
+    return v;
+}
+
+struct Barycentrics {
+    float3 lambda;  // perspective correct barycentrics of the pixel
+    float3 ddx;     // and their derivatives along the pixel x and y axes
+    float3 ddy;
+};
+
+// Barycentrics of the pixel at ndc within the triangle with clip space vertices p0, p1 and p2, on a target of the given size.
+// The derivatives are computed analytically, as neighbouring pixels of a quad may belong to other triangles.
+Barycentrics compute_barycentrics(float4 p0, float4 p1, float4 p2, float2 ndc, float2 size) {
+    const float3 invW = 1.0 / float3(p0.w, p1.w, p2.w);
+
+    const float2 ndc0 = p0.xy * invW.x;
+    const float2 ndc1 = p1.xy * invW.y;
+    const float2 ndc2 = p2.xy * invW.z;
+
+    // Gradients of the screen space barycentrics divided by w, along the ndc x and y axes.
+    const float  invDet = 1.0 / determinant(float2x2(ndc2 - ndc1, ndc0 - ndc1));
+    float3 dx = float3(ndc1.y - ndc2.y, ndc2.y - ndc0.y, ndc0.y - ndc1.y) * invDet * invW;
+    float3 dy = float3(ndc2.x - ndc1.x, ndc0.x - ndc2.x, ndc1.x - ndc0.x) * invDet * invW;
+    float  dxSum = dx.x + dx.y + dx.z;
+    float  dySum = dy.x + dy.y + dy.z;
+
+    // 1/w is affine in screen space, so it is interpolated from vertex 0 along the gradients.
+    const float2 delta      = ndc - ndc0;
+    const float  interpInvW = invW.x + delta.x * dxSum + delta.y * dySum;
+    const float  interpW    = 1.0 / interpInvW;
+
+    Barycentrics b;
+    b.lambda = interpW * (float3(invW.x, 0.0, 0.0) + delta.x * dx + delta.y * dy);
+
+    // One pixel is 2 / size in ndc. Vulkan ndc and pixel y both point down.
+    dx    *= 2.0 / size.x;
+    dy    *= 2.0 / size.y;
+    dxSum *= 2.0 / size.x;
+    dySum *= 2.0 / size.y;
+
+    // Perspective correct barycentrics of the neighbouring pixels, minus those of this pixel.
+    b.ddx = (b.lambda * interpInvW + dx) / (interpInvW + dxSum) - b.lambda;
+    b.ddy = (b.lambda * interpInvW + dy) / (interpInvW + dySum) - b.lambda;
+    return b;
+}
+
+float2 interpolate(float3 lambda, float2 a0, float2 a1, float2 a2) { return lambda.x * a0 + lambda.y * a1 + lambda.z * a2; }
+float3 interpolate(float3 lambda, float3 a0, float3 a1, float3 a2) { return lambda.x * a0 + lambda.y * a1 + lambda.z * a2; }
+
+GBufferOutput main(float4 position : SV_Position) {
+    const uint id = visibility.Load(int3(position.xy, 0));
+
+    const ObjectData object = objects[visibility_draw(id) - pc.drawOffset];
+    const uint  first = object.firstIndex + visibility_triangle(id) * 3;
+
+    const Vertex v0 = load_vertex(object.vertexOffset + load_index(first + 0));
+    const Vertex v1 = load_vertex(object.vertexOffset + load_index(first + 1));
+    const Vertex v2 = load_vertex(object.vertexOffset + load_index(first + 2));
+
+    const float3 w0 = mul(object.world, float4(v0.pos, 1.0)).xyz;
+    const float3 w1 = mul(object.world, float4(v1.pos, 1.0)).xyz;
+    const float3 w2 = mul(object.world, float4(v2.pos, 1.0)).xyz;
+
+    uint width, height;
+    visibility.GetDimensions(width, height);
+    const float2 size = float2(width, height);
+
+    const float4x4 viewProj = mul(proj, view);
+    const Barycentrics b = compute_barycentrics(mul(viewProj, float4(w0, 1.0)), mul(viewProj, float4(w1, 1.0)), mul(viewProj, float4(w2, 1.0)),
+                                                position.xy / size * 2.0 - 1.0, size);
+
+    const float3 worldPos = interpolate(b.lambda, w0, w1, w2);
+
+    // Same attributes as offscreen.vert passes to offscreen.frag.
+    const float3 N = normalize(mul((float3x3)object.normal, interpolate(b.lambda, v0.normal, v1.normal, v2.normal)));
+    const float3 T = normalize(mul((float3x3)object.world, interpolate(b.lambda, v0.tangent.xyz, v1.tangent.xyz, v2.tangent.xyz)));
+    const float3 B = normalize(cross(N, T) * v0.tangent.w);
+
+    MaterialInput surface;
+    surface.normal         = N;
+    surface.tangent        = float4(T, v0.tangent.w);
+    surface.uv             = interpolate(b.lambda, v0.uv, v1.uv, v2.uv);
+    surface.uvDdx          = interpolate(b.ddx, v0.uv, v1.uv, v2.uv);
+    surface.uvDdy          = interpolate(b.ddy, v0.uv, v1.uv, v2.uv);
+    surface.tangentViewDir = normalize(mul(float3x3(T, B, N), camPos - worldPos));
+
+    return write_gbuffer(surface, object.materialIndex, view);
+}
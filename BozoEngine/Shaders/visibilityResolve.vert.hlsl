@@ -0,0 +1,14 @@
+#include "visibility.hlsli"
+
+struct PushConstants {
+    uint drawOffset;    // global index of the model's first draw
+    uint materialSlot;  // global slot of the material being resolved
+};
+[[vk::push_constant]] PushConstants pc;
+
+// Full-screen triangle at the depth of the material slot. Tested for equality against the material depth buffer, it only
+// covers the pixels of the material.
+float4 main(uint vertexIndex : SV_VertexID) : SV_Position {
+    float2 uv = float2((vertexIndex << 1) & 2, vertexIndex & 2);
+    return float4(uv * 2.0f - 1.0f, material_depth(pc.materialSlot), 1.0f);
+}
@@ -18,13 +18,6 @@
 
 Device* Device::ptr = nullptr;
 
-// SGR escape sequences: https://docs.microsoft.com/en-us/windows/console/console-virtual-terminal-sequences
-#define SGR_SET_BG_GRAY  "\x1B[100;1m"
-#define SGR_SET_BG_BLUE	 "\x1B[44;1m"
-#define SGR_SET_BG_RED	 "\x1B[41;1m"
-#define SGR_SET_TXT_BLUE "\x1B[34;1m"
-#define SGR_SET_DEFAULT  "\x1B[0m"
-
 static VKAPI_ATTR VkBool32 VKAPI_CALL DebugCallback(
 	VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
 	VkDebugUtilsMessageTypeFlagsEXT messageType,
@@ -189,7 +182,10 @@ static VkDevice CreateLogicalDevice(VkPhysicalDevice physicalDevice, VkPhysicalD
 	};
 	VkPhysicalDeviceVulkan12Features features12 = {
 		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
-		.pNext = &features13
+		.pNext = &features13,
+		.drawIndirectCount = VK_TRUE,
+		.shaderOutputViewportIndex = VK_TRUE,	// SV_ViewportArrayIndex and SV_RenderTargetArrayIndex outside of geometry shaders
+		.shaderOutputLayer = VK_TRUE
 	};
 	VkPhysicalDeviceVulkan11Features features11 = {
 		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES,
@@ -261,16 +257,18 @@ static VmaAllocator CreateVmaAllocator(VkInstance instance, VkPhysicalDevice phy
     return allocator;
 }
 
-static VkDescriptorPool CreateDescriptorPool(VkDevice device, u32 maxBufferDescriptors, u32 maxDynamicBufferDescriptors, u32 maxImageDescriptors) {
+static VkDescriptorPool CreateDescriptorPool(VkDevice device, u32 maxBufferDescriptors, u32 maxDynamicBufferDescriptors, u32 maxImageDescriptors, u32 maxStorageDescriptors) {
 	VkDescriptorPoolSize poolSizes[] = {
 		{ .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,			.descriptorCount = maxBufferDescriptors },
 		{ .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,	.descriptorCount = maxDynamicBufferDescriptors },
-		{ .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,	.descriptorCount = maxImageDescriptors }
+		{ .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,	.descriptorCount = maxImageDescriptors },
+		{ .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,			.descriptorCount = maxStorageDescriptors },
+		{ .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,				.descriptorCount = maxStorageDescriptors }
 	};
 
 	VkDescriptorPoolCreateInfo poolInfo = {
 		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-		.maxSets = maxBufferDescriptors + maxImageDescriptors,
+		.maxSets = maxBufferDescriptors + maxImageDescriptors + maxStorageDescriptors,
 		.poolSizeCount = arraysize(poolSizes),
 		.pPoolSizes = poolSizes
 	};
@@ -303,9 +301,14 @@ VulkanDevice::VulkanDevice(Window* window) {
 
 	// Specify the vulkan features we want to enable
     features = {
-        .depthClamp         = VK_TRUE,
-        .depthBiasClamp     = VK_TRUE,
-        .samplerAnisotropy  = VK_TRUE
+        .geometryShader            = VK_TRUE,     // SV_PrimitiveID in fragment shaders, for the visibility buffer
+        .multiDrawIndirect         = VK_TRUE,
+        .drawIndirectFirstInstance = VK_TRUE,
+        .depthClamp                = VK_TRUE,
+        .depthBiasClamp            = VK_TRUE,
+        .depthBounds               = VK_TRUE,
+        .multiViewport             = VK_TRUE,
+        .samplerAnisotropy         = VK_TRUE
     };
 
 	// Get the physical device properties. Easy access to device limits, such as minUniformBufferOffsetAlignment.
@@ -326,7 +329,7 @@ VulkanDevice::VulkanDevice(Window* window) {
     vkGetDeviceQueue(vkDevice, m_transfer.index, 0, &m_transfer.queue);
 
 	// Create the global persistant descriptor pool
-	descriptorPool = CreateDescriptorPool(vkDevice, 100, 100, 100);
+	descriptorPool = CreateDescriptorPool(vkDevice, 100, 100, 100, 100);
 
 	// Create the VMA allocator
     vmaAllocator   = CreateVmaAllocator(m_instance, m_gpu, vkDevice);
@@ -351,7 +354,14 @@ VulkanDevice::VulkanDevice(Window* window) {
         VkCheck(vkCreateSemaphore  (vkDevice, &semaphoreInfo, nullptr, &frame.imageAvailable), "Failed to create RenderFrame imageAvailable semaphore");
 		VkCheck(vkCreateFence      (vkDevice, &fenceInfo,     nullptr, &frame.inFlight),       "Failed to create RenderFrame inFlight fence");
 	    VkCheck(vkCreateCommandPool(vkDevice, &poolInfo,      nullptr, &frame.commandPool),    "Failed to create RenderFrame command pool");
-        frame.descriptorPool = CreateDescriptorPool(vkDevice, 100, 1, 100);
+        frame.descriptorPool = CreateDescriptorPool(vkDevice, 100, 1, 100, 100);
+
+        VkQueryPoolCreateInfo queryPoolInfo = {
+            .sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .queryType  = VK_QUERY_TYPE_TIMESTAMP,
+            .queryCount = MaxTimestamps
+        };
+        VkCheck(vkCreateQueryPool(vkDevice, &queryPoolInfo, nullptr, &frame.timestampPool), "Failed to create RenderFrame timestamp query pool");
     }
 
 	// Create the swapchain
@@ -366,6 +376,7 @@ VulkanDevice::~VulkanDevice() {
         vkDestroyFence(vkDevice, frame.inFlight, nullptr);
         vkDestroyCommandPool(vkDevice, frame.commandPool, nullptr);
         vkDestroyDescriptorPool(vkDevice, frame.descriptorPool, nullptr);
+        vkDestroyQueryPool(vkDevice, frame.timestampPool, nullptr);
     }
 
 	vkDestroyDescriptorPool(vkDevice, descriptorPool, nullptr);
@@ -571,9 +582,19 @@ bool VulkanDevice::BeginFrame() {
 	VkCheck(vkResetCommandPool(vkDevice, frame().commandPool, 0), "Failed to reset frame command pool.");
 	VkCheck(vkResetDescriptorPool(vkDevice, frame().descriptorPool, 0), "Failed to reset frame descriptor pool");
 
+	// The fence guarantees the previous frame with this index has finished, so its timestamps can be read without waiting.
+	// Queries that were never written are simply unavailable. They must have been reset once before they can be read.
+	if (frame().timestampsReset) {
+		vkGetQueryPoolResults(vkDevice, frame().timestampPool, 0, MaxTimestamps, sizeof(frame().timestamps), frame().timestamps,
+			2 * sizeof(u64), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+	}
+
 	frame().commandBuffers.clear();
 	Check(GetCommandBuffer().m_index == 0, "Main rendering command buffer should always be at index 0");
 
+	vkCmdResetQueryPool(frame().commandBuffers[0].m_cmd, frame().timestampPool, 0, MaxTimestamps);
+	frame().timestampsReset = true;
+
 	VkImageSubresourceRange subresourceRange = {
 		.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
 		.baseMipLevel   = 0, .levelCount = 1,
@@ -679,6 +700,18 @@ Extent2D VulkanDevice::GetSwapchainExtent() {
 	return { m_swapchain.extent.width, m_swapchain.extent.height };
 }
 
+float VulkanDevice::GetTimestampDelta(u32 begin, u32 end) {
+	const u64* timestamps = frame().timestamps;
+
+	// Each query is stored as a {value, availability} pair.
+	if (timestamps[2 * begin + 1] == 0 || timestamps[2 * end + 1] == 0) {
+		return 0.0f;
+	}
+
+	// timestampPeriod is the number of nanoseconds per timestamp tick.
+	return float(double(timestamps[2 * end] - timestamps[2 * begin]) * properties.limits.timestampPeriod * 1e-6);
+}
+
 void VulkanDevice::FlushCommandBuffer(CommandBuffer& commandBuffer) {
 	VkCommandBuffer cmd = frame().commandBuffers[commandBuffer.m_index].m_cmd;
 	FlushCommandBufferVK(cmd);
@@ -736,32 +769,53 @@ VkRenderingAttachmentInfo* VulkanDevice::GetSwapchainAttachmentInfo() {
 	return &m_swapchain.attachmentInfos[m_swapchain.imageIndex];
 }
 
-void VulkanCommandBuffer::BeginRendering(Handle<Texture> depth, u32 layer, u32 width, u32 height) {
+VkQueryPool VulkanDevice::GetTimestampPool() {
+	return frame().timestampPool;
+}
+
+void VulkanCommandBuffer::BeginRendering(Handle<Texture> depth, u32 layer, u32 width, u32 height, bool clear) {
 	VulkanResourceManager* rm = VulkanResourceManager::impl();
 
-	VkRenderingAttachmentInfo depthAttachmentInfo = rm->GetTexture(depth)->GetAttachmentInfo(layer);
+	VulkanTexture* texture = rm->GetTexture(depth);
+
+	// Layered rendering goes through a view of the whole array.
+	const bool layered = layer == ~0u;
+	Check(!layered || texture->layered, "Texture has no layered depth view");
+
+	VkRenderingAttachmentInfo depthAttachmentInfo = texture->GetAttachmentInfo(layered ? 0 : layer);
+	if (layered)
+		depthAttachmentInfo.imageView = texture->layered;
+	if (!clear)
+		depthAttachmentInfo.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
 
 	VkRenderingInfo renderingInfo = {
 		.sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
 		.renderArea = { .extent = { width, height } },
-		.layerCount = 1,
+		.layerCount = layered ? texture->numLayers : 1,
 		.pDepthAttachment = &depthAttachmentInfo
 	};
 
 	vkCmdBeginRendering(m_cmd, &renderingInfo);
 }
 
-void VulkanCommandBuffer::BeginRendering(Extent2D extent, const span<const Handle<Texture>>&& attachments, Handle<Texture> depth) {
+void VulkanCommandBuffer::BeginRendering(Extent2D extent, const span<const Handle<Texture>>&& attachments, Handle<Texture> depth, bool readOnlyDepth, bool clearDepth, bool clearColor) {
 	VulkanResourceManager* rm = VulkanResourceManager::impl();
 
 	bool hasDepth = depth.valid();
 	VkRenderingAttachmentInfo depthAttachmentInfo = {};
-	if (hasDepth)
-		depthAttachmentInfo = rm->GetTexture(depth)->GetAttachmentInfo();
+	if (hasDepth) {
+		VulkanTexture* texture = rm->GetTexture(depth);
+		depthAttachmentInfo = readOnlyDepth ? texture->GetReadOnlyAttachmentInfo() : texture->GetAttachmentInfo();
+		if (!clearDepth)
+			depthAttachmentInfo.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	}
 
 	std::vector<VkRenderingAttachmentInfo> colorAttachments(attachments.size());
-	for (u32 i = 0; i < attachments.size(); i++)
+	for (u32 i = 0; i < attachments.size(); i++) {
 		colorAttachments[i] = rm->GetTexture(attachments[i])->GetAttachmentInfo();
+		if (!clearColor)
+			colorAttachments[i].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	}
 
 	VkRenderingInfo renderingInfo = {
 		.sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
@@ -776,7 +830,7 @@ void VulkanCommandBuffer::BeginRendering(Extent2D extent, const span<const Handl
 }
 
 
-void VulkanCommandBuffer::BeginRenderingSwapchain(Handle<Texture> depth) {
+void VulkanCommandBuffer::BeginRenderingSwapchain(Handle<Texture> depth, bool readOnlyDepth) {
 	VulkanDevice* device = VulkanDevice::impl();
 	VulkanResourceManager* rm = VulkanResourceManager::impl();
 
@@ -792,7 +846,8 @@ void VulkanCommandBuffer::BeginRenderingSwapchain(Handle<Texture> depth) {
 	// If depth is also passed, we want to sample it, so set load_op_load.
 	VkRenderingAttachmentInfo depthAttachmentInfo = {};
 	if (depth.valid()) {
-		depthAttachmentInfo = rm->GetTexture(depth)->GetAttachmentInfo(0);
+		VulkanTexture* texture = rm->GetTexture(depth);
+		depthAttachmentInfo = readOnlyDepth ? texture->GetReadOnlyAttachmentInfo() : texture->GetAttachmentInfo(0);
 		depthAttachmentInfo.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
 		renderingInfo.pDepthAttachment = &depthAttachmentInfo;
 	}
@@ -804,6 +859,24 @@ void VulkanCommandBuffer::EndRendering() {
 	vkCmdEndRendering(m_cmd);
 }
 
+void VulkanCommandBuffer::ClearDepth(const Rect2D& rect, u32 baseLayer, u32 layerCount, float depth) {
+	VkClearAttachment attachment = {
+		.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
+		.clearValue = {.depthStencil = { depth, 0 } }
+	};
+
+	VkClearRect clearRect = {
+		.rect = {
+			.offset = { rect.offset.x, rect.offset.y },
+			.extent = { rect.extent.width, rect.extent.height }
+		},
+		.baseArrayLayer = baseLayer,
+		.layerCount = layerCount
+	};
+
+	vkCmdClearAttachments(m_cmd, 1, &attachment, 1, &clearRect);
+}
+
 void VulkanCommandBuffer::ImageBarrier(Handle<Texture> texture, Usage srcUsage, Usage dstUsage, u32 baseMip, u32 mipCount, u32 baseLayer, u32 layerCount) {
 	VulkanResourceManager* rm = VulkanResourceManager::impl();
 
@@ -820,20 +893,63 @@ void VulkanCommandBuffer::ImageBarrier(Handle<Texture> texture, Usage srcUsage,
 	vkCmdPipelineBarrier2(m_cmd, &dependencyInfo);
 }
 
+void VulkanCommandBuffer::CopyTexture(Handle<Texture> src, Handle<Texture> dst, span<const Rect2D> regions) {
+	VulkanResourceManager* rm = VulkanResourceManager::impl();
+
+	VulkanTexture* srcImage = rm->GetTexture(src);
+	VulkanTexture* dstImage = rm->GetTexture(dst);
+
+	const VkImageSubresourceLayers subresource = {
+		.aspectMask		= GetImageAspect(ConvertFormatVK(srcImage->format)),
+		.mipLevel		= 0,
+		.baseArrayLayer = 0,
+		.layerCount		= 1
+	};
+
+	VkImageCopy copies[16];
+	Check(regions.size() <= arraysize(copies), "At most %u regions can be copied at once", arraysize(copies));
+
+	for (u32 i = 0; i < regions.size(); i++) {
+		copies[i] = {
+			.srcSubresource = subresource,
+			.srcOffset		= { regions[i].offset.x, regions[i].offset.y, 0 },
+			.dstSubresource = subresource,
+			.dstOffset		= { regions[i].offset.x, regions[i].offset.y, 0 },
+			.extent			= { regions[i].extent.width, regions[i].extent.height, 1 }
+		};
+	}
+
+	vkCmdCopyImage(m_cmd, srcImage->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dstImage->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (u32)regions.size(), copies);
+}
+
+void VulkanCommandBuffer::BufferBarrier(Handle<Buffer> buffer, Usage srcUsage, Usage dstUsage, u64 offset, u64 size) {
+	VulkanResourceManager* rm = VulkanResourceManager::impl();
+
+	VkBufferMemoryBarrier2 barrier = GetVkBufferBarrier(rm->GetBuffer(buffer)->buffer, srcUsage, dstUsage, offset, size);
+
+	VkDependencyInfo dependencyInfo = {
+		.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+		.bufferMemoryBarrierCount = 1,
+		.pBufferMemoryBarriers = &barrier
+	};
+
+	vkCmdPipelineBarrier2(m_cmd, &dependencyInfo);
+}
+
 void VulkanCommandBuffer::SetPipeline(Handle<Pipeline> handle) {
 	VulkanResourceManager* rm = VulkanResourceManager::impl();
 
-	VkPipeline pipeline = rm->GetPipeline(handle)->pipeline;
-	vkCmdBindPipeline(m_cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	VulkanPipeline* pipeline = rm->GetPipeline(handle);
+	vkCmdBindPipeline(m_cmd, pipeline->bindPoint, pipeline->pipeline);
 	boundPipeline = handle;
 }
 
 void VulkanCommandBuffer::SetBindGroup(Handle<BindGroup> handle, u32 index, span<const u32> dynamicOffsets) {
 	VulkanResourceManager* rm = VulkanResourceManager::impl();
 
-	VkPipelineLayout pipelineLayout = rm->GetPipeline(boundPipeline)->layout;
-	VkDescriptorSet  descriptorSet  = rm->GetBindGroup(handle)->set;
-	vkCmdBindDescriptorSets(m_cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, index, 1, &descriptorSet, (u32)dynamicOffsets.size(), dynamicOffsets.data());
+	VulkanPipeline* pipeline = rm->GetPipeline(boundPipeline);
+	VkDescriptorSet descriptorSet = rm->GetBindGroup(handle)->set;
+	vkCmdBindDescriptorSets(m_cmd, pipeline->bindPoint, pipeline->layout, index, 1, &descriptorSet, (u32)dynamicOffsets.size(), dynamicOffsets.data());
 }
 
 void VulkanCommandBuffer::PushConstants(void* data, u32 offset, u32 size, u32 stages) {
@@ -843,11 +959,11 @@ void VulkanCommandBuffer::PushConstants(void* data, u32 offset, u32 size, u32 st
 	vkCmdPushConstants(m_cmd, pipelineLayout, ParseShaderStageFlags(stages), offset, size, data);
 }
 
-void VulkanCommandBuffer::SetVertexBuffer(Handle<Buffer> handle, u64 offset) {
+void VulkanCommandBuffer::SetVertexBuffer(Handle<Buffer> handle, u64 offset, u32 binding) {
 	VulkanResourceManager* rm = VulkanResourceManager::impl();
 
 	VkBuffer vertexBuffer = rm->GetBuffer(handle)->buffer;
-	vkCmdBindVertexBuffers(m_cmd, 0, 1, &vertexBuffer, &offset);
+	vkCmdBindVertexBuffers(m_cmd, binding, 1, &vertexBuffer, &offset);
 }
 
 void VulkanCommandBuffer::SetIndexBuffer(Handle<Buffer> handle, u64 offset, IndexType type) {
@@ -879,6 +995,35 @@ void VulkanCommandBuffer::SetViewport(float width, float height) {
 	vkCmdSetViewport(m_cmd, 0, 1, &viewport);
 }
 
+void VulkanCommandBuffer::SetViewports(span<const Rect2D> rects) {
+	VkViewport viewports[16];
+	VkRect2D   scissors[16];
+	Check(rects.size() <= arraysize(viewports), "At most %u viewports can be set at once", arraysize(viewports));
+
+	for (u32 i = 0; i < rects.size(); i++) {
+		viewports[i] = {
+			.x		  = (float)rects[i].offset.x,
+			.y		  = (float)rects[i].offset.y,
+			.width	  = (float)rects[i].extent.width,
+			.height	  = (float)rects[i].extent.height,
+			.minDepth = 0.0f,
+			.maxDepth = 1.0f
+		};
+
+		scissors[i] = {
+			.offset = {.x = rects[i].offset.x, .y = rects[i].offset.y },
+			.extent = {.width = rects[i].extent.width, .height = rects[i].extent.height }
+		};
+	}
+
+	vkCmdSetViewport(m_cmd, 0, (u32)rects.size(), viewports);
+	vkCmdSetScissor(m_cmd, 0, (u32)rects.size(), scissors);
+}
+
+void VulkanCommandBuffer::SetDepthBounds(float minDepth, float maxDepth) {
+	vkCmdSetDepthBounds(m_cmd, minDepth, maxDepth);
+}
+
 void VulkanCommandBuffer::Draw(u32 vertexCount, u32 instanceCount, u32 firstVertex, u32 firstInstance) {
 	vkCmdDraw(m_cmd, vertexCount, instanceCount, firstVertex, firstInstance);
 }
@@ -886,3 +1031,32 @@ void VulkanCommandBuffer::Draw(u32 vertexCount, u32 instanceCount, u32 firstVert
 void VulkanCommandBuffer::DrawIndexed(u32 indexCount, u32 instanceCount, u32 firstIndex, u32 vertexOffset, u32 firstInstance) {
 	vkCmdDrawIndexed(m_cmd, indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
 }
+
+void VulkanCommandBuffer::DrawIndexedIndirect(Handle<Buffer> buffer, u64 offset, u32 drawCount, u32 stride) {
+	VulkanResourceManager* rm = VulkanResourceManager::impl();
+
+	vkCmdDrawIndexedIndirect(m_cmd, rm->GetBuffer(buffer)->buffer, offset, drawCount, stride);
+}
+
+void VulkanCommandBuffer::DrawIndexedIndirectCount(Handle<Buffer> buffer, u64 offset, Handle<Buffer> countBuffer, u64 countOffset, u32 maxDrawCount, u32 stride) {
+	VulkanResourceManager* rm = VulkanResourceManager::impl();
+
+	vkCmdDrawIndexedIndirectCount(m_cmd, rm->GetBuffer(buffer)->buffer, offset, rm->GetBuffer(countBuffer)->buffer, countOffset, maxDrawCount, stride);
+}
+
+void VulkanCommandBuffer::Dispatch(u32 groupCountX, u32 groupCountY, u32 groupCountZ) {
+	vkCmdDispatch(m_cmd, groupCountX, groupCountY, groupCountZ);
+}
+
+void VulkanCommandBuffer::WriteTimestamp(u32 query) {
+	Check(m_index == 0, "Timestamps can only be written to the frame command buffer");
+	Check(query < Device::MaxTimestamps, "Timestamp query %u is out of range", query);
+
+	vkCmdWriteTimestamp2(m_cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VulkanDevice::impl()->GetTimestampPool(), query);
+}
+
+void VulkanCommandBuffer::DispatchIndirect(Handle<Buffer> buffer, u64 offset) {
+	VulkanResourceManager* rm = VulkanResourceManager::impl();
+
+	vkCmdDispatchIndirect(m_cmd, rm->GetBuffer(buffer)->buffer, offset);
+}
@@ -14,25 +14,38 @@ class VulkanCommandBuffer final : public CommandBuffer {
 public:
     VulkanCommandBuffer(VkCommandBuffer cmd, u32 index) : m_cmd{cmd} { m_index = index; }
 
-    void BeginRendering(Handle<Texture> depth, u32 layer, u32 width, u32 height);
-    void BeginRendering(Extent2D extent, const span<const Handle<Texture>>&& attachments = {}, Handle<Texture> depth = {});
-    void BeginRenderingSwapchain(Handle<Texture> depth = {});
+    void BeginRendering(Handle<Texture> depth, u32 layer, u32 width, u32 height, bool clear = true);
+    void BeginRendering(Extent2D extent, const span<const Handle<Texture>>&& attachments = {}, Handle<Texture> depth = {}, bool readOnlyDepth = false, bool clearDepth = true, bool clearColor = true);
+    void BeginRenderingSwapchain(Handle<Texture> depth = {}, bool readOnlyDepth = false);
     void EndRendering();
 
+    void ClearDepth(const Rect2D& rect, u32 baseLayer = 0, u32 layerCount = 1, float depth = 0.0f);
+
     void ImageBarrier(Handle<Texture> texture, Usage srcUsage, Usage dstUsage, u32 baseMip = 0, u32 mipCount = 1, u32 baseLayer = 0, u32 layerCount = 1);
+    void CopyTexture(Handle<Texture> src, Handle<Texture> dst, span<const Rect2D> regions);
+    void BufferBarrier(Handle<Buffer> buffer, Usage srcUsage, Usage dstUsage, u64 offset = 0, u64 size = -1);
 
     void SetPipeline(Handle<Pipeline> handle);
     void SetBindGroup(Handle<BindGroup> handle, u32 index, span<const u32> dynamicOffsets = {});
     void PushConstants(void* data, u32 offset, u32 size, u32 stages);
 
-    void SetVertexBuffer(Handle<Buffer> handle, u64 offset);
+    void SetVertexBuffer(Handle<Buffer> handle, u64 offset, u32 binding = 0);
     void SetIndexBuffer(Handle<Buffer> handle, u64 offset, IndexType type);
 
     void SetScissor(const Rect2D& scissor);
     void SetViewport(float width, float height);
+    void SetViewports(span<const Rect2D> rects);
+    void SetDepthBounds(float minDepth, float maxDepth);
 
     void Draw(u32 vertexCount, u32 instanceCount, u32 firstVertex, u32 firstInstance);
     void DrawIndexed(u32 indexCount, u32 instanceCount, u32 firstIndex, u32 vertexOffset, u32 firstInstance);
+    void DrawIndexedIndirect(Handle<Buffer> buffer, u64 offset, u32 drawCount, u32 stride = sizeof(DrawIndexedIndirectCommand));
+    void DrawIndexedIndirectCount(Handle<Buffer> buffer, u64 offset, Handle<Buffer> countBuffer, u64 countOffset, u32 maxDrawCount, u32 stride = sizeof(DrawIndexedIndirectCommand));
+
+    void Dispatch(u32 groupCountX, u32 groupCountY, u32 groupCountZ);
+    void DispatchIndirect(Handle<Buffer> buffer, u64 offset);
+
+    void WriteTimestamp(u32 query);
 
 private:
     friend class VulkanDevice;
@@ -61,9 +74,12 @@ public:
     Format GetSwapchainFormat();
     Extent2D GetSwapchainExtent();
 
+    float GetTimestampDelta(u32 begin, u32 end);
+
     VkCommandBuffer GetCommandBufferVK();
     void FlushCommandBufferVK(VkCommandBuffer cmd);
     VkRenderingAttachmentInfo* GetSwapchainAttachmentInfo();
+    VkQueryPool GetTimestampPool();
     
 private:
     // Creates a new swapchain
@@ -110,6 +126,12 @@ private:
         // can be allocated for the frame. The returned handle
         // will only be valid during this frame.
         VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+
+        // Timestamp queries written by the frame command buffer. Read back when the frame index comes around again,
+        // as {value, availability} pairs, before the queries are reset for the new frame.
+        VkQueryPool timestampPool   = VK_NULL_HANDLE;
+        bool        timestampsReset = false;
+        u64         timestamps[2 * MaxTimestamps] = {};
     };
 
     struct Queue {
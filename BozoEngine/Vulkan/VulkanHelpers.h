@@ -59,6 +59,7 @@ inline constexpr VkFormat ConvertFormat(Format format) {
 	switch (format) {
 	case Format::UNDEFINED:			return VK_FORMAT_UNDEFINED;
 	case Format::R8_UNORM:			return VK_FORMAT_R8_UNORM;
+	case Format::RG8_UNORM:			return VK_FORMAT_R8G8_UNORM;
 	case Format::RGBA8_UNORM:		return VK_FORMAT_R8G8B8A8_UNORM;
 	case Format::RGBA8_SRGB:		return VK_FORMAT_R8G8B8A8_SRGB;
 	case Format::BGRA8_SRGB:		return VK_FORMAT_B8G8R8A8_SRGB;
@@ -66,6 +67,11 @@ inline constexpr VkFormat ConvertFormat(Format format) {
 	case Format::D32_SFLOAT:		return VK_FORMAT_D32_SFLOAT;
 	case Format::RG32_SFLOAT:		return VK_FORMAT_R32G32_SFLOAT;
 	case Format::RGB32_SFLOAT:		return VK_FORMAT_R32G32B32_SFLOAT;
+	case Format::RG16_UNORM:		return VK_FORMAT_R16G16_UNORM;
+	case Format::RG16_SFLOAT:		return VK_FORMAT_R16G16_SFLOAT;
+	case Format::R32_UINT:			return VK_FORMAT_R32_UINT;
+	case Format::RGBA16_SNORM:		return VK_FORMAT_R16G16B16A16_SNORM;
+	case Format::RGBA16_SFLOAT:		return VK_FORMAT_R16G16B16A16_SFLOAT;
 	case Format::RGBA32_SFLOAT:		return VK_FORMAT_R32G32B32A32_SFLOAT;
 
 	default: 
@@ -77,6 +83,7 @@ inline constexpr Format ConvertFormatVK(VkFormat format) {
 	switch (format) {
 	case VK_FORMAT_UNDEFINED:			return Format::UNDEFINED;
 	case VK_FORMAT_R8_UNORM:			return Format::R8_UNORM;
+	case VK_FORMAT_R8G8_UNORM:			return Format::RG8_UNORM;
 	case VK_FORMAT_R8G8B8A8_UNORM:		return Format::RGBA8_UNORM;
 	case VK_FORMAT_R8G8B8A8_SRGB:		return Format::RGBA8_SRGB;
 	case VK_FORMAT_B8G8R8A8_SRGB:		return Format::BGRA8_SRGB;
@@ -84,6 +91,11 @@ inline constexpr Format ConvertFormatVK(VkFormat format) {
 	case VK_FORMAT_D32_SFLOAT:			return Format::D32_SFLOAT;
 	case VK_FORMAT_R32G32_SFLOAT:		return Format::RG32_SFLOAT;
 	case VK_FORMAT_R32G32B32_SFLOAT:	return Format::RGB32_SFLOAT;
+	case VK_FORMAT_R16G16_UNORM:		return Format::RG16_UNORM;
+	case VK_FORMAT_R16G16_SFLOAT:		return Format::RG16_SFLOAT;
+	case VK_FORMAT_R32_UINT:			return Format::R32_UINT;
+	case VK_FORMAT_R16G16B16A16_SNORM:	return Format::RGBA16_SNORM;
+	case VK_FORMAT_R16G16B16A16_SFLOAT:	return Format::RGBA16_SFLOAT;
 	case VK_FORMAT_R32G32B32A32_SFLOAT:	return Format::RGBA32_SFLOAT;
 
 	default:
@@ -149,6 +161,8 @@ inline constexpr VkDescriptorType ConvertDescriptorType(Binding::Type type) {
         case Binding::Type::TEXTURE: return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
         case Binding::Type::BUFFER:  return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
         case Binding::Type::DYNAMIC: return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        case Binding::Type::STORAGE_BUFFER:  return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        case Binding::Type::STORAGE_TEXTURE: return VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
 
         default:
             Check(false, "Unknown descriptor type %u", type);
@@ -163,6 +177,12 @@ inline constexpr VkBufferUsageFlags ParseUsageFlags(u32 value) {
 	if (HasFlag(value, Usage::VERTEX_BUFFER))	usage |= VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
 	if (HasFlag(value, Usage::INDEX_BUFFER))	usage |= VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
 	if (HasFlag(value, Usage::UNIFORM_BUFFER))	usage |= VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+	if (HasFlag(value, Usage::INDIRECT_BUFFER))	usage |= VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+
+	// Buffers are only ever bound to shaders as storage buffers. Shader resource buffers are just read-only.
+	if (HasFlag(value, Usage::SHADER_RESOURCE) || HasFlag(value, Usage::UNORDERED_ACCESS)) {
+		usage |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	}
 
 	return usage;
 }
@@ -173,6 +193,7 @@ inline constexpr VkAccessFlags2 ParseAccessFlags(u32 value) {
     if (HasFlag(value, Usage::SHADER_RESOURCE)) flags |= VK_ACCESS_2_SHADER_READ_BIT;
 	if (HasFlag(value, Usage::RENDER_TARGET))	flags |= VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
 	if (HasFlag(value, Usage::DEPTH_STENCIL))	flags |= VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	if (HasFlag(value, Usage::UNORDERED_ACCESS)) flags |= VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
 
     return flags;
 }
@@ -182,6 +203,7 @@ inline constexpr VkShaderStageFlags ParseShaderStageFlags(u32 value) {
 
     if (HasFlag(value, ShaderStage::VERTEX))     stages |= VK_SHADER_STAGE_VERTEX_BIT;
 	if (HasFlag(value, ShaderStage::FRAGMENT))   stages |= VK_SHADER_STAGE_FRAGMENT_BIT;
+	if (HasFlag(value, ShaderStage::COMPUTE))    stages |= VK_SHADER_STAGE_COMPUTE_BIT;
 
     return stages;
 }
@@ -190,6 +212,9 @@ inline constexpr VkImageLayout ParseImageLayout(u32 value) {
 	if (HasFlag(value, Usage::RENDER_TARGET) || HasFlag(value, Usage::DEPTH_STENCIL)) {
 		return VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL;
 	}
+	else if (HasFlag(value, Usage::UNORDERED_ACCESS)) {
+		return VK_IMAGE_LAYOUT_GENERAL;
+	}
 	else if (HasFlag(value, Usage::SHADER_RESOURCE)) {
 		return VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 	}
@@ -210,6 +235,12 @@ inline constexpr VkImageUsageFlags ParseImageUsage(u32 value) {
 	if (HasFlag(value, Usage::DEPTH_STENCIL)) {
 		usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
 	}
+	if (HasFlag(value, Usage::UNORDERED_ACCESS)) {
+		usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+	}
+	if (HasFlag(value, Usage::TRANSFER_SRC)) {
+		usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	}
 
 	return usage;
 }
@@ -235,14 +266,21 @@ inline constexpr u32 FormatStride(VkFormat format) {
 	case VK_FORMAT_R8_UNORM:
 		return 1;
 
+	case VK_FORMAT_R8G8_UNORM:
+		return 2;
+
 	case VK_FORMAT_R8G8B8A8_UNORM:
 	case VK_FORMAT_R8G8B8A8_SRGB:
 	case VK_FORMAT_B8G8R8A8_SRGB:
 	case VK_FORMAT_D24_UNORM_S8_UINT:
 	case VK_FORMAT_D32_SFLOAT:
+	case VK_FORMAT_R16G16_UNORM:
+	case VK_FORMAT_R16G16_SFLOAT:
+	case VK_FORMAT_R32_UINT:
         return 4;
 
 	case VK_FORMAT_R32G32_SFLOAT:
+	case VK_FORMAT_R16G16B16A16_SNORM:
 		return 8;
 
 	case VK_FORMAT_R32G32B32_SFLOAT:
@@ -311,15 +349,25 @@ inline constexpr VkImageMemoryBarrier2 GetVkImageBarrier(VkImage image, VkImageA
 		barrier.oldLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL;
 	}
 	else if (HasFlag(srcUsage, Usage::SHADER_RESOURCE)) {
-		barrier.srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		barrier.srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
 		barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
 		barrier.oldLayout = VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL;
 	}
+	else if (HasFlag(srcUsage, Usage::UNORDERED_ACCESS)) {
+		barrier.srcStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	}
 	else if (HasFlag(srcUsage, Usage::TRANSFER_DST)) {
 		barrier.srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
 		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
 		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
 	}
+	else if (HasFlag(srcUsage, Usage::TRANSFER_SRC)) {
+		barrier.srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		barrier.srcAccessMask = VK_ACCESS_NONE;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	}
 	else {
 		Check(false, "Unsupported srcUsage for image transition: %u", (u32)srcUsage);
 	}
@@ -335,15 +383,31 @@ inline constexpr VkImageMemoryBarrier2 GetVkImageBarrier(VkImage image, VkImageA
 		barrier.newLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL;
 	}
 	else if (HasFlag(dstUsage, Usage::SHADER_RESOURCE)) {
-		barrier.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		barrier.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
 		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 		barrier.newLayout = VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL;
+
+		// Depth textures in this layout can also be bound as read-only depth attachments, and tested against.
+		if (aspect & VK_IMAGE_ASPECT_DEPTH_BIT) {
+			barrier.dstStageMask |= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			barrier.dstAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+		}
+	}
+	else if (HasFlag(dstUsage, Usage::UNORDERED_ACCESS)) {
+		barrier.dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
 	}
 	else if (HasFlag(dstUsage, Usage::TRANSFER_DST)) {
 		barrier.dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
 		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
 		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
 	}
+	else if (HasFlag(dstUsage, Usage::TRANSFER_SRC)) {
+		barrier.dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	}
 	else {
 		Check(false, "Unsupported dstUsage for image transition: %u", (u32)dstUsage);
 	}
@@ -351,6 +415,68 @@ inline constexpr VkImageMemoryBarrier2 GetVkImageBarrier(VkImage image, VkImageA
 	return barrier;
 }
 
+// Get the pipeline stages and access flags a buffer is used with for the given usage.
+inline constexpr void GetBufferBarrierScope(Usage usage, VkPipelineStageFlags2& stages, VkAccessFlags2& access) {
+	constexpr VkPipelineStageFlags2 shaderStages = VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT 
+												 | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT 
+												 | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+
+	if (HasFlag(usage, Usage::UNORDERED_ACCESS)) {
+		stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+		access = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+	}
+	else if (HasFlag(usage, Usage::SHADER_RESOURCE)) {
+		stages = shaderStages;
+		access = VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+	}
+	else if (HasFlag(usage, Usage::UNIFORM_BUFFER)) {
+		stages = shaderStages;
+		access = VK_ACCESS_2_UNIFORM_READ_BIT;
+	}
+	else if (HasFlag(usage, Usage::INDIRECT_BUFFER)) {
+		stages = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT;
+		access = VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT;
+	}
+	else if (HasFlag(usage, Usage::VERTEX_BUFFER)) {
+		stages = VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT;
+		access = VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT;
+	}
+	else if (HasFlag(usage, Usage::INDEX_BUFFER)) {
+		stages = VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT;
+		access = VK_ACCESS_2_INDEX_READ_BIT;
+	}
+	else if (HasFlag(usage, Usage::TRANSFER_SRC)) {
+		stages = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+		access = VK_ACCESS_2_TRANSFER_READ_BIT;
+	}
+	else if (HasFlag(usage, Usage::TRANSFER_DST)) {
+		stages = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+		access = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	}
+	else if (usage == Usage::USAGE_NONE) {
+		// No device usage: the buffer is accessed by the host, e.g. when reading back results.
+		stages = VK_PIPELINE_STAGE_2_HOST_BIT;
+		access = VK_ACCESS_2_HOST_READ_BIT | VK_ACCESS_2_HOST_WRITE_BIT;
+	}
+	else {
+		Check(false, "Unsupported usage for buffer barrier: %u", (u32)usage);
+	}
+}
+
+inline constexpr VkBufferMemoryBarrier2 GetVkBufferBarrier(VkBuffer buffer, Usage srcUsage, Usage dstUsage, u64 offset, u64 size) {
+	VkBufferMemoryBarrier2 barrier = {
+		.sType  = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+		.buffer = buffer,
+		.offset = offset,
+		.size   = size
+	};
+
+	GetBufferBarrierScope(srcUsage, barrier.srcStageMask, barrier.srcAccessMask);
+	GetBufferBarrierScope(dstUsage, barrier.dstStageMask, barrier.dstAccessMask);
+
+	return barrier;
+}
+
 inline void ImageBarrier(VkCommandBuffer cmd, VkImage image, VkImageSubresourceRange subresourceRange,
 	VkPipelineStageFlags2	srcStage,	VkPipelineStageFlags2	dstStage, 
 	VkAccessFlags2			srcAccess,	VkAccessFlags2			dstAccess,
@@ -81,6 +81,15 @@ void VulkanResourceManager::UnmapBuffer(Handle<Buffer> handle) {
     buffer->mapped = nullptr;
 }
 
+bool VulkanResourceManager::FlushBuffer(Handle<Buffer> handle, u32 size, u32 offset) {
+    VulkanBuffer* buffer = m_buffers.get(handle);
+
+    if (!buffer) return false; // TODO: log error
+
+    // VMA automatically ignores this call if the allocation is coherent.
+    return VK_SUCCESS == vmaFlushAllocation(m_device->vmaAllocator, buffer->allocation, offset, size);
+}
+
 static VkImageView CreateView(VkImage image, VkFormat format, TextureDesc::Type type, VkImageAspectFlags aspect, u32 firstLayer, u32 layerCount, u32 firstMip, u32 mipCount) {
 	VkImageViewCreateInfo viewInfo = {
 		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
@@ -271,11 +280,16 @@ Handle<Texture> VulkanResourceManager::CreateTexture(const TextureDesc&& desc) {
     // IMAGE VIEWS
 
     // Shader resource views
-    if (HasFlag(desc.usage, Usage::SHADER_RESOURCE)) {
+    if (HasFlag(desc.usage, Usage::SHADER_RESOURCE) || HasFlag(desc.usage, Usage::UNORDERED_ACCESS)) {
         VkImageAspectFlags aspect = HasDepth(desc.format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
 		texture.srv = CreateView(texture.image, texture.format, desc.type, aspect, 0, -1, 0, -1);
     }
 
+    // Storage image views : A storage image descriptor must view a single mip level, so storage images are bound at mip 0
+    if (HasFlag(desc.usage, Usage::UNORDERED_ACCESS)) {
+		texture.uav = CreateView(texture.image, texture.format, desc.type, VK_IMAGE_ASPECT_COLOR_BIT, 0, -1, 0, 1);
+    }
+
     // Render target views : As each layer is rendered to individually, we create a view for each layer
     if (HasFlag(desc.usage, Usage::RENDER_TARGET)) {
 		for (u32 layer = 0; layer < texture.numLayers; layer++) {
@@ -287,6 +301,11 @@ Handle<Texture> VulkanResourceManager::CreateTexture(const TextureDesc&& desc) {
 		for (u32 layer = 0; layer < texture.numLayers; layer++) {
 			texture.dsv[layer] = CreateView(texture.image, texture.format, TextureDesc::Type::TEXTURE2D, aspect, layer, 1, 0, 1);
 		}
+
+		// Depth arrays can also be rendered to all at once, with the layer selected in the vertex shader.
+		if (texture.numLayers > 1) {
+			texture.layered = CreateView(texture.image, texture.format, TextureDesc::Type::TEXTURE2DARRAY, aspect, 0, -1, 0, 1);
+		}
 	}
     
     // SAMPLER
@@ -320,6 +339,8 @@ void VulkanResourceManager::DestroyTexture(Handle<Texture> handle) {
     VulkanTexture* texture = m_textures.get(handle);
 
     if (texture->srv) vkDestroyImageView(m_device->vkDevice, texture->srv, nullptr);
+    if (texture->uav) vkDestroyImageView(m_device->vkDevice, texture->uav, nullptr);
+    if (texture->layered) vkDestroyImageView(m_device->vkDevice, texture->layered, nullptr);
 
     for (u32 layer = 0; layer < texture->numLayers; layer++) {
 		if (texture->rtv[layer]) vkDestroyImageView(m_device->vkDevice, texture->rtv[layer], nullptr);
@@ -401,19 +422,27 @@ void VulkanResourceManager::UpdateBindGroupTextures(Handle<BindGroup> bindgroup,
         .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
         .dstSet = m_bindgroups.get(bindgroup)->set,
         .dstArrayElement = 0,
-        .descriptorCount = 1,
-        .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+        .descriptorCount = 1
     });
+
+    Handle<BindGroupLayout> layout = m_bindgroups.get(bindgroup)->layout;
+    Binding* bindings = m_bindgroupLayouts.get(layout)->bindings;
     
     for (u32 i = 0; i < textures.size(); i++) {
         VulkanTexture* texture = m_textures.get(textures[i].texture);
+        Binding::Type type = bindings[textures[i].binding].type;
+
+        Check(type != Binding::Type::STORAGE_TEXTURE || texture->uav, "Texture bound to storage texture binding %u was not created with UNORDERED_ACCESS usage", textures[i].binding);
+
+        // Storage images are accessed in the GENERAL layout through their mip 0 view, and don't use a sampler
         descriptors[i] = {
-            .sampler = texture->sampler,
-            .imageView = texture->srv,
-            .imageLayout = VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL
+            .sampler = type == Binding::Type::STORAGE_TEXTURE ? VK_NULL_HANDLE : texture->sampler,
+            .imageView = type == Binding::Type::STORAGE_TEXTURE ? texture->uav : texture->srv,
+            .imageLayout = type == Binding::Type::STORAGE_TEXTURE ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL
         };
         updates[i].dstBinding = textures[i].binding;
         updates[i].pImageInfo = &descriptors[i];
+        updates[i].descriptorType = ConvertDescriptorType(type);
     }
 
     vkUpdateDescriptorSets(m_device->vkDevice, (u32)textures.size(), updates.data(), 0, nullptr);
@@ -440,7 +469,7 @@ void VulkanResourceManager::UpdateBindGroupBuffers(Handle<BindGroup> bindgroup,
 
         updates[i].dstBinding = buffers[i].binding;
         updates[i].pBufferInfo = &descriptors[i];
-        updates[i].descriptorType = ConvertDescriptorType(bindings[i].type);
+        updates[i].descriptorType = ConvertDescriptorType(bindings[buffers[i].binding].type);
     }
 
     vkUpdateDescriptorSets(m_device->vkDevice, (u32)buffers.size(), updates.data(), 0, nullptr);
@@ -458,28 +487,51 @@ static VkStencilOpState GetVulkanStencilOpState(GraphicsState::DepthStencilState
     };
 }
 
+// Map the specialization constants of a shader. The values are read straight out of the shader's SpecializationConstant array.
+static VkSpecializationInfo GetSpecializationInfo(const ShaderDesc& shader, std::vector<VkSpecializationMapEntry>& mapEntries) {
+    mapEntries.clear();
+    for (u32 i = 0; i < shader.specialization.size(); i++) {
+        mapEntries.push_back({
+            .constantID = shader.specialization[i].id,
+            .offset     = u32(i * sizeof(SpecializationConstant) + offsetof(SpecializationConstant, value)),
+            .size       = sizeof(u32)
+        });
+    }
+
+    return {
+        .mapEntryCount = (u32)mapEntries.size(),
+        .pMapEntries   = mapEntries.data(),
+        .dataSize      = shader.specialization.size_bytes(),
+        .pData         = shader.specialization.data()
+    };
+}
+
 static VkResult CreateVkPipeline(VkPipeline& pipeline, VkPipelineLayout pipelineLayout, span<const ShaderDesc> shaders, GraphicsState desc) {
-    VkDynamicState dynamicState[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+    VkDynamicState dynamicState[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR, VK_DYNAMIC_STATE_DEPTH_BOUNDS };
 
+    // Depth bounds are only dynamic when the test is enabled, so other pipelines never need them set.
     VkPipelineDynamicStateCreateInfo dynamicStateInfo = { 
         .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO, 
-        .dynamicStateCount = arraysize(dynamicState), 
+        .dynamicStateCount = desc.depthStencilState.depthBoundsTestEnable ? 3u : 2u, 
         .pDynamicStates = dynamicState 
     };
 
     VkPipelineViewportStateCreateInfo viewportStateInfo = { 
         .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO, 
-        .viewportCount = 1, 
-        .scissorCount = 1 
+        .viewportCount = desc.viewportCount, 
+        .scissorCount = desc.viewportCount 
     };
 
-    // TODO: If we at some point want to add specialization constants,
-    //       just reflect them from the shader spirv.
-    VkSpecializationInfo specializationInfo = {};
+    // Sized up front, as the stage create infos point into them.
+    std::vector<std::vector<VkSpecializationMapEntry>> mapEntries(shaders.size());
+    std::vector<VkSpecializationInfo> specializationInfos(shaders.size());
 
     // TODO: Enable VK_KHR_maintenance5 and remove shader module creation + deletion code
     std::vector<VkPipelineShaderStageCreateInfo> shaderStageCreateInfos;
     for (const ShaderDesc& shader : shaders) {
+        const u32 stage = (u32)shaderStageCreateInfos.size();
+        specializationInfos[stage] = GetSpecializationInfo(shader, mapEntries[stage]);
+
         VkShaderModuleCreateInfo shaderModuleCreateInfo = {
             .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
             .codeSize = shader.spirv.size_bytes(),
@@ -490,27 +542,40 @@ static VkResult CreateVkPipeline(VkPipeline& pipeline, VkPipelineLayout pipeline
             .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
             .stage = (VkShaderStageFlagBits)ParseShaderStageFlags(shader.stage),
             .pName = shader.entry,
-            .pSpecializationInfo = &specializationInfo
+            .pSpecializationInfo = &specializationInfos[stage]
         });
 
         vkCreateShaderModule(VulkanDevice::impl()->vkDevice, &shaderModuleCreateInfo, nullptr, &shaderStageCreateInfos.back().module);
     }
 
-    // Build the vertex input descriptions. For now, we just support a single vertex input binding (0)
-    VkVertexInputBindingDescription vertexBindingDesc = { .stride = desc.vertexInputState.vertexStride };
+    // Build the vertex input descriptions. Attribute i is read from location i of its binding.
+    std::vector<VkVertexInputBindingDescription> vertexBindingDescs;
+    for (u32 binding = 0; binding < desc.vertexInputState.bindingStrides.size(); binding++) {
+        vertexBindingDescs.push_back({
+            .binding = binding,
+            .stride = desc.vertexInputState.bindingStrides[binding],
+            .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
+        });
+    }
+
     std::vector<VkVertexInputAttributeDescription> vertexAttributeDescs;
     for (u32 location = 0; location < desc.vertexInputState.attributes.size(); location++) {
+        const GraphicsState::VertexInputState::Attribute& attribute = desc.vertexInputState.attributes[location];
+        Check(attribute.binding < vertexBindingDescs.size(), "Vertex attribute %u reads from binding %u, but the pipeline has %u vertex bindings",
+            location, attribute.binding, (u32)vertexBindingDescs.size());
+
         vertexAttributeDescs.push_back({
             .location = location,
-            .format = ConvertFormat(desc.vertexInputState.attributes[location].format),
-            .offset = desc.vertexInputState.attributes[location].offset
+            .binding = attribute.binding,
+            .format = ConvertFormat(attribute.format),
+            .offset = attribute.offset
         });
     }
 
     VkPipelineVertexInputStateCreateInfo vertexInputInfo = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-        .vertexBindingDescriptionCount = 1,
-        .pVertexBindingDescriptions = &vertexBindingDesc,
+        .vertexBindingDescriptionCount = (u32)vertexBindingDescs.size(),
+        .pVertexBindingDescriptions = vertexBindingDescs.data(),
         .vertexAttributeDescriptionCount = (u32)vertexAttributeDescs.size(),
         .pVertexAttributeDescriptions = vertexAttributeDescs.data()
     };
@@ -546,7 +611,7 @@ static VkResult CreateVkPipeline(VkPipeline& pipeline, VkPipelineLayout pipeline
         .depthTestEnable = desc.depthStencilState.depthTestEnable,
         .depthWriteEnable = desc.depthStencilState.depthWriteEnable,
         .depthCompareOp = ConvertCompareOp(desc.depthStencilState.depthCompareOp),
-        .depthBoundsTestEnable = VK_FALSE,
+        .depthBoundsTestEnable = desc.depthStencilState.depthBoundsTestEnable,
         .stencilTestEnable = desc.depthStencilState.stencilTestEnable,
         .front = GetVulkanStencilOpState(desc.depthStencilState.frontStencilState),
         .back = GetVulkanStencilOpState(desc.depthStencilState.backStencilState),
@@ -617,20 +682,56 @@ static VkResult CreateVkPipeline(VkPipeline& pipeline, VkPipelineLayout pipeline
     return res;
 }
 
+static VkResult CreateVkComputePipeline(VkPipeline& pipeline, VkPipelineLayout pipelineLayout, const ShaderDesc& shader) {
+    VkShaderModuleCreateInfo shaderModuleCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .codeSize = shader.spirv.size_bytes(),
+        .pCode = shader.spirv.data()
+    };
+
+    VkShaderModule module;
+    VkCheck(vkCreateShaderModule(VulkanDevice::impl()->vkDevice, &shaderModuleCreateInfo, nullptr, &module), "Failed to create compute shader module");
+
+    std::vector<VkSpecializationMapEntry> mapEntries;
+    const VkSpecializationInfo specializationInfo = GetSpecializationInfo(shader, mapEntries);
+
+    VkComputePipelineCreateInfo pipelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .stage = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = module,
+            .pName = shader.entry,
+            .pSpecializationInfo = &specializationInfo
+        },
+        .layout = pipelineLayout
+    };
+
+    VkResult res = vkCreateComputePipelines(VulkanDevice::impl()->vkDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline);
+
+    vkDestroyShaderModule(VulkanDevice::impl()->vkDevice, module, nullptr);
+
+    return res;
+}
+
 static VkResult CreateVkPipelineLayout(VkPipelineLayout& pipelineLayout, std::vector<VkDescriptorSetLayout>& setLayouts, span<const ShaderDesc> shaders) {
     VkPushConstantRange pushConstants = {};
     std::vector<VkSpecializationMapEntry> mapEntries = {};
     for (const ShaderDesc& shader : shaders) {
         spirv_cross::Compiler comp(shader.spirv.data(), shader.spirv.size());
         spirv_cross::ShaderResources resources = comp.get_shader_resources();
-        auto ranges = comp.get_active_buffer_ranges(resources.push_constant_buffers.front().id);
 
-        for (spirv_cross::BufferRange& r : ranges) {
-            pushConstants.size = glm::max(pushConstants.size, u32(r.offset + r.range));
-        }
+        // Not every shader declares push constants, i.e. most compute shaders.
+        if (!resources.push_constant_buffers.empty()) {
+            auto ranges = comp.get_active_buffer_ranges(resources.push_constant_buffers.front().id);
 
-        if (ranges.size()) {
-            pushConstants.stageFlags |= ParseShaderStageFlags(shader.stage);
+            for (spirv_cross::BufferRange& r : ranges) {
+                pushConstants.size = glm::max(pushConstants.size, u32(r.offset + r.range));
+            }
+
+            if (ranges.size()) {
+                pushConstants.stageFlags |= ParseShaderStageFlags(shader.stage);
+            }
         }
         
         if (setLayouts.empty()) {
@@ -660,7 +761,18 @@ Handle<Pipeline> VulkanResourceManager::CreatePipeline(const PipelineDesc&& desc
     }
 
     CreateVkPipelineLayout(pipeline.layout, descriptorSetLayouts, desc.shaderDescs);
-    CreateVkPipeline(pipeline.pipeline, pipeline.layout, desc.shaderDescs, desc.graphicsState);
+
+    bool isCompute = desc.shaderDescs.size() == 1 && desc.shaderDescs[0].stage == ShaderStage::COMPUTE;
+    if (isCompute) {
+        pipeline.bindPoint = VK_PIPELINE_BIND_POINT_COMPUTE;
+        VkCheck(CreateVkComputePipeline(pipeline.pipeline, pipeline.layout, desc.shaderDescs[0]), "Failed to create compute pipeline");
+    }
+    else {
+        for (const ShaderDesc& shader : desc.shaderDescs) {
+            Check(shader.stage != ShaderStage::COMPUTE, "Compute shaders cannot be combined with other shader stages in pipeline '%s'", desc.debugName);
+        }
+        CreateVkPipeline(pipeline.pipeline, pipeline.layout, desc.shaderDescs, desc.graphicsState);
+    }
 
     VkNameObject(pipeline.layout,   desc.debugName);
     VkNameObject(pipeline.pipeline, desc.debugName);
@@ -699,6 +811,26 @@ bool VulkanResourceManager::WriteBuffer(Handle<Buffer> handle, const void* data,
     return res == VK_SUCCESS;
 }
 
+bool VulkanResourceManager::ReadBuffer(Handle<Buffer> handle, void* data, u32 size, u32 offset) {
+    if (!data) return false; // TODO log "no data"
+
+    VulkanBuffer* buffer = m_buffers.get(handle);
+
+    if (!buffer)                      return false; // TODO log "invalid buffer handle"
+    if (!MapBuffer(handle))           return false; // TODO log "failed to map buffer"
+    if (offset + size > buffer->size) return false; // TODO log "read size greater than buffer size"
+
+    // GPU writes need to be invalidated before they are visible if allocation is not coherent.
+    // VMA automatically ignores this call if the allocation is coherent.
+    VkResult res = vmaInvalidateAllocation(m_device->vmaAllocator, buffer->allocation, offset, size);
+
+    memcpy(data, buffer->mapped + offset, size);
+
+    UnmapBuffer(handle);
+
+    return res == VK_SUCCESS;
+}
+
 bool VulkanResourceManager::Upload(Handle<Buffer> handle, const void* data, u32 size) {
     Handle<Buffer> staging = CreateBuffer({
         .debugName = "BufferUploadStagingBuffer",
@@ -38,8 +38,10 @@ struct VulkanTexture {
 	u32 samples              = 1;
 
     VkImageView srv          = VK_NULL_HANDLE;
+    VkImageView uav          = VK_NULL_HANDLE;	// mip 0 of all layers, as storage images can only view a single mip
 	VkImageView rtv[8]       = {};
 	VkImageView dsv[8]       = {};
+	VkImageView layered      = VK_NULL_HANDLE;	// depth view of all layers, for layered rendering
 
     VkRenderingAttachmentInfo GetAttachmentInfo(u32 layer = 0) const {
         return {
@@ -50,6 +52,16 @@ struct VulkanTexture {
             .storeOp = srv ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE
         };
     }
+
+    // Bind a depth texture read-only in its shader resource layout, so it can be tested against while it is sampled.
+    // Its contents are loaded, and never written back.
+    VkRenderingAttachmentInfo GetReadOnlyAttachmentInfo() const {
+        VkRenderingAttachmentInfo info = GetAttachmentInfo();
+        info.imageLayout = VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL;
+        info.loadOp      = VK_ATTACHMENT_LOAD_OP_LOAD;
+        info.storeOp     = VK_ATTACHMENT_STORE_OP_NONE;
+        return info;
+    }
 };
 
 struct VulkanBindGroupLayout {
@@ -64,8 +76,9 @@ struct VulkanBindGroup {
 };
 
 struct VulkanPipeline {
-    VkPipelineLayout layout = VK_NULL_HANDLE;
-    VkPipeline pipeline     = VK_NULL_HANDLE;
+    VkPipelineLayout layout       = VK_NULL_HANDLE;
+    VkPipeline pipeline           = VK_NULL_HANDLE;
+    VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
 };
 
 class VulkanResourceManager final : public ResourceManager {
@@ -104,6 +117,7 @@ public:
     void DestroyPipeline(Handle<Pipeline> handle);
 
     bool WriteBuffer(Handle<Buffer> handle, const void* data, u32 size, u32 offset = 0);
+    bool ReadBuffer(Handle<Buffer> handle, void* data, u32 size, u32 offset = 0);
     bool Upload(Handle<Buffer> handle, const void* data, u32 size);
 
     // TODO: vkCmdCopy should be pushed to a transfer queue. Backend should handle the semaphore
@@ -121,6 +135,8 @@ public:
 
     bool MapBuffer(Handle<Buffer>   handle);
     void UnmapBuffer(Handle<Buffer> handle);
+
+    bool FlushBuffer(Handle<Buffer> handle, u32 size, u32 offset = 0);
     
     VulkanBuffer*          GetBuffer(Handle<Buffer> handle)                   { return m_buffers.get(handle); }
     VulkanTexture*         GetTexture(Handle<Texture> handle)                 { return m_textures.get(handle); }
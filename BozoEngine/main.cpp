@@ -6,6 +6,8 @@
 #include "Rendering/GLTFModel.h"
 #include "Rendering/Shadows.h"
 #include "Rendering/GTAO.h"
+#include "Rendering/Lights.h"
+#include "Rendering/VisibilityBuffer.h"
 
 // TODO: Remove this include. Only used for loading skybox textures.
 #include <stb/stb_image.h>
@@ -19,6 +21,9 @@ constexpr u32 HEIGHT = 900;
 // NOTE: Until a proper input system has been implemented, camera is just stored as a global here.
 Camera* camera;
 GTAO* g_gtao;
+CascadedShadowMap* g_shadowMap;
+ClusteredLights* g_lights;
+LightManager* g_lightManager;
 
 // NOTE: These callbacks should be handled by some input system. For now we just store previous mouse positions as globals
 double lastXpos = WIDTH / 2.0f;
@@ -72,12 +77,6 @@ struct DirectionalLight {
     alignas(16) glm::vec3 diffuse;
 };
 
-struct PointLight {
-    alignas(16) glm::vec3 position;
-    alignas(16) glm::vec3 ambient;
-    alignas(16) glm::vec3 diffuse;
-};
-
 bool bAnimateLight = false;
 DirectionalLight dirLight = {
     .direction = glm::vec3(1.0f, -1.0f, -0.2f),
@@ -85,23 +84,43 @@ DirectionalLight dirLight = {
     .diffuse   = glm::vec3(2.0f,  1.6f,  1.4f)
 };
 
+// Point lights scattered through the scene - count and radius can be modified in the GUI.
+std::vector<Handle<PointLight>> pointLights;
+u32   pointLightCount  = 20;
+float pointLightRadius = 4.0f;
+bool  bAnimatePointLights = false;
+
+// Add or remove point lights until pointLightCount lights are in the scene.
+void SetPointLightCount(u32 count);
+// Move the point lights to their pseudo-random positions inside the Sponza atrium, bobbing up and down if animated.
+void PlacePointLights(float time);
+
 // Parallax settings - can be modfied in the GUI.
 u32 parallaxMode = 4;
 u32 parallaxSteps = 8;
 float parallaxScale = 0.05f;
 
-// NOTE: Temporary deferred ubo struct, will change once proper lights are implemented
-constexpr u32 MAX_POINT_LIGHTS = 20;
+// NOTE: Temporary deferred ubo struct. Point lights are read from the LightManager buffers.
 struct DeferredUBO {
     alignas(16) glm::mat4 view;
     alignas(16) glm::mat4 invProj;
     alignas(16) glm::vec4 camPos;
 
     alignas(16) CascadedShadowMap::ShadowDataUBO shadowData;
+    alignas(16) ClusteredLights::ClusterDataUBO clusterData;
 
-    int pointLightCount;
     DirectionalLight dirLight;
-    PointLight pointLights[MAX_POINT_LIGHTS];
+};
+
+// GPU timestamp slots written by Render, and read back MaxFramesInFlight frames later.
+enum GPUTimestamp : u32 {
+    TIMESTAMP_FRAME_BEGIN,
+    TIMESTAMP_GBUFFER_BEGIN,
+    TIMESTAMP_PREPASS_END,
+    TIMESTAMP_GBUFFER_END,
+    TIMESTAMP_LIGHTING_BEGIN,
+    TIMESTAMP_LIGHTING_END,
+    TIMESTAMP_FRAME_END
 };
 
 // Struct to hold all GBuffer rendering resources.
@@ -110,14 +129,28 @@ struct GBuffer {
 
     Handle<Texture> albedo = {};
     Handle<Texture> normal = {};
-    Handle<Texture> metallicRoughness = {};
+    Handle<Texture> roughnessAO = {};
     Handle<Texture> depth = {};
 
+    // Output of the tiled compute lighting pass, copied to the swapchain by the blit pipeline.
+    Handle<Texture> lighting = {};
+
     Handle<BindGroupLayout> globalsLayout = {};
     Handle<BindGroupLayout> materialLayout = {};
+    Handle<BindGroupLayout> drawLayout = {};
 
     Handle<Pipeline> offscreen = {};
+    Handle<Pipeline> offscreenEqual = {};
+    Handle<Pipeline> depthPrepassPipeline = {};
     Handle<Pipeline> deferred = {};
+    Handle<Pipeline> tiledDeferred = {};
+    Handle<Pipeline> blit = {};
+    Handle<Pipeline> lightVolume = {};
+
+    Handle<BindGroupLayout> lightingLayout = {};
+    Handle<BindGroupLayout> blitLayout = {};
+    Handle<BindGroup> lightingBindings = {};
+    Handle<BindGroup> blitBindings = {};
 
     Handle<Buffer> deferredUBO[Device::MaxFramesInFlight] = {};
     Handle<BindGroup> deferredBindings[Device::MaxFramesInFlight] = {};
@@ -126,22 +159,41 @@ struct GBuffer {
     struct {
         u32 renderMode = 0;
         u32 colorCascades = 0;
-        u32 enablePCF = 1;
         u32 enableGTAO = 1;
     } settings;
+
+    // PCF taps per shadow lookup, specialized into the deferred pipeline. The pipelines are recreated when it changes.
+    u32  pcfTaps = 4;
+    bool rebuildPipelines = false;
+
+    // Render the GBuffer through a visibility buffer, resolving the materials once per pixel, instead of the offscreen pass.
+    bool visibilityBuffer = false;
+
+    // Lay down the depth of the non-discarding materials in a position-only prepass, then shade them in the GBuffer pass
+    // with an equal depth test, so only the visible fragment of each pixel samples its material. Discarding (parallax mapped)
+    // materials are left out of the prepass, and drawn with the regular depth test after the prepassed materials.
+    bool depthPrepass = false;
+
+    // Light the GBuffer with the tiled compute pass instead of the full-screen fragment pass.
+    bool computeLighting = false;
+
+    // Shade the point lights of the fragment path with one additive draw per light, limited to the light's screen bounds by
+    // the scissor and depth bounds tests. The deferred pipeline is specialized on this setting.
+    bool lightVolumes = false;
+    std::vector<LightVolume> volumes;
 } gbuffer = {};
 
-// Create/destroy the GBuffer
-void CreateGBuffer(CascadedShadowMap* shadowMap, GTAO* gtao);
+// Create/destroy the GBuffer. Pipelines are created separately, as they depend on the shadow map, GTAO and light bindgroup layouts.
+void CreateGBuffer();
 void DestroyGBuffer();
-static void CreateGBufferPipelines(CascadedShadowMap* shadowMap, GTAO* gtao);
+static void CreateGBufferPipelines(CascadedShadowMap* shadowMap, GTAO* gtao, ClusteredLights* lights);
 static void DestroyGBufferPipelines();
 
 // Update the GBuffer on window resize
 void ResizeGBuffer();
 
 // Update the GBuffer UBO. This must be called *after*  successful Device.BeginFrame() call to avoid a race condition
-void UpdateGBufferUBO(CascadedShadowMap* shadowMap);
+void UpdateGBufferUBO(CascadedShadowMap* shadowMap, ClusteredLights* lights);
 
 struct Skybox {
     Handle<Texture> texture;
@@ -159,8 +211,8 @@ void DestroySkybox();
 // The user-specified ImGui overlay render callback.
 void ImGuiRenderCallback();
 
-// Render models with a given shadowMap, GTAO and UIOverlay.
-void Render(Device* device, CascadedShadowMap* shadowMap, GTAO* gtao, UIOverlay* UI, span<const GLTFModel* const> models);
+// Render models with a given shadowMap, GTAO, point lights, visibility buffer and UIOverlay.
+void Render(Device* device, CascadedShadowMap* shadowMap, GTAO* gtao, ClusteredLights* lights, VisibilityBuffer* visibility, UIOverlay* UI, span<GLTFModel* const> models);
 
 
 int main(int argc, char* argv[]) {
@@ -182,17 +234,30 @@ int main(int argc, char* argv[]) {
     // -- Create UI overlay, 3D camera, shadow map, skybox and rendering resources -- 
     UIOverlay* UI = new UIOverlay(window, device, device->GetSwapchainFormat(), Format::D24_UNORM_S8_UINT, ImGuiRenderCallback);
     camera = new Camera(glm::vec3(0.0f, 1.5f, 1.0f), 1.0f, 60.0f, (float)WIDTH / HEIGHT, 0.01f, 0.0f, -30.0f);
-    CascadedShadowMap* shadowMap = new CascadedShadowMap(1024 * 2, camera, { {0.0f, 3.0f}, {2.5f, 12.0f}, {11.0f, 32.0f}, {30.0f, 128.0f} });
-    CreateGBuffer(shadowMap, nullptr);
+    CreateGBuffer();
+    CascadedShadowMap* shadowMap = new CascadedShadowMap(4096, camera, gbuffer.drawLayout, gbuffer.depth, {
+        { {0.0f, 3.0f},    2048 },
+        { {2.5f, 12.0f},   2048 },
+        { {11.0f, 32.0f},  2048 },
+        { {30.0f, 128.0f}, 2048 }
+    });
     GTAO* gtao = new GTAO(gbuffer.extent.width, gbuffer.extent.height, gbuffer.depth, gbuffer.normal);
+    VisibilityBuffer* visibility = new VisibilityBuffer(gbuffer.extent.width, gbuffer.extent.height, gbuffer.depth,
+        { gbuffer.albedo, gbuffer.normal, gbuffer.roughnessAO }, gbuffer.globalsLayout, gbuffer.materialLayout, gbuffer.drawLayout);
+    LightManager* lightManager = new LightManager();
+    ClusteredLights* lights = new ClusteredLights(camera, lightManager);
     g_gtao = gtao;
-    CreateGBufferPipelines(shadowMap, gtao);
+    g_shadowMap = shadowMap;
+    g_lights = lights;
+    g_lightManager = lightManager;
+    SetPointLightCount(pointLightCount);
+    CreateGBufferPipelines(shadowMap, gtao, lights);
     CreateSkybox();
 
 
     // -- Load 3D models --
-    GLTFModel* rocks  = new GLTFModel(device, gbuffer.materialLayout, "Assets/ParallaxTest/rocks.gltf");
-    GLTFModel* sponza = new GLTFModel(device, gbuffer.materialLayout, "Assets/Sponza/Sponza.gltf");
+    GLTFModel* rocks  = new GLTFModel(device, gbuffer.materialLayout, gbuffer.drawLayout, "Assets/ParallaxTest/rocks.gltf");
+    GLTFModel* sponza = new GLTFModel(device, gbuffer.materialLayout, gbuffer.drawLayout, "Assets/Sponza/Sponza.gltf");
 
 
     // -- Main loop --
@@ -213,13 +278,28 @@ int main(int argc, char* argv[]) {
             dirLight.direction = glm::vec3(glm::cos(t), -1.0f, 0.3f * glm::sin(t));
         }
 
-        Render(device, shadowMap, gtao, UI, { sponza, rocks });
+        // Static lights are left untouched, so their buffers are only re-uploaded when the camera moves.
+        if (bAnimatePointLights)
+            PlacePointLights(float(currentFrame));
+
+        Render(device, shadowMap, gtao, lights, visibility, UI, { sponza, rocks });
+
+        // Pipelines specialized on GUI settings are rebuilt outside of the frame, once the GPU is done with the old ones.
+        if (gbuffer.rebuildPipelines) {
+            device->WaitIdle();
+            shadowMap->UpdateMoments();
+            DestroyGBufferPipelines();
+            CreateGBufferPipelines(shadowMap, gtao, lights);
+            gbuffer.rebuildPipelines = false;
+        }
 
         // If the window was resized, we also have to resize the GBuffer and update the camera aspect
         Extent2D swapchainExtent = device->GetSwapchainExtent();
         if (swapchainExtent.width != gbuffer.extent.width || swapchainExtent.height != gbuffer.extent.height) {
             ResizeGBuffer();
             gtao->Resize(swapchainExtent.width, swapchainExtent.height, gbuffer.depth, gbuffer.normal);
+            visibility->Resize(swapchainExtent.width, swapchainExtent.height, gbuffer.depth, { gbuffer.albedo, gbuffer.normal, gbuffer.roughnessAO });
+            shadowMap->SetDepthBuffer(gbuffer.depth);
             camera->aspect = (float)swapchainExtent.width / swapchainExtent.height;
         }
 
@@ -234,6 +314,9 @@ int main(int argc, char* argv[]) {
     delete sponza;
     delete rocks;
 
+    delete lights;
+    delete lightManager;
+    delete visibility;
     delete gtao;
     delete shadowMap;
     delete camera;
@@ -246,40 +329,125 @@ int main(int argc, char* argv[]) {
 }
 
 
-void Render(Device* device, CascadedShadowMap* shadowMap, GTAO* gtao, UIOverlay* UI, span<const GLTFModel* const> models) {
+void Render(Device* device, CascadedShadowMap* shadowMap, GTAO* gtao, ClusteredLights* lights, VisibilityBuffer* visibility, UIOverlay* UI, span<GLTFModel* const> models) {
     if (!device->BeginFrame()) {
         return;
     }
 
     UI->Update();
     camera->UpdateUBO();
-    shadowMap->UpdateCascadeUBO(dirLight.direction);
-    UpdateGBufferUBO(shadowMap);
+
+    // Models must be updated before the cascades, which check for moved casters to decide what to re-render.
+    for (GLTFModel* model : models)
+        model->Update();
+
+    // Cull the models against the camera frustum. View 0 of each model holds the draws visible to the camera,
+    // which are also the receivers the shadow casters are culled against.
+    const Frustum cameraFrustum = Frustum::FromMatrix(camera->projection * camera->view);
+
+    UI->stats.camera = {};
+    for (GLTFModel* model : models) {
+        u32 drawn = model->Cull(0, cameraFrustum);
+        UI->stats.camera.tested += model->DrawCount();
+        UI->stats.camera.drawn  += drawn;
+        UI->stats.camera.culled += model->DrawCount() - drawn;
+    }
+
+    shadowMap->UpdateCascadeUBO(dirLight.direction, models);
+    g_lightManager->Update(camera->view);
+    lights->Update();
+    UpdateGBufferUBO(shadowMap, lights);
     gtao->Update(camera->projection, glm::inverse(camera->projection));
 
     CommandBuffer& cmd = device->GetFrameCommandBuffer();
+    cmd.WriteTimestamp(TIMESTAMP_FRAME_BEGIN);
+
+    UI->stats.gpuFrameTime    = device->GetTimestampDelta(TIMESTAMP_FRAME_BEGIN, TIMESTAMP_FRAME_END);
+    UI->stats.gpuGBufferTime  = device->GetTimestampDelta(TIMESTAMP_GBUFFER_BEGIN, TIMESTAMP_GBUFFER_END);
+    UI->stats.gpuPrepassTime  = device->GetTimestampDelta(TIMESTAMP_GBUFFER_BEGIN, TIMESTAMP_PREPASS_END);
+    UI->stats.gpuLightingTime = device->GetTimestampDelta(TIMESTAMP_LIGHTING_BEGIN, TIMESTAMP_LIGHTING_END);
 
     shadowMap->Render(cmd, models);
 
+    UI->stats.cascadeCount = shadowMap->CascadeCount();
+    for (u32 i = 0; i < shadowMap->CascadeCount(); i++) {
+        UI->stats.cascades[i] = {
+            .tested = shadowMap->m_stats[i].tested,
+            .culled = shadowMap->m_stats[i].tested - shadowMap->m_stats[i].drawn,
+            .drawn  = shadowMap->m_stats[i].drawn,
+            .cached = shadowMap->m_stats[i].cached
+        };
+    }
+
     Extent2D extent = device->GetSwapchainExtent();
     cmd.SetViewport((float)extent.width, (float)extent.height);
     cmd.SetScissor({ .offset = {0, 0}, .extent = extent });
 
-    // -- Offscreen GBuffer pass --
-    cmd.SetPipeline(gbuffer.offscreen);
-    cmd.SetBindGroup(camera->GetCameraBindings(), 0);
-
     // Transition gbuffer resources to RT
     cmd.ImageBarrier(gbuffer.albedo, Usage::SHADER_RESOURCE, Usage::RENDER_TARGET);
     cmd.ImageBarrier(gbuffer.normal, Usage::SHADER_RESOURCE, Usage::RENDER_TARGET);
-    cmd.ImageBarrier(gbuffer.metallicRoughness, Usage::SHADER_RESOURCE, Usage::RENDER_TARGET);
+    cmd.ImageBarrier(gbuffer.roughnessAO, Usage::SHADER_RESOURCE, Usage::RENDER_TARGET);
 
-    cmd.BeginRendering(extent, { gbuffer.albedo, gbuffer.normal, gbuffer.metallicRoughness }, gbuffer.depth);
+    // The GBuffer pass is timed including its depth prepass, as the prepass trades vertex work for fragment work.
+    cmd.WriteTimestamp(TIMESTAMP_GBUFFER_BEGIN);
 
-    for (const GLTFModel* model : models)
-        model->Draw(cmd);
+    if (gbuffer.visibilityBuffer) {
+        // -- Visibility buffer pass and material resolve --
+        visibility->Render(cmd, camera->GetCameraBindings(), models);
 
-    cmd.EndRendering();
+        // -- Offscreen GBuffer pass of the discarding materials, loading the resolved GBuffer and its depth --
+        cmd.BeginRendering(extent, { gbuffer.albedo, gbuffer.normal, gbuffer.roughnessAO }, gbuffer.depth, false, false, false);
+
+        cmd.SetPipeline(gbuffer.offscreen);
+        cmd.SetBindGroup(camera->GetCameraBindings(), 0);
+        for (const GLTFModel* model : models)
+            model->Draw(cmd, 0, false, GLTFModel::MaterialFilter::DISCARDING);
+
+        cmd.EndRendering();
+    }
+    else if (gbuffer.depthPrepass) {
+        // -- Depth prepass --
+        cmd.SetPipeline(gbuffer.depthPrepassPipeline);
+        cmd.SetBindGroup(camera->GetCameraBindings(), 0);
+
+        cmd.BeginRendering(gbuffer.depth, 0, extent.width, extent.height);
+
+        for (const GLTFModel* model : models)
+            model->Draw(cmd, 0, true, GLTFModel::MaterialFilter::NON_DISCARDING);
+
+        cmd.EndRendering();
+
+        cmd.WriteTimestamp(TIMESTAMP_PREPASS_END);
+
+        // -- Offscreen GBuffer pass, loading the prepass depth --
+        cmd.BeginRendering(extent, { gbuffer.albedo, gbuffer.normal, gbuffer.roughnessAO }, gbuffer.depth, false, false);
+
+        cmd.SetPipeline(gbuffer.offscreenEqual);
+        cmd.SetBindGroup(camera->GetCameraBindings(), 0);
+        for (const GLTFModel* model : models)
+            model->Draw(cmd, 0, false, GLTFModel::MaterialFilter::NON_DISCARDING);
+
+        cmd.SetPipeline(gbuffer.offscreen);
+        cmd.SetBindGroup(camera->GetCameraBindings(), 0);
+        for (const GLTFModel* model : models)
+            model->Draw(cmd, 0, false, GLTFModel::MaterialFilter::DISCARDING);
+
+        cmd.EndRendering();
+    }
+    else {
+        // -- Offscreen GBuffer pass --
+        cmd.SetPipeline(gbuffer.offscreen);
+        cmd.SetBindGroup(camera->GetCameraBindings(), 0);
+
+        cmd.BeginRendering(extent, { gbuffer.albedo, gbuffer.normal, gbuffer.roughnessAO }, gbuffer.depth);
+
+        for (const GLTFModel* model : models)
+            model->Draw(cmd, 0);
+
+        cmd.EndRendering();
+    }
+
+    cmd.WriteTimestamp(TIMESTAMP_GBUFFER_END);
 
     // Transition depth and normal for GTAO to read
     cmd.ImageBarrier(gbuffer.normal, Usage::RENDER_TARGET, Usage::SHADER_RESOURCE);
@@ -288,21 +456,87 @@ void Render(Device* device, CascadedShadowMap* shadowMap, GTAO* gtao, UIOverlay*
     // -- GTAO pass --
     gtao->Render(cmd);
 
+    // -- Depth reduction for SDSM, read back by the shadow map in a later frame --
+    shadowMap->ReduceDepth(cmd, extent.width, extent.height);
+
+    // -- Bin the point lights into clusters for the deferred pass. Light volumes are bounded on the CPU instead --
+    const bool lightVolumes = gbuffer.lightVolumes && !gbuffer.computeLighting && gbuffer.settings.renderMode == 0;
+    if (!lightVolumes)
+        lights->CullLights(cmd);
+
     // Transition remaining gbuffer resources for deferred pass
     cmd.ImageBarrier(gbuffer.albedo, Usage::RENDER_TARGET, Usage::SHADER_RESOURCE);
-    cmd.ImageBarrier(gbuffer.metallicRoughness, Usage::RENDER_TARGET, Usage::SHADER_RESOURCE);
+    cmd.ImageBarrier(gbuffer.roughnessAO, Usage::RENDER_TARGET, Usage::SHADER_RESOURCE);
 
     // -- Deferred pass --
-    cmd.SetPipeline(gbuffer.deferred);
-    cmd.SetBindGroup(gbuffer.deferredBindings[device->FrameIdx()], 0);
-    cmd.SetBindGroup(gbuffer.offscreenBindings[device->FrameIdx()], 1);
-    cmd.SetBindGroup(shadowMap->GetShadowBindings(), 2);
-    cmd.SetBindGroup(gtao->GetAOBindings(), 3);
-    cmd.PushConstants(&gbuffer.settings, 0, sizeof(gbuffer.settings), ShaderStage::FRAGMENT);
-
-    cmd.BeginRenderingSwapchain();
-    cmd.Draw(3, 1, 0, 0);
-    cmd.EndRendering();
+    // The compute path is timed including the copy to the swapchain, as the fragment path writes to it directly.
+    cmd.WriteTimestamp(TIMESTAMP_LIGHTING_BEGIN);
+
+    if (gbuffer.computeLighting) {
+        cmd.ImageBarrier(gbuffer.lighting, Usage::SHADER_RESOURCE, Usage::UNORDERED_ACCESS);
+
+        cmd.SetPipeline(gbuffer.tiledDeferred);
+        cmd.SetBindGroup(gbuffer.deferredBindings[device->FrameIdx()], 0);
+        cmd.SetBindGroup(gbuffer.offscreenBindings[device->FrameIdx()], 1);
+        cmd.SetBindGroup(shadowMap->GetShadowBindings(), 2);
+        cmd.SetBindGroup(gtao->GetAOBindings(), 3);
+        cmd.SetBindGroup(lights->GetLightBindings(), 4);
+        cmd.SetBindGroup(gbuffer.lightingBindings, 5);
+        cmd.PushConstants(&gbuffer.settings, 0, sizeof(gbuffer.settings), ShaderStage::COMPUTE);
+        cmd.Dispatch((extent.width + 15) / 16, (extent.height + 15) / 16, 1);
+
+        cmd.ImageBarrier(gbuffer.lighting, Usage::UNORDERED_ACCESS, Usage::SHADER_RESOURCE);
+
+        cmd.SetPipeline(gbuffer.blit);
+        cmd.SetBindGroup(gbuffer.blitBindings, 0);
+
+        cmd.BeginRenderingSwapchain();
+        cmd.Draw(3, 1, 0, 0);
+        cmd.EndRendering();
+    }
+    else {
+        // Depth is bound read-only, so the depth bounds test can skip the sky pixels, which are covered by the skybox pass.
+        cmd.BeginRenderingSwapchain(gbuffer.depth, true);
+
+        cmd.SetPipeline(gbuffer.deferred);
+        cmd.SetBindGroup(gbuffer.deferredBindings[device->FrameIdx()], 0);
+        cmd.SetBindGroup(gbuffer.offscreenBindings[device->FrameIdx()], 1);
+        cmd.SetBindGroup(shadowMap->GetShadowBindings(), 2);
+        cmd.SetBindGroup(gtao->GetAOBindings(), 3);
+        cmd.SetBindGroup(lights->GetLightBindings(), 4);
+        cmd.PushConstants(&gbuffer.settings, 0, sizeof(gbuffer.settings), ShaderStage::FRAGMENT);
+        cmd.SetDepthBounds(Camera::MinSurfaceDepth, 1.0f);
+        cmd.Draw(3, 1, 0, 0);
+
+        // -- Light volume pass --
+        // Every light is drawn as a full-screen triangle clipped by the scissor to the light's screen bounds, and by the
+        // depth bounds test to the pixels whose depth lies within the light's depth range. Sky pixels are always rejected.
+        if (lightVolumes) {
+            g_lightManager->GetLightVolumes(camera->projection, extent, gbuffer.volumes);
+
+            cmd.SetPipeline(gbuffer.lightVolume);
+            cmd.SetBindGroup(gbuffer.deferredBindings[device->FrameIdx()], 0);
+            cmd.SetBindGroup(gbuffer.offscreenBindings[device->FrameIdx()], 1);
+            cmd.SetBindGroup(shadowMap->GetShadowBindings(), 2);
+            cmd.SetBindGroup(gtao->GetAOBindings(), 3);
+            cmd.SetBindGroup(lights->GetLightBindings(), 4);
+            cmd.PushConstants(&gbuffer.settings, 0, sizeof(gbuffer.settings), ShaderStage::FRAGMENT);
+
+            for (LightVolume& volume : gbuffer.volumes) {
+                // The light index follows the settings in the push constants.
+                cmd.PushConstants(&volume.light, sizeof(gbuffer.settings), sizeof(u32), ShaderStage::FRAGMENT);
+                cmd.SetScissor(volume.scissor);
+                cmd.SetDepthBounds(volume.minDepth, volume.maxDepth);
+                cmd.Draw(3, 1, 0, 0);
+            }
+
+            cmd.SetScissor({ .offset = {0, 0}, .extent = extent });
+        }
+
+        cmd.EndRendering();
+    }
+
+    cmd.WriteTimestamp(TIMESTAMP_LIGHTING_END);
 
     // -- Skybox pass --
     cmd.SetPipeline(skybox.pipeline);
@@ -320,6 +554,7 @@ void Render(Device* device, CascadedShadowMap* shadowMap, GTAO* gtao, UIOverlay*
 
     UI->Render(cmd);
 
+    cmd.WriteTimestamp(TIMESTAMP_FRAME_END);
     device->EndFrame();
 }
 
@@ -449,7 +684,7 @@ void CreateSkybox() {
             .depthStencilState = {.depthStencilFormat = Format::D24_UNORM_S8_UINT },
             .rasterizationState = {.cullMode = CullMode::Front },
             .vertexInputState = {
-                .vertexStride = sizeof(glm::vec3),
+                .bindingStrides = { sizeof(glm::vec3) },
                 .attributes = { {.offset = 0, .format = Format::RGB32_SFLOAT} }
             }
         }
@@ -470,9 +705,9 @@ static void CreateGBufferResources() {
     ResourceManager* rm = ResourceManager::ptr;
     Device* device = Device::ptr;
 
-    // Create GBuffer textures
+    // Create GBuffer textures. See Shaders/gbuffer.hlsli for the layout.
     gbuffer.albedo = rm->CreateTexture({
-        .debugName = "GBuffer Albedo",
+        .debugName = "GBuffer Albedo/Metallic",
         .width = gbuffer.extent.width, .height = gbuffer.extent.height,
         .format = Format::RGBA8_UNORM,
         .usage = Usage::RENDER_TARGET | Usage::SHADER_RESOURCE
@@ -481,14 +716,14 @@ static void CreateGBufferResources() {
     gbuffer.normal = rm->CreateTexture({
         .debugName = "GBuffer Normal",
         .width = gbuffer.extent.width, .height = gbuffer.extent.height,
-        .format = Format::RGBA8_UNORM,
+        .format = Format::RG16_UNORM,
         .usage = Usage::RENDER_TARGET | Usage::SHADER_RESOURCE
     });
 
-    gbuffer.metallicRoughness = rm->CreateTexture({
-        .debugName = "GBuffer Metallic/Roughness",
+    gbuffer.roughnessAO = rm->CreateTexture({
+        .debugName = "GBuffer Roughness/AO",
         .width = gbuffer.extent.width, .height = gbuffer.extent.height,
-        .format = Format::RGBA8_UNORM,
+        .format = Format::RG8_UNORM,
         .usage = Usage::RENDER_TARGET | Usage::SHADER_RESOURCE
     });
 
@@ -499,12 +734,20 @@ static void CreateGBufferResources() {
         .usage = Usage::DEPTH_STENCIL | Usage::SHADER_RESOURCE
     });
 
+    gbuffer.lighting = rm->CreateTexture({
+        .debugName = "Tiled deferred lighting",
+        .width = gbuffer.extent.width, .height = gbuffer.extent.height,
+        .format = Format::RGBA16_SFLOAT,
+        .usage = Usage::UNORDERED_ACCESS | Usage::SHADER_RESOURCE
+    });
+
     // rm will transition them to attachment layout but render loop expects them to start in shader readonly layout.
     CommandBuffer& cmd = device->GetCommandBuffer();
 
     cmd.ImageBarrier(gbuffer.albedo, Usage::RENDER_TARGET, Usage::SHADER_RESOURCE);
     cmd.ImageBarrier(gbuffer.normal, Usage::RENDER_TARGET, Usage::SHADER_RESOURCE);
-    cmd.ImageBarrier(gbuffer.metallicRoughness, Usage::RENDER_TARGET, Usage::SHADER_RESOURCE);
+    cmd.ImageBarrier(gbuffer.roughnessAO, Usage::RENDER_TARGET, Usage::SHADER_RESOURCE);
+    cmd.ImageBarrier(gbuffer.lighting, Usage::UNORDERED_ACCESS, Usage::SHADER_RESOURCE);
 
     device->FlushCommandBuffer(cmd);
 }
@@ -515,16 +758,50 @@ static void CreateGBufferBindings() {
     // Create bindgroup layouts
     gbuffer.globalsLayout = rm->CreateBindGroupLayout({
         .debugName = "Globals bindgroup layout",
-        .bindings = { {.type = Binding::Type::BUFFER, .stages = ShaderStage::VERTEX | ShaderStage::FRAGMENT } }
+        .bindings = { {.type = Binding::Type::BUFFER, .stages = ShaderStage::VERTEX | ShaderStage::FRAGMENT | ShaderStage::COMPUTE } }
     });
 
+    // Also used for the GBuffer textures, which are read by the tiled compute lighting pass.
     gbuffer.materialLayout = rm->CreateBindGroupLayout({
         .debugName = "Material bindgroup layout",
         .bindings = {
-            {.type = Binding::Type::TEXTURE, .stages = ShaderStage::FRAGMENT },
-            {.type = Binding::Type::TEXTURE, .stages = ShaderStage::FRAGMENT },
-            {.type = Binding::Type::TEXTURE, .stages = ShaderStage::FRAGMENT },
-            {.type = Binding::Type::TEXTURE, .stages = ShaderStage::FRAGMENT },
+            {.type = Binding::Type::TEXTURE, .stages = ShaderStage::FRAGMENT | ShaderStage::COMPUTE },
+            {.type = Binding::Type::TEXTURE, .stages = ShaderStage::FRAGMENT | ShaderStage::COMPUTE },
+            {.type = Binding::Type::TEXTURE, .stages = ShaderStage::FRAGMENT | ShaderStage::COMPUTE },
+            {.type = Binding::Type::TEXTURE, .stages = ShaderStage::FRAGMENT | ShaderStage::COMPUTE },
+        }
+    });
+
+    gbuffer.lightingLayout = rm->CreateBindGroupLayout({
+        .debugName = "Tiled deferred output bindgroup layout",
+        .bindings = { {.type = Binding::Type::STORAGE_TEXTURE, .stages = ShaderStage::COMPUTE } }
+    });
+
+    gbuffer.blitLayout = rm->CreateBindGroupLayout({
+        .debugName = "Blit bindgroup layout",
+        .bindings = { {.type = Binding::Type::TEXTURE, .stages = ShaderStage::FRAGMENT } }
+    });
+
+    gbuffer.lightingBindings = rm->CreateBindGroup({
+        .debugName = "Tiled deferred output bindgroup",
+        .layout = gbuffer.lightingLayout,
+        .textures = { { 0, gbuffer.lighting } }
+    });
+
+    gbuffer.blitBindings = rm->CreateBindGroup({
+        .debugName = "Blit bindgroup",
+        .layout = gbuffer.blitLayout,
+        .textures = { { 0, gbuffer.lighting } }
+    });
+
+    gbuffer.drawLayout = rm->CreateBindGroupLayout({
+        .debugName = "Draw data bindgroup layout",
+        .bindings = {
+            {.type = Binding::Type::STORAGE_BUFFER, .stages = ShaderStage::VERTEX | ShaderStage::FRAGMENT },
+            {.type = Binding::Type::STORAGE_BUFFER, .stages = ShaderStage::FRAGMENT },
+            {.type = Binding::Type::STORAGE_BUFFER, .stages = ShaderStage::FRAGMENT },
+            {.type = Binding::Type::STORAGE_BUFFER, .stages = ShaderStage::FRAGMENT },
+            {.type = Binding::Type::STORAGE_BUFFER, .stages = ShaderStage::FRAGMENT }
         }
     });
 
@@ -536,7 +813,7 @@ static void CreateGBufferBindings() {
             .textures = {
                 { 0, gbuffer.albedo },
                 { 1, gbuffer.normal },
-                { 2, gbuffer.metallicRoughness },
+                { 2, gbuffer.roughnessAO },
                 { 3, gbuffer.depth }
             }
         });
@@ -559,7 +836,7 @@ static void CreateGBufferBindings() {
     }
 }
 
-static void CreateGBufferPipelines(CascadedShadowMap* shadowMap, GTAO* gtao) {
+static void CreateGBufferPipelines(CascadedShadowMap* shadowMap, GTAO* gtao, ClusteredLights* lights) {
     // Create Offscreen pipeline
     std::vector<u32> offscreenVert = ReadShaderSpv("Shaders/offscreen.vert.spv");
     std::vector<u32> offscreenFrag = ReadShaderSpv("Shaders/offscreen.frag.spv");
@@ -570,14 +847,47 @@ static void CreateGBufferPipelines(CascadedShadowMap* shadowMap, GTAO* gtao) {
             {.spirv = offscreenVert, .stage = ShaderStage::VERTEX},
             {.spirv = offscreenFrag, .stage = ShaderStage::FRAGMENT}
         },
-        .bindgroupLayouts = { gbuffer.globalsLayout, gbuffer.materialLayout },
+        .bindgroupLayouts = { gbuffer.globalsLayout, gbuffer.materialLayout, gbuffer.drawLayout },
         .graphicsState = {
-            .colorAttachments = { Format::RGBA8_UNORM, Format::RGBA8_UNORM, Format::RGBA8_UNORM },
+            .colorAttachments = { Format::RGBA8_UNORM, Format::RG16_UNORM, Format::RG8_UNORM },
             .depthStencilState = {.depthStencilFormat = Format::D24_UNORM_S8_UINT },
             .vertexInputState = GLTFModel::Vertex::InputState
         }
     });
 
+    // Create the offscreen pipeline used after the depth prepass. Fragments are only shaded if they are the ones whose depth
+    // the prepass wrote, which is already in the depth buffer.
+    gbuffer.offscreenEqual = ResourceManager::ptr->CreatePipeline({
+        .debugName = "Offscreen equal depth pipeline",
+        .shaderDescs = {
+            {.spirv = offscreenVert, .stage = ShaderStage::VERTEX},
+            {.spirv = offscreenFrag, .stage = ShaderStage::FRAGMENT}
+        },
+        .bindgroupLayouts = { gbuffer.globalsLayout, gbuffer.materialLayout, gbuffer.drawLayout },
+        .graphicsState = {
+            .colorAttachments = { Format::RGBA8_UNORM, Format::RG16_UNORM, Format::RG8_UNORM },
+            .depthStencilState = {
+                .depthStencilFormat = Format::D24_UNORM_S8_UINT,
+                .depthWriteEnable = false,
+                .depthCompareOp = CompareOp::Equal
+            },
+            .vertexInputState = GLTFModel::Vertex::InputState
+        }
+    });
+
+    // Create depth prepass pipeline. Only positions are read, and no fragment shader is run.
+    std::vector<u32> depthPrepassVert = ReadShaderSpv("Shaders/depthPrepass.vert.spv");
+
+    gbuffer.depthPrepassPipeline = ResourceManager::ptr->CreatePipeline({
+        .debugName = "Depth prepass pipeline",
+        .shaderDescs = { {.spirv = depthPrepassVert, .stage = ShaderStage::VERTEX} },
+        .bindgroupLayouts = { gbuffer.globalsLayout, gbuffer.drawLayout },
+        .graphicsState = {
+            .depthStencilState = {.depthStencilFormat = Format::D24_UNORM_S8_UINT },
+            .vertexInputState = GLTFModel::Vertex::PositionInputState
+        }
+    });
+
     // Create Deferred pipeline
     std::vector<u32> deferredVert = ReadShaderSpv("Shaders/deferred.vert.spv");
     std::vector<u32> deferredFrag = ReadShaderSpv("Shaders/deferred.frag.spv");
@@ -586,47 +896,122 @@ static void CreateGBufferPipelines(CascadedShadowMap* shadowMap, GTAO* gtao) {
         .debugName = "Deferred pipeline",
         .shaderDescs = {
             {.spirv = deferredVert, .stage = ShaderStage::VERTEX},
-            {.spirv = deferredFrag, .stage = ShaderStage::FRAGMENT}
+            {.spirv = deferredFrag, .stage = ShaderStage::FRAGMENT, .specialization = {
+                {.id = 0, .value = gbuffer.pcfTaps },
+                {.id = 1, .value = shadowMap->settings.evsm },
+                {.id = 2, .value = gbuffer.lightVolumes }
+            } }
+        },
+        .bindgroupLayouts = {
+            gbuffer.globalsLayout, gbuffer.materialLayout, shadowMap->GetShadowBindingsLayout(), gtao->GetAOBindingsLayout(), lights->GetLightBindingsLayout()
         },
-        .bindgroupLayouts = { gbuffer.globalsLayout, gbuffer.materialLayout, shadowMap->GetShadowBindingsLayout(), gtao->GetAOBindingsLayout() },
         .graphicsState = {
             .colorAttachments = { Format::BGRA8_SRGB },
-            .depthStencilState = {.depthStencilFormat = Format::D24_UNORM_S8_UINT },
+            .depthStencilState = {
+                .depthStencilFormat = Format::D24_UNORM_S8_UINT,
+                .depthTestEnable = false,
+                .depthWriteEnable = false,
+                .depthBoundsTestEnable = true
+            },
+            .rasterizationState = {.cullMode = CullMode::Front }
+        }
+    });
+
+    // Create tiled deferred compute pipeline, sharing the bindgroups of the deferred pipeline
+    std::vector<u32> tiledDeferredComp = ReadShaderSpv("Shaders/tiledDeferred.comp.spv");
+
+    gbuffer.tiledDeferred = ResourceManager::ptr->CreatePipeline({
+        .debugName = "Tiled deferred pipeline",
+        .shaderDescs = {
+            {.spirv = tiledDeferredComp, .stage = ShaderStage::COMPUTE, .specialization = {
+                {.id = 0, .value = gbuffer.pcfTaps },
+                {.id = 1, .value = shadowMap->settings.evsm }
+            } }
+        },
+        .bindgroupLayouts = {
+            gbuffer.globalsLayout, gbuffer.materialLayout, shadowMap->GetShadowBindingsLayout(), gtao->GetAOBindingsLayout(), lights->GetLightBindingsLayout(),
+            gbuffer.lightingLayout
+        }
+    });
+
+    // Create blit pipeline, copying the tiled deferred output to the swapchain
+    std::vector<u32> blitFrag = ReadShaderSpv("Shaders/blit.frag.spv");
+
+    gbuffer.blit = ResourceManager::ptr->CreatePipeline({
+        .debugName = "Blit pipeline",
+        .shaderDescs = {
+            {.spirv = deferredVert, .stage = ShaderStage::VERTEX},
+            {.spirv = blitFrag,     .stage = ShaderStage::FRAGMENT}
+        },
+        .bindgroupLayouts = { gbuffer.blitLayout },
+        .graphicsState = {
+            .colorAttachments = { Format::BGRA8_SRGB },
+            .depthStencilState = {},
+            .rasterizationState = {.cullMode = CullMode::Front }
+        }
+    });
+
+    // Create light volume pipeline, adding the contribution of a single point light to the deferred output.
+    // Depth is bound read-only: it is only used for the depth bounds test, while the shader samples it to reconstruct positions.
+    std::vector<u32> lightVolumeFrag = ReadShaderSpv("Shaders/lightVolume.frag.spv");
+
+    gbuffer.lightVolume = ResourceManager::ptr->CreatePipeline({
+        .debugName = "Light volume pipeline",
+        .shaderDescs = {
+            {.spirv = deferredVert,    .stage = ShaderStage::VERTEX},
+            {.spirv = lightVolumeFrag, .stage = ShaderStage::FRAGMENT}
+        },
+        .bindgroupLayouts = {
+            gbuffer.globalsLayout, gbuffer.materialLayout, shadowMap->GetShadowBindingsLayout(), gtao->GetAOBindingsLayout(), lights->GetLightBindingsLayout()
+        },
+        .graphicsState = {
+            .colorAttachments = { Format::BGRA8_SRGB },
+            .blendStates = { Blend::ADDITIVE(0xF) },
+            .depthStencilState = {
+                .depthStencilFormat = Format::D24_UNORM_S8_UINT,
+                .depthTestEnable = false,
+                .depthWriteEnable = false,
+                .depthBoundsTestEnable = true
+            },
             .rasterizationState = {.cullMode = CullMode::Front }
         }
     });
 }
 
-static void CreateGBuffer(CascadedShadowMap* shadowMap, GTAO* gtao) {
+static void CreateGBuffer() {
     gbuffer.extent = Device::ptr->GetSwapchainExtent();
 
     CreateGBufferResources();
     CreateGBufferBindings();
-
-    // Pipelines are created separately after GTAO is initialized,
-    // since the deferred pipeline needs GTAO's bind group layout.
-    if (gtao)
-        CreateGBufferPipelines(shadowMap, gtao);
 }
 
 static void DestroyGBufferPipelines() {
     ResourceManager::ptr->DestroyPipeline(gbuffer.offscreen);
+    ResourceManager::ptr->DestroyPipeline(gbuffer.offscreenEqual);
+    ResourceManager::ptr->DestroyPipeline(gbuffer.depthPrepassPipeline);
     ResourceManager::ptr->DestroyPipeline(gbuffer.deferred);
+    ResourceManager::ptr->DestroyPipeline(gbuffer.tiledDeferred);
+    ResourceManager::ptr->DestroyPipeline(gbuffer.blit);
+    ResourceManager::ptr->DestroyPipeline(gbuffer.lightVolume);
 }
 
 static void DestroyGBufferResources() {
     ResourceManager::ptr->DestroyTexture(gbuffer.albedo);
     ResourceManager::ptr->DestroyTexture(gbuffer.normal);
-    ResourceManager::ptr->DestroyTexture(gbuffer.metallicRoughness);
+    ResourceManager::ptr->DestroyTexture(gbuffer.roughnessAO);
     ResourceManager::ptr->DestroyTexture(gbuffer.depth);
+    ResourceManager::ptr->DestroyTexture(gbuffer.lighting);
 }
 
 static void DestroyGBufferBindings() {
     for (Handle<Buffer> buffer : gbuffer.deferredUBO)
         ResourceManager::ptr->DestroyBuffer(buffer);
 
+    ResourceManager::ptr->DestroyBindGroupLayout(gbuffer.drawLayout);
     ResourceManager::ptr->DestroyBindGroupLayout(gbuffer.materialLayout);
     ResourceManager::ptr->DestroyBindGroupLayout(gbuffer.globalsLayout);
+    ResourceManager::ptr->DestroyBindGroupLayout(gbuffer.lightingLayout);
+    ResourceManager::ptr->DestroyBindGroupLayout(gbuffer.blitLayout);
 }
 
 static void DestroyGBuffer() {
@@ -646,33 +1031,62 @@ void ResizeGBuffer() {
         ResourceManager::ptr->UpdateBindGroupTextures(bindgroup, {
             { 0, gbuffer.albedo },
             { 1, gbuffer.normal },
-            { 2, gbuffer.metallicRoughness },
+            { 2, gbuffer.roughnessAO },
             { 3, gbuffer.depth }
         });
     }
+
+    ResourceManager::ptr->UpdateBindGroupTextures(gbuffer.lightingBindings, { { 0, gbuffer.lighting } });
+    ResourceManager::ptr->UpdateBindGroupTextures(gbuffer.blitBindings, { { 0, gbuffer.lighting } });
 }
 
-void UpdateGBufferUBO(CascadedShadowMap* shadowMap) {
+void UpdateGBufferUBO(CascadedShadowMap* shadowMap, ClusteredLights* lights) {
     DeferredUBO ubo = {
         .view = camera->view,
         .invProj = glm::inverse(camera->projection),
         .camPos = glm::vec4(camera->position, 1.0f),
         .shadowData = shadowMap->m_shadowData,
-        .pointLightCount = MAX_POINT_LIGHTS,
-        .dirLight = dirLight,
-        .pointLights = {}
+        .clusterData = lights->m_clusterData,
+        .dirLight = dirLight
     };
 
-    for (i32 i = 0; i < MAX_POINT_LIGHTS; i++)
-        ubo.pointLights[i] = {
-            .position = glm::vec3(2.5f * (i - 10), (i/10) * 4.0f + 1.0f, ((i % 3) - 1) * 2.5f),
-            .ambient = glm::vec3(1.2f, 1.0f, 1.0f),
-            .diffuse = glm::vec3(1.4f, 1.0f, 1.0f)
-        };
-
     ResourceManager::ptr->WriteBuffer(gbuffer.deferredUBO[Device::ptr->FrameIdx()], &ubo, sizeof(ubo), 0);
 }
 
+// Integer hash mapped to [0, 1), so every light keeps its position and color as the count changes.
+static float PointLightRandom(u32 x) {
+    x ^= x >> 16; x *= 0x7feb352dU;
+    x ^= x >> 15; x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return (x >> 8) * (1.0f / (1 << 24));
+}
+
+static glm::vec3 PointLightPosition(u32 i, float time) {
+    const float bob = bAnimatePointLights ? 0.5f * glm::sin(time + 6.2831853f * PointLightRandom(5 * i + 3)) : 0.0f;
+    return glm::vec3(-12.0f + 24.0f * PointLightRandom(5 * i), 0.5f + 7.5f * PointLightRandom(5 * i + 1) + bob, -5.0f + 10.0f * PointLightRandom(5 * i + 2));
+}
+
+void SetPointLightCount(u32 count) {
+    while (pointLights.size() > count) {
+        g_lightManager->RemovePointLight(pointLights.back());
+        pointLights.pop_back();
+    }
+
+    const float time = float(glfwGetTime());
+    for (u32 i = (u32)pointLights.size(); i < count; i++) {
+        pointLights.push_back(g_lightManager->AddPointLight({
+            .position = PointLightPosition(i, time),
+            .radius   = pointLightRadius,
+            .color    = 1.5f * glm::mix(glm::vec3(1.0f), glm::vec3(PointLightRandom(5 * i + 4), PointLightRandom(5 * i + 3), PointLightRandom(5 * i + 1)), 0.5f)
+        }));
+    }
+}
+
+void PlacePointLights(float time) {
+    for (u32 i = 0; i < pointLights.size(); i++)
+        g_lightManager->SetPosition(pointLights[i], PointLightPosition(i, time));
+}
+
 void ImGuiRenderCallback() {
     ImGui::Begin("Bozo Engine", 0, 0);
     ImGui::SliderFloat3("dir", &dirLight.direction[0], -1.0f, 1.0f);
@@ -682,12 +1096,69 @@ void ImGuiRenderCallback() {
     ImGui::ColorEdit3("Ambient", &dirLight.ambient.x, ImGuiColorEditFlags_Float);
     ImGui::ColorEdit3("Diffuse", &dirLight.diffuse.x, ImGuiColorEditFlags_Float);
 
+    ImGui::SeparatorText("Point Light settings");
+    const u32 minLights = 0;
+    const u32 maxLights = LightManager::MaxLights;
+    if (ImGui::SliderScalar("Point lights", ImGuiDataType_U32, &pointLightCount, &minLights, &maxLights))
+        SetPointLightCount(pointLightCount);
+    if (ImGui::SliderFloat("Point light radius", &pointLightRadius, 0.1f, 8.0f)) {
+        for (Handle<PointLight> light : pointLights)
+            g_lightManager->SetRadius(light, pointLightRadius);
+    }
+    if (ImGui::Checkbox("Animate point lights", &bAnimatePointLights))
+        PlacePointLights(float(glfwGetTime()));
+    ImGui::Checkbox("Clustered lighting", &g_lights->settings.clustered);
+
     if (ImGui::CollapsingHeader("Shadow settings", ImGuiTreeNodeFlags_DefaultOpen)) {
         ImGui::Checkbox("Visualize cascades", (bool*)&gbuffer.settings.colorCascades);
-        ImGui::Checkbox("Enable PCF", (bool*)&gbuffer.settings.enablePCF);
+        const u32 pcfTaps[] = { 1, 4, 9, 16 };
+        const char* pcfKernels[] = { "1 tap", "4 taps (rotated grid)", "9 taps (3x3 grid)", "16 taps (rotated Poisson disk)" };
+
+        int pcfKernel = 0;
+        while (pcfTaps[pcfKernel] != gbuffer.pcfTaps) pcfKernel++;
+        if (ImGui::Combo("PCF kernel", &pcfKernel, pcfKernels, (int)arraysize(pcfKernels))) {
+            gbuffer.pcfTaps = pcfTaps[pcfKernel];
+            gbuffer.rebuildPipelines = true;
+        }
+        if (ImGui::Checkbox("EVSM filtering", &g_shadowMap->settings.evsm)) {
+            gbuffer.rebuildPipelines = true;
+        }
+        if (g_shadowMap->settings.evsm) {
+            const u32 minRadius = 0;
+            const u32 maxRadius = 8;
+            ImGui::SliderScalar("EVSM blur radius", ImGuiDataType_U32, &g_shadowMap->settings.evsmBlurRadius, &minRadius, &maxRadius);
+            ImGui::SliderFloat("EVSM exponent", &g_shadowMap->settings.evsmExponent, 1.0f, 42.0f);
+            ImGui::SliderFloat("Light bleeding reduction", &g_shadowMap->settings.evsmBleedReduction, 0.0f, 0.9f);
+        }
+        int cascadeCount = (int)g_shadowMap->CascadeCount();
+        if (ImGui::SliderInt("Cascades", &cascadeCount, 1, CascadedShadowMap::MaxCascades)) {
+            g_shadowMap->SetCascadeCount((u32)cascadeCount);
+        }
+        ImGui::Checkbox("Single-pass cascades", &g_shadowMap->settings.singlePass);
+        ImGui::Checkbox("Fit cascades to visible depth (SDSM)", &g_shadowMap->settings.sdsm);
+        if (g_shadowMap->settings.sdsm) {
+            ImGui::SliderFloat("Split lambda", &g_shadowMap->settings.sdsmLambda, 0.0f, 1.0f);
+        }
+        ImGui::Checkbox("Cache cascades", &g_shadowMap->settings.caching);
+        ImGui::Checkbox("Cache static casters", &g_shadowMap->settings.staticCaching);
+        ImGui::Checkbox("Cull casters without visible receivers", &g_shadowMap->settings.receiverCulling);
+        ImGui::Checkbox("Time-slice cascade updates", &g_shadowMap->settings.timeSlicing);
+        if (g_shadowMap->settings.timeSlicing) {
+            const u32 minInterval = 1;
+            const u32 maxInterval = 8;
+            ImGui::SliderScalarN("Update intervals", ImGuiDataType_U32, g_shadowMap->settings.updateIntervals, (int)g_shadowMap->CascadeCount(), &minInterval, &maxInterval);
+        }
     }
 
     if (ImGui::CollapsingHeader("Render Mode", ImGuiTreeNodeFlags_DefaultOpen)) {
+        ImGui::Checkbox("Visibility buffer", &gbuffer.visibilityBuffer);
+        if (!gbuffer.visibilityBuffer)
+            ImGui::Checkbox("Depth prepass", &gbuffer.depthPrepass);
+        ImGui::Checkbox("Tiled compute lighting", &gbuffer.computeLighting);
+        if (ImGui::Checkbox("Point light volumes", &gbuffer.lightVolumes)) {
+            gbuffer.rebuildPipelines = true;
+        }
+
         ImGui::BeginTable("split", 2);
 
         ImGui::TableNextColumn(); if (ImGui::RadioButton("Deferred", gbuffer.settings.renderMode == 0)) { gbuffer.settings.renderMode = 0; }